@@ -0,0 +1,1178 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_CONTAINER_
+#define _NUWAINFO_LRU_CONTAINER_
+
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include <boost/bimap.hpp>
+#include <boost/bimap/list_of.hpp>
+#include <boost/bimap/unordered_set_of.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/predef/other/endian.h>
+
+#include "Eviction.hpp"
+#include "Hash.hpp"
+#include "Slab.hpp"
+
+#if defined(__GNUC__)
+#define LRU_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define LRU_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define LRU_PREFETCH(p)
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LRU_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace LRUImpl
+{
+
+// Storage engines of LRU.
+// A storage engine keeps records in recency order, it does not lock and
+// does not know capacity, LRU does both. Interface:
+//
+// Iterator                  Record handle, stable until record is purged.
+// Position                  Result of a failed probe, to insert without
+//                           probing again.
+// SharedHit                 Find and Touch can run under a shared lock.
+// Find(k, pos)              Probe key, End() if not found.
+// Refind(k, pos)            Probe again after lock is re-acquired, using
+//                           the hash kept in pos if possible.
+// Hash(k, pos)              Hash key into pos, no lock is required.
+// Prefetch(pos)             Prefetch index of key hashed into pos.
+// FindHashed(k, pos)        Probe key hashed into pos.
+// Insert(k, v, pos)         Insert at most-recently-used end, pos may be
+//                           NULL; existing record is kept.
+// Touch(it)                 Record is hit, make it most-recently-used.
+// Victim()                  Pick least-recently-used (or the victim of
+//                           eviction policy) record, never the record
+//                           just inserted if there is another one.
+// Evict(it)                 Purge victim.
+// Pending()                 Deferred hits are waiting for Drain.
+// Drain()                   Apply deferred hits, exclusive lock is held.
+// Key(it), Value(it), Size(), Contains(k), GetKeys(dst).
+// Resize(n)                 Capacity changes to n, storage grows to hold
+//                           n records without pause, LRU purges records
+//                           over it.
+// Compact()                 Capacity shrinks, return memory of records
+//                           as they are purged, a little at a time.
+// Expiration(it)            Expiry and refresh state of record, reset on
+//                           insertion.
+//
+// Find, Refind, Hash and FindHashed take a view of key too (see 
+// LRUKeyView), which hashes and compares equal to the key it views; only
+// FlatContainer probes by the view without building the key.
+//
+// Storage selectors are metafunction classes,
+// Storage::apply<K, V>::type is the storage engine.
+
+/**
+Expiry and refresh state of record, times are milliseconds of the cache
+clock, see TimerWheel.
+*/
+struct Expiry
+{
+ Expiry() : ttl(0), deadline(0), scheduled(0), loaded(0), cost(0),
+            refreshing(false)
+ {
+ }
+
+ /// Time to live, 0 means never expires.
+ boost::uint32_t ttl;
+
+ /// Expiration time.
+ boost::uint32_t deadline;
+
+ /// Deadline of timer pending in wheel, timer is stale if it differs.
+ boost::uint32_t scheduled;
+
+ /// Time value is loaded, in refresh mode.
+ boost::uint32_t loaded;
+
+ /// Time taken to evaluate value.
+ boost::uint32_t cost;
+
+ /// Value is being refreshed.
+ bool refreshing;
+};
+
+/**
+Storage engine based on boost::bimaps, a hashed view of keys and a list
+view of values in recency order (head is least-recently-used). Nodes are
+allocated from a Slab of the container, the node of the purged record is
+reused by the next one inserted, and chunks emptied after shrinking are
+returned to the heap (see Slab). The left map view builds the key of a
+view of key to find it, bimap does not expose its hashed index to probe 
+by the view, FlatContainer does.
+
+@param K Key type.
+@param V Value type.
+*/
+template<typename K, typename V>
+class BimapContainer
+{
+public:
+
+ /// Value and its expiry.
+ struct Entry
+ {
+  Entry(const V& v) : value(v)
+  {
+  }
+
+  V value;
+  Expiry expiry;
+ };
+
+ typedef boost::bimaps::bimap<
+  boost::bimaps::unordered_set_of<K, LRUHash, LRUEqual>,
+  boost::bimaps::list_of<Entry>,
+  SlabAllocator<char>
+ > ContainerType;
+
+ typedef typename ContainerType::left_iterator Iterator;
+
+ /// Probe position, hashed view does not accept insertion hint.
+ struct Position
+ {
+ };
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ /**
+ Constructor.
+
+ @param capacity Maximum number of records, not used.
+ */
+ explicit BimapContainer(const std::size_t /*capacity*/ = 0) : 
+  slab(new Slab()), 
+  container(typename ContainerType::allocator_type(slab))
+ {
+ }
+
+ template<typename Q>
+ inline Iterator Find(const Q& k, Position&)
+ {
+  return container.left.find(k);
+ }
+
+ template<typename Q>
+ inline Iterator Refind(const Q& k, Position&)
+ {
+  return container.left.find(k);
+ }
+
+ template<typename Q>
+ static inline void Hash(const Q&, Position&)
+ {
+ }
+
+ inline void Prefetch(const Position&) const
+ {
+ }
+
+ template<typename Q>
+ inline Iterator FindHashed(const Q& k, Position&)
+ {
+  return container.left.find(k);
+ }
+
+ inline Iterator End()
+ {
+  return container.left.end();
+ }
+
+ inline bool Contains(const K& k) const
+ {
+  return container.left.find(k) != container.left.end();
+ }
+
+ inline const K& Key(const Iterator& it) const
+ {
+  return it->first;
+ }
+
+ inline V& Value(const Iterator& it) const
+ {
+  return it->second.value;
+ }
+
+ inline Expiry& Expiration(const Iterator& it) const
+ {
+  return it->second.expiry;
+ }
+
+ std::pair<Iterator, bool> Insert(const K& k, const V& v, Position*)
+ {
+  // Create a new record from the key and the value bimap's list_view
+  // defaults to inserting this at the list tail
+  // (considered most-recently-used).
+  const std::pair<typename ContainerType::iterator, bool> r =
+   container.insert(typename ContainerType::value_type(k, Entry(v)));
+
+  return std::make_pair(container.project_left(r.first), r.second);
+ }
+
+ inline void Touch(const Iterator& it)
+ {
+  // Update the access record view.
+  container.right.relocate(container.right.end(),
+                           container.project_right(it));
+ }
+
+ inline Iterator Victim()
+ {
+  // The least-recently-used element.
+  return container.project_left(container.right.begin());
+ }
+
+ inline void Evict(const Iterator& it)
+ {
+  container.left.erase(it);
+ }
+
+ inline std::size_t Size() const
+ {
+  return container.size();
+ }
+
+ inline void Resize(const std::size_t)
+ {
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ inline void Drain()
+ {
+ }
+
+ inline void Compact()
+ {
+  slab->Shrink();
+ }
+
+ /**
+ Obtain the keys, most recently used element at head.
+
+ @param dst Result container iterator.
+ */
+ template<typename IT>
+ void GetKeys(IT& dst) const
+ {
+  typename ContainerType::right_const_reverse_iterator src =
+   container.right.rbegin();
+
+  while(src != container.right.rend())
+   *dst++ = (*src++).second;
+ }
+
+ /**
+ Slab of nodes, it counts heap traffic of the container.
+
+ @return Slab.
+ */
+ inline const Slab& Nodes() const
+ {
+  return *slab;
+ }
+
+private:
+
+ /// Nodes of container.
+ boost::shared_ptr<Slab> slab;
+
+ /// Internal container.
+ ContainerType container;
+
+};
+
+/**
+Storage selector of BimapContainer, default of LRU.
+*/
+struct BimapStorage
+{
+ template<typename K, typename V>
+ struct apply
+ {
+  typedef BimapContainer<K, V> type;
+ };
+};
+
+/**
+Array in chunks of 2^Bits elements, growing only reallocates the last 
+chunk if it is short, so it moves no more than a chunk of elements. 
+Elements are default-constructed and only grow.
+
+@param T Element type.
+@param Bits Bits of index in chunk.
+*/
+template<typename T, unsigned Bits = 12>
+class ChunkArray : private boost::noncopyable
+{
+public:
+
+ typedef T value_type;
+
+ /// Elements of a full chunk.
+ static const std::size_t ChunkSize = (std::size_t)1 << Bits;
+
+public:
+
+ ChunkArray() : count(0)
+ {
+ }
+
+ ~ChunkArray()
+ {
+  for(std::size_t i = 0; i < chunks.size(); i++)
+   delete[] chunks[i];
+ }
+
+ inline T& operator[](const std::size_t i)
+ {
+  return chunks[i >> Bits][i & (ChunkSize - 1)];
+ }
+
+ inline const T& operator[](const std::size_t i) const
+ {
+  return chunks[i >> Bits][i & (ChunkSize - 1)];
+ }
+
+ inline std::size_t size() const
+ {
+  return count;
+ }
+
+ /**
+ Grow to n elements, the last chunk is only as long as required.
+
+ @param n Number of elements.
+ */
+ void resize(const std::size_t n)
+ {
+  while(count < n)
+  {
+   // Elements in the last chunk if it is short.
+   const std::size_t used = count & (ChunkSize - 1);
+   const std::size_t m = (std::min)(n - (count - used), 
+                                    (std::size_t)ChunkSize);
+
+   T* chunk = new T[m];
+
+   if(used)
+   {
+    for(std::size_t i = 0; i < used; i++)
+     std::swap(chunk[i], chunks.back()[i]);
+
+    delete[] chunks.back();
+    chunks.back() = chunk;
+   }
+   else
+   {
+    chunks.push_back(chunk);
+   }
+
+   count += m - used;
+  }
+ }
+
+private:
+
+ /// Chunks.
+ std::vector<T*> chunks;
+
+ /// Number of elements.
+ std::size_t count;
+
+};
+
+/**
+Index probing of FlatContainer slot by slot, comparing hash tags of slots.
+*/
+struct SlotProbing
+{
+ static const bool Grouped = false;
+};
+
+/**
+Index probing of FlatContainer by groups of 16 control bytes (as Swiss 
+tables do), a control byte per slot holds 7 bits of hash tag or Empty. A 
+group is compared in one SSE2 instruction (or 2 64-bit words elsewhere), 
+so most misses are rejected by the control bytes alone, without touching 
+slots or keys, and a hit touches one slot and one key. It takes a byte per 
+slot more, and pays off for large caches whose index is not in cache.
+*/
+struct GroupProbing
+{
+ static const bool Grouped = true;
+};
+
+/**
+Group of 16 control bytes, see GroupProbing. Without SSE2, a group is 
+matched as 2 little-endian 64-bit words, or byte by byte.
+*/
+struct ControlGroup
+{
+ /// Slots in a group.
+ static const std::size_t Size = 16;
+
+ /// Control byte of empty slot, control bytes of slots are 7 bits.
+ static const boost::uint8_t Empty = 0x80;
+
+ /**
+ Control byte of hash tag, bits not used by home slot of small indices.
+
+ @param tag Hash tag.
+ @return Control byte.
+ */
+ static inline boost::uint8_t Control(const boost::uint32_t tag)
+ {
+  return (boost::uint8_t)(tag >> 25);
+ }
+
+ /**
+ Match control bytes of a group.
+
+ @param p Control bytes, 16 of them.
+ @param c Control byte to match.
+ @param match Output bit i is set if byte i is c.
+ @param empty Output bit i is set if byte i is Empty.
+ */
+ static inline void Match(const boost::uint8_t* p, const boost::uint8_t c, 
+                          boost::uint32_t& match, boost::uint32_t& empty)
+ {
+#ifdef LRU_SSE2
+  const __m128i g = _mm_loadu_si128((const __m128i*)p);
+
+  match = (boost::uint32_t)_mm_movemask_epi8(
+   _mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+  empty = (boost::uint32_t)_mm_movemask_epi8(g);
+#elif BOOST_ENDIAN_LITTLE_BYTE
+  boost::uint64_t lo, hi;
+  std::memcpy(&lo, p, sizeof(lo));
+  std::memcpy(&hi, p + 8, sizeof(hi));
+
+  match = Bits(Zeros(lo ^ Repeat(c))) | 
+          (Bits(Zeros(hi ^ Repeat(c))) << 8);
+  empty = Bits(lo & Repeat(Empty)) | (Bits(hi & Repeat(Empty)) << 8);
+#else
+  match = empty = 0;
+
+  for(std::size_t i = 0; i < Size; i++)
+  {
+   match |= (boost::uint32_t)(p[i] == c) << i;
+   empty |= (boost::uint32_t)(p[i] == Empty) << i;
+  }
+#endif
+ }
+
+ /**
+ Index of lowest bit set.
+
+ @param m Bits, not 0.
+ @return Index.
+ */
+ static inline unsigned Lowest(const boost::uint32_t m)
+ {
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctz(m);
+#elif defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward(&i, m);
+
+  return (unsigned)i;
+#else
+  unsigned i = 0;
+  while(!(m >> i & 1))
+   i++;
+
+  return i;
+#endif
+ }
+
+private:
+
+ /// Byte repeated in a word.
+ static inline boost::uint64_t Repeat(const boost::uint8_t c)
+ {
+  return c * 0x0101010101010101ULL;
+ }
+
+ /// High bit of zero bytes set, bytes above a zero byte may be set too 
+ /// (they are checked by keys anyway), control bytes are little-endian.
+ static inline boost::uint64_t Zeros(const boost::uint64_t x)
+ {
+  return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+ }
+
+ /// Gather high bits of bytes into 8 bits, byte i to bit i.
+ static inline boost::uint32_t Bits(const boost::uint64_t x)
+ {
+  return (boost::uint32_t)(((x >> 7) * 0x0102040810204080ULL) >> 56);
+ }
+};
+
+/**
+Flat storage engine: records live in a contiguous array preallocated to
+capacity, ordered by an eviction policy on 32-bit record indices (for
+LRUEviction, the recency list is kept as prev/next indices inside records).
+Keys are indexed by an open-addressing (linear probing) table of
+{hash tag, record index} pairs, so a probe compares tags in the index and
+touches a record only when tags match. Purged records are recycled through
+a free list, no allocation happens after construction unless it grows.
+With GroupProbing, the index is probed by groups of control bytes too.
+
+Growing (see Resize) adds records a chunk at a time (see ChunkArray) as 
+they are needed. The index doubles when it is half full: the old one is 
+kept and migrated to the new one a few slots on every insertion, probes 
+look into the old one for records not migrated yet, so no insertion 
+rehashes the whole index.
+
+@param K Key type.
+@param V Value type.
+@param Eviction Eviction policy, see Eviction.hpp.
+@param Probing Index probing, SlotProbing or GroupProbing.
+*/
+template<
+ typename K, 
+ typename V, 
+ typename Eviction = LRUEviction, 
+ typename Probing = SlotProbing
+>
+class FlatContainer
+{
+public:
+
+ /// Record index.
+ typedef RecordIndex Iterator;
+
+ /// Probe position, keeps hash tag and the empty slot probe stopped at.
+ struct Position
+ {
+  Position() : tag(0), slot(0), version(0)
+  {
+  }
+
+  /// Hash tag of key.
+  boost::uint32_t tag;
+
+  /// Index slot to insert.
+  std::size_t slot;
+
+  /// Container version when probed, 0 if not probed.
+  std::size_t version;
+ };
+
+ /// Record.
+ struct Record
+ {
+  typedef typename Eviction::Hook HookType;
+
+  K key;
+  V value;
+
+  /// Hash tag, next free record if record is free.
+  boost::uint32_t tag;
+
+  /// Eviction policy data.
+  HookType hook;
+
+  Expiry expiry;
+ };
+
+ typedef ChunkArray<Record> RecordTable;
+
+ /// Hits can run under a shared lock.
+ static const bool SharedHit = Eviction::SharedHit;
+
+public:
+
+ /**
+ Constructor, preallocate records and index.
+
+ @param capacity Maximum number of records.
+ */
+ explicit FlatContainer(const std::size_t capacity = 0) :
+  cursor(0), size(0), limit(capacity), version(1), free(NilRecord), 
+  eviction(capacity + 1)
+ {
+  // One spare record, LRU inserts before purging.
+  Allocate(capacity + 1);
+
+  std::size_t n = 8;
+  while(n < (capacity + 1) * 2)
+   n <<= 1;
+
+  slots.resize(n);
+  mask = n - 1;
+  ClearControls();
+ }
+
+ template<typename Q>
+ Iterator Find(const Q& k, Position& pos) const
+ {
+  pos.tag = Tag(k);
+  pos.version = version;
+
+  return Search(k, pos);
+ }
+
+ template<typename Q>
+ Iterator Refind(const Q& k, Position& pos) const
+ {
+  if(pos.version == version)
+   return NilRecord;
+
+  if(pos.version == 0)
+   return Find(k, pos);
+
+  return Search(k, pos);
+ }
+
+ template<typename Q>
+ static inline void Hash(const Q& k, Position& pos)
+ {
+  pos.tag = Tag(k);
+ }
+
+ inline void Prefetch(const Position& pos) const
+ {
+  if(Probing::Grouped)
+   LRU_PREFETCH(&controls[pos.tag & mask]);
+  else
+   LRU_PREFETCH(&slots[pos.tag & mask]);
+ }
+
+ template<typename Q>
+ inline Iterator FindHashed(const Q& k, Position& pos) const
+ {
+  pos.version = version;
+
+  return Search(k, pos);
+ }
+
+ inline Iterator End() const
+ {
+  return NilRecord;
+ }
+
+ inline bool Contains(const K& k) const
+ {
+  Position pos;
+
+  return Find(k, pos) != NilRecord;
+ }
+
+ inline const K& Key(const Iterator& it) const
+ {
+  return records[it].key;
+ }
+
+ inline V& Value(const Iterator& it) const
+ {
+  return records[it].value;
+ }
+
+ inline Expiry& Expiration(const Iterator& it) const
+ {
+  return records[it].expiry;
+ }
+
+ std::pair<Iterator, bool> Insert(const K& k, const V& v, Position* pos)
+ {
+  Position p;
+
+  if(!pos)
+   pos = &p;
+
+  // Grow records and index, positions probed before are invalidated.
+  if(free == NilRecord)
+   Allocate((std::min)(records.size() + RecordTable::ChunkSize, 
+                       (std::size_t)(limit + 1)));
+
+  if((size + 1) * 2 > slots.size())
+   Rehash();
+
+  // Container changed since probe, probe again by tag without hashing.
+  if(pos->version != version)
+  {
+   const Iterator it = Refind(k, *pos);
+   if(it != NilRecord)
+    return std::make_pair(it, false);
+  }
+
+  const Iterator it = free;
+  Record& r = records[it];
+  free = r.tag;
+
+  r.key = k;
+  r.value = v;
+  r.tag = pos->tag;
+  r.expiry = Expiry();
+  eviction.Insert(records, it);
+
+  Slot s;
+  s.tag = pos->tag;
+  s.record = it + 1;
+  Set(pos->slot, s);
+
+  size++;
+  version++;
+
+  if(!old.empty())
+   Migrate(MigrateStep);
+
+  return std::make_pair(it, true);
+ }
+
+ inline void Touch(const Iterator& it)
+ {
+  eviction.Touch(records, it);
+ }
+
+ inline Iterator Victim()
+ {
+  return eviction.Victim(records);
+ }
+
+ void Evict(const Iterator it)
+ {
+  Erase(it);
+  eviction.Erase(records, it);
+
+  // Release memory owned by key and value.
+  K k = K();
+  V v = V();
+  std::swap(records[it].key, k);
+  std::swap(records[it].value, v);
+
+  records[it].tag = free;
+  free = it;
+
+  size--;
+  version++;
+ }
+
+ inline std::size_t Size() const
+ {
+  return size;
+ }
+
+ /**
+ Capacity changes, records are added when they are needed.
+
+ @param n Capacity.
+ */
+ void Resize(const std::size_t n)
+ {
+  limit = n;
+  eviction.Resize(n + 1);
+ }
+
+ inline bool Pending() const
+ {
+  return eviction.Pending();
+ }
+
+ inline void Drain()
+ {
+  eviction.Drain(records);
+ }
+
+ /**
+ Records are indexed in chunks and recycled through free list, memory is
+ kept for capacity to grow back.
+ */
+ inline void Compact()
+ {
+ }
+
+ /**
+ Obtain the keys, most valuable (most recently used) element at head.
+
+ @param dst Result container iterator.
+ */
+ template<typename IT>
+ void GetKeys(IT& dst) const
+ {
+  eviction.GetKeys(records, dst);
+ }
+
+private:
+
+ /// Slots of old index migrated on every insertion.
+ static const std::size_t MigrateStep = 8;
+
+ /// Record of old index slot whose record is purged before migration.
+ static const boost::uint32_t Tombstone = 0xffffffff;
+
+ /// Index slot, record is index + 1, 0 means empty.
+ struct Slot
+ {
+  Slot() : tag(0), record(0)
+  {
+  }
+
+  boost::uint32_t tag;
+  boost::uint32_t record;
+ };
+
+ /**
+ Hash key, home slot is tag & mask. LRUHasher mixes bits, so the tag is the 
+ hash folded.
+
+ @param k Key.
+ @return Hash tag.
+ */
+ template<typename Q>
+ static inline boost::uint32_t Tag(const Q& k)
+ {
+  const boost::uint64_t h = LRUHasher<Q>::Hash(k);
+
+  return (boost::uint32_t)(h ^ (h >> 32));
+ }
+
+ /**
+ Probe key by tag in the way of Probing.
+
+ @param k Key.
+ @param pos Probe position with tag.
+ @return Record index, NilRecord if not found.
+ */
+ template<typename Q>
+ inline Iterator Search(const Q& k, Position& pos) const
+ {
+  return Probing::Grouped ? ProbeGroups(k, pos) : Probe(k, pos);
+ }
+
+ /**
+ Probe key by tag, keep the empty slot probe stopped at.
+
+ @param k Key.
+ @param pos Probe position with tag.
+ @return Record index, NilRecord if not found.
+ */
+ template<typename Q>
+ Iterator Probe(const Q& k, Position& pos) const
+ {
+  std::size_t i = pos.tag & mask;
+
+  for(;;)
+  {
+   const Slot& s = slots[i];
+
+   if(!s.record)
+    break;
+
+   if(s.tag == pos.tag && records[s.record - 1].key == k)
+    return s.record - 1;
+
+   i = (i + 1) & mask;
+  }
+
+  pos.slot = i;
+  pos.version = version;
+
+  return old.empty() ? NilRecord : ProbeOld(k, pos.tag);
+ }
+
+ /**
+ Probe key by groups of control bytes from its home slot, slots up to the 
+ first empty one are the slots Probe compares, keep the empty slot.
+
+ @param k Key.
+ @param pos Probe position with tag.
+ @return Record index, NilRecord if not found.
+ */
+ template<typename Q>
+ Iterator ProbeGroups(const Q& k, Position& pos) const
+ {
+  const boost::uint8_t c = ControlGroup::Control(pos.tag);
+  std::size_t i = pos.tag & mask;
+
+  // Hits are mostly in home slot, fetch it along with control bytes.
+  LRU_PREFETCH(&slots[i]);
+
+  for(;;)
+  {
+   boost::uint32_t match, empty;
+   ControlGroup::Match(&controls[i], c, match, empty);
+
+   // Slots after the first empty one are not probed.
+   if(empty)
+    match &= (empty & (0u - empty)) - 1;
+
+   for(; match; match &= match - 1)
+   {
+    const Slot& s = slots[(i + ControlGroup::Lowest(match)) & mask];
+
+    if(s.tag == pos.tag && records[s.record - 1].key == k)
+     return s.record - 1;
+   }
+
+   if(empty)
+   {
+    i = (i + ControlGroup::Lowest(empty)) & mask;
+    break;
+   }
+
+   i = (i + ControlGroup::Size) & mask;
+  }
+
+  pos.slot = i;
+  pos.version = version;
+
+  return old.empty() ? NilRecord : ProbeOld(k, pos.tag);
+ }
+
+ /**
+ Probe key in old index, skip slots migrated already.
+
+ @param k Key.
+ @param tag Hash tag.
+ @return Record index, NilRecord if not found.
+ */
+ template<typename Q>
+ Iterator ProbeOld(const Q& k, const boost::uint32_t tag) const
+ {
+  for(std::size_t i = tag & oldMask; old[i].record; i = (i + 1) & oldMask)
+  {
+   const Slot& s = old[i];
+
+   if(i >= cursor && s.record != Tombstone && s.tag == tag && 
+      records[s.record - 1].key == k)
+    return s.record - 1;
+  }
+
+  return NilRecord;
+ }
+
+ /**
+ Add records up to n, put them in free list. LRU purges a record for every 
+ record inserted over capacity, so records up to capacity and a spare one 
+ are enough.
+
+ @param n Number of records.
+ */
+ void Allocate(const std::size_t n)
+ {
+  const std::size_t m = records.size();
+
+  records.resize(n);
+
+  for(std::size_t i = n; i > m; i--)
+  {
+   records[i - 1].tag = free;
+   free = (Iterator)(i - 1);
+  }
+ }
+
+ /**
+ Double index, keep the old one to migrate.
+ */
+ void Rehash()
+ {
+  // Finish migration of last one.
+  Migrate(old.size());
+
+  old.swap(slots);
+  oldMask = mask;
+  cursor = 0;
+
+  slots.assign(old.size() * 2, Slot());
+  mask = slots.size() - 1;
+  ClearControls();
+
+  version++;
+ }
+
+ /**
+ Migrate slots of old index to index, drop old index when all are.
+
+ @param n Number of slots.
+ */
+ void Migrate(std::size_t n)
+ {
+  for(; n && cursor < old.size(); n--, cursor++)
+  {
+   const Slot& s = old[cursor];
+
+   if(!s.record || s.record == Tombstone)
+    continue;
+
+   std::size_t i = s.tag & mask;
+   while(slots[i].record)
+    i = (i + 1) & mask;
+
+   Set(i, s);
+  }
+
+  if(cursor == old.size() && !old.empty())
+   std::vector<Slot>().swap(old);
+
+  version++;
+ }
+
+ /**
+ Remove record from index by backward shift deletion,
+ no tombstone is left.
+
+ @param it Record index.
+ */
+ void Erase(const Iterator it)
+ {
+  std::size_t i = records[it].tag & mask;
+  while(slots[i].record && slots[i].record != it + 1)
+   i = (i + 1) & mask;
+
+  // Not migrated yet, leave a tombstone so old probes go on.
+  if(!slots[i].record)
+  {
+   i = records[it].tag & oldMask;
+   while(old[i].record != it + 1 || i < cursor)
+    i = (i + 1) & oldMask;
+
+   old[i].record = Tombstone;
+
+   return;
+  }
+
+  for(std::size_t j = (i + 1) & mask; slots[j].record; j = (j + 1) & mask)
+  {
+   const std::size_t home = slots[j].tag & mask;
+
+   // Move slot j back to hole i unless its home is cyclically in (i, j].
+   if((j > i && (home <= i || home > j)) ||
+      (j < i && (home <= i && home > j)))
+   {
+    Set(i, slots[j]);
+    i = j;
+   }
+  }
+
+  Set(i, Slot());
+ }
+
+ /**
+ Write index slot and its control byte.
+
+ @param i Slot index.
+ @param s Slot.
+ */
+ inline void Set(const std::size_t i, const Slot& s)
+ {
+  slots[i] = s;
+
+  if(!Probing::Grouped)
+   return;
+
+  const boost::uint8_t c = s.record ? ControlGroup::Control(s.tag) : 
+                                      (boost::uint8_t)ControlGroup::Empty;
+
+  // Bytes past the end mirror the first ones, so a group never wraps.
+  for(std::size_t j = i; j < controls.size(); j += slots.size())
+   controls[j] = c;
+ }
+
+ /**
+ Mark control bytes of all slots empty.
+ */
+ void ClearControls()
+ {
+  if(Probing::Grouped)
+   controls.assign(slots.size() + ControlGroup::Size - 1, 
+                   (boost::uint8_t)ControlGroup::Empty);
+ }
+
+private:
+
+ /// Records.
+ mutable RecordTable records;
+
+ /// Open-addressing index.
+ std::vector<Slot> slots;
+
+ /// Control bytes of index slots and a group less one mirroring the first 
+ /// ones, empty unless Probing is grouped.
+ std::vector<boost::uint8_t> controls;
+
+ /// Index mask, index size is power of 2.
+ std::size_t mask;
+
+ /// Old index being migrated, empty if none.
+ std::vector<Slot> old;
+
+ /// Old index mask.
+ std::size_t oldMask;
+
+ /// Slots of old index before it are migrated.
+ std::size_t cursor;
+
+ /// Number of records.
+ std::size_t size;
+
+ /// Capacity, records are added up to it and a spare one.
+ std::size_t limit;
+
+ /// Incremented when index changes.
+ std::size_t version;
+
+ /// Free records.
+ Iterator free;
+
+ /// Eviction policy, GetKeys may drain deferred hits.
+ mutable Eviction eviction;
+
+};
+
+/**
+Storage selector of FlatContainer.
+
+@param Eviction Eviction policy, LRUEviction, ClockEviction, 
+ BufferedEviction, TinyLFUEviction, SLRUEviction, TwoQueueEviction or 
+ ARCEviction.
+@param Probing Index probing, SlotProbing or GroupProbing.
+*/
+template<typename Eviction = LRUEviction, typename Probing = SlotProbing>
+struct FlatStorage
+{
+ template<typename K, typename V>
+ struct apply
+ {
+  typedef FlatContainer<K, V, Eviction, Probing> type;
+ };
+};
+
+}
+
+#endif
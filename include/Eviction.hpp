@@ -0,0 +1,1481 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_EVICTION_
+#define _NUWAINFO_LRU_EVICTION_
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "Parallel.hpp"
+
+namespace LRUImpl
+{
+
+/// Record index of flat storage.
+typedef boost::uint32_t RecordIndex;
+
+/// Null record index.
+const RecordIndex NilRecord = 0xffffffff;
+
+// Eviction policies of flat storage (FlatContainer).
+// A policy orders records by their indices and picks the victim to purge,
+// it may keep per-record data in Hook, a member of every record. Records
+// also have key and tag (hash of key). Interface:
+//
+// Hook                      Per-record data.
+// SharedHit                 Touch only updates atomics, so hits can run
+//                           under a shared lock.
+// Policy(n)                 Construct for n records, capacity + 1 (one
+//                           record is spare, inserted before purging).
+// Resize(n)                 Capacity changes, n is capacity + 1, records
+//                           are added up to it.
+// Insert(records, it)       Record is inserted.
+// Touch(records, it)        Record is hit.
+// Victim(records)           Pick record to purge, it is erased next. The
+//                           record just inserted is picked only if it is
+//                           the only one.
+// Erase(records, it)        Record is removed.
+// GetKeys(records, dst)     Obtain keys, most valuable first.
+// Pending()                 Deferred hits are waiting for Drain.
+// Drain(records)            Apply deferred hits, exclusive lock is held.
+
+/**
+Intrusive list of records linked by 32-bit prev/next indices in hooks,
+head is least-recently-used.
+*/
+class RecordList
+{
+public:
+
+ /// Links kept in record hook.
+ struct Hook
+ {
+  RecordIndex prev;
+  RecordIndex next;
+ };
+
+public:
+
+ RecordList() : head(NilRecord), tail(NilRecord), size(0)
+ {
+ }
+
+ inline RecordIndex Head() const
+ {
+  return head;
+ }
+
+ inline std::size_t Size() const
+ {
+  return size;
+ }
+
+ /**
+ Append record to most-recently-used end.
+
+ @param records Records.
+ @param it Record index.
+ */
+ template<typename R>
+ inline void PushBack(R& records, const RecordIndex it)
+ {
+  typename R::value_type::HookType& h = records[it].hook;
+
+  h.prev = tail;
+  h.next = NilRecord;
+
+  if(tail != NilRecord)
+   records[tail].hook.next = it;
+  else
+   head = it;
+
+  tail = it;
+  size++;
+ }
+
+ /**
+ Remove record from list.
+
+ @param records Records.
+ @param it Record index.
+ */
+ template<typename R>
+ inline void Remove(R& records, const RecordIndex it)
+ {
+  typename R::value_type::HookType& h = records[it].hook;
+
+  if(h.prev != NilRecord)
+   records[h.prev].hook.next = h.next;
+  else
+   head = h.next;
+
+  if(h.next != NilRecord)
+   records[h.next].hook.prev = h.prev;
+  else
+   tail = h.prev;
+
+  size--;
+ }
+
+ template<typename R>
+ inline void MoveToBack(R& records, const RecordIndex it)
+ {
+  if(it == tail)
+   return;
+
+  Remove(records, it);
+  PushBack(records, it);
+ }
+
+ /**
+ Obtain keys, most-recently-used first.
+
+ @param records Records.
+ @param dst Result container iterator.
+ */
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  for(RecordIndex it = tail; it != NilRecord; it = records[it].hook.prev)
+   *dst++ = records[it].key;
+ }
+
+private:
+
+ /// Least-recently-used record.
+ RecordIndex head;
+
+ /// Most-recently-used record.
+ RecordIndex tail;
+
+ /// Number of records.
+ std::size_t size;
+
+};
+
+/**
+Record lists of a segmented policy, each record is in one segment.
+
+@param N Number of segments.
+*/
+template<std::size_t N>
+class SegmentList
+{
+public:
+
+ /// Recency list links and segment of record.
+ struct Hook
+ {
+  RecordIndex prev;
+  RecordIndex next;
+  unsigned char segment;
+ };
+
+public:
+
+ inline RecordList& operator[](const unsigned char segment)
+ {
+  return lists[segment];
+ }
+
+ inline const RecordList& operator[](const unsigned char segment) const
+ {
+  return lists[segment];
+ }
+
+ /**
+ Append record to most-recently-used end of segment.
+
+ @param records Records.
+ @param it Record index.
+ @param segment Segment.
+ */
+ template<typename R>
+ inline void Link(R& records, const RecordIndex it, 
+                  const unsigned char segment)
+ {
+  records[it].hook.segment = segment;
+  lists[segment].PushBack(records, it);
+ }
+
+ template<typename R>
+ inline void Remove(R& records, const RecordIndex it)
+ {
+  lists[records[it].hook.segment].Remove(records, it);
+ }
+
+ /**
+ Move record to most-recently-used end of another segment.
+
+ @param records Records.
+ @param it Record index.
+ @param segment Segment to move to.
+ */
+ template<typename R>
+ inline void Move(R& records, const RecordIndex it, 
+                  const unsigned char segment)
+ {
+  Remove(records, it);
+  Link(records, it, segment);
+ }
+
+ /**
+ Make record most-recently-used in its segment.
+
+ @param records Records.
+ @param it Record index.
+ */
+ template<typename R>
+ inline void Touch(R& records, const RecordIndex it)
+ {
+  lists[records[it].hook.segment].MoveToBack(records, it);
+ }
+
+ std::size_t Size() const
+ {
+  std::size_t n = 0;
+
+  for(std::size_t i = 0; i < N; i++)
+   n += lists[i].Size();
+
+  return n;
+ }
+
+private:
+
+ /// Lists.
+ RecordList lists[N];
+
+};
+
+/**
+Ghost list, hash tags of purged keys in recency order, head is
+least-recently-used. Ghosts are indexed by an open-addressing table and
+preallocated to capacity like FlatContainer records, oldest ghost is
+dropped when full.
+*/
+class GhostList : private boost::noncopyable
+{
+public:
+
+ /**
+ Constructor.
+
+ @param n Maximum number of ghosts.
+ */
+ explicit GhostList(const std::size_t n = 0)
+ {
+  Reset(n);
+ }
+
+ /**
+ Change maximum number of ghosts, the most recent ghosts are kept.
+
+ @param n Maximum number of ghosts.
+ */
+ void Resize(const std::size_t n)
+ {
+  if(n == capacity)
+   return;
+
+  std::vector<boost::uint32_t> tags;
+  tags.reserve(list.Size());
+
+  for(RecordIndex it = list.Head(); it != NilRecord; 
+      it = ghosts[it].hook.next)
+   tags.push_back(ghosts[it].key);
+
+  Reset(n);
+
+  for(std::size_t i = tags.size() - (std::min)(n, tags.size()); 
+      i < tags.size(); i++)
+   Add(tags[i]);
+ }
+
+ inline std::size_t Size() const
+ {
+  return list.Size();
+ }
+
+ inline bool Contains(const boost::uint32_t tag) const
+ {
+  return Find(tag) != NilRecord;
+ }
+
+ /**
+ Add tag as most-recently-used ghost, drop the oldest one if full.
+
+ @param tag Hash tag.
+ */
+ void Add(const boost::uint32_t tag)
+ {
+  if(!capacity)
+   return;
+
+  const RecordIndex found = Find(tag);
+  if(found != NilRecord)
+  {
+   list.MoveToBack(ghosts, found);
+
+   return;
+  }
+
+  if(list.Size() == capacity)
+   PopFront();
+
+  const RecordIndex it = free;
+  free = ghosts[it].hook.next;
+
+  ghosts[it].key = tag;
+  list.PushBack(ghosts, it);
+
+  std::size_t i = tag & mask;
+  while(slots[i])
+   i = (i + 1) & mask;
+
+  slots[i] = it + 1;
+ }
+
+ /**
+ Remove ghost of tag.
+
+ @param tag Hash tag.
+ @return Whether ghost was there.
+ */
+ bool Remove(const boost::uint32_t tag)
+ {
+  const RecordIndex it = Find(tag);
+  if(it == NilRecord)
+   return false;
+
+  Erase(it);
+
+  return true;
+ }
+
+ /// Drop least-recently-used ghost.
+ inline void PopFront()
+ {
+  Erase(list.Head());
+ }
+
+private:
+
+ /// Ghost, key is hash tag.
+ struct Ghost
+ {
+  typedef RecordList::Hook HookType;
+
+  boost::uint32_t key;
+  HookType hook;
+ };
+
+ /**
+ Drop all ghosts and preallocate n.
+
+ @param n Maximum number of ghosts.
+ */
+ void Reset(const std::size_t n)
+ {
+  capacity = n;
+  free = NilRecord;
+  list = RecordList();
+
+  ghosts.assign(n ? n : 1, Ghost());
+
+  std::size_t m = 8;
+  while(m < ghosts.size() * 2)
+   m <<= 1;
+
+  slots.assign(m, 0);
+  mask = m - 1;
+
+  for(std::size_t i = ghosts.size(); i > 0; i--)
+  {
+   ghosts[i - 1].hook.next = free;
+   free = (RecordIndex)(i - 1);
+  }
+ }
+
+ RecordIndex Find(const boost::uint32_t tag) const
+ {
+  for(std::size_t i = tag & mask; slots[i]; i = (i + 1) & mask)
+   if(ghosts[slots[i] - 1].key == tag)
+    return slots[i] - 1;
+
+  return NilRecord;
+ }
+
+ /**
+ Remove ghost from list and index by backward shift deletion.
+
+ @param it Ghost index.
+ */
+ void Erase(const RecordIndex it)
+ {
+  list.Remove(ghosts, it);
+
+  std::size_t i = ghosts[it].key & mask;
+  while(slots[i] != it + 1)
+   i = (i + 1) & mask;
+
+  for(std::size_t j = (i + 1) & mask; slots[j]; j = (j + 1) & mask)
+  {
+   const std::size_t home = ghosts[slots[j] - 1].key & mask;
+
+   // Move slot j back to hole i unless its home is cyclically in (i, j].
+   if((j > i && (home <= i || home > j)) ||
+      (j < i && (home <= i && home > j)))
+   {
+    slots[i] = slots[j];
+    i = j;
+   }
+  }
+
+  slots[i] = 0;
+
+  ghosts[it].hook.next = free;
+  free = it;
+ }
+
+private:
+
+ /// Maximum number of ghosts.
+ std::size_t capacity;
+
+ /// Ghosts.
+ std::vector<Ghost> ghosts;
+
+ /// Open-addressing index, ghost index + 1, 0 means empty.
+ std::vector<boost::uint32_t> slots;
+
+ /// Index mask.
+ std::size_t mask;
+
+ /// Ghosts in recency order.
+ RecordList list;
+
+ /// Free ghosts.
+ RecordIndex free;
+
+};
+
+/**
+Least-recently-used eviction, records are linked in a RecordList.
+*/
+class LRUEviction : private boost::noncopyable
+{
+public:
+
+ /// Recency list links.
+ typedef RecordList::Hook Hook;
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ explicit LRUEviction(const std::size_t /*n*/ = 0)
+ {
+ }
+
+ inline void Resize(const std::size_t /*n*/)
+ {
+ }
+
+ template<typename R>
+ inline void Insert(R& records, const RecordIndex it)
+ {
+  list.PushBack(records, it);
+ }
+
+ template<typename R>
+ inline void Touch(R& records, const RecordIndex it)
+ {
+  list.MoveToBack(records, it);
+ }
+
+ template<typename R>
+ inline RecordIndex Victim(R& /*records*/)
+ {
+  return list.Head();
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  list.Remove(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  list.GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Recency list.
+ RecordList list;
+
+};
+
+/**
+CLOCK (second-chance) eviction, an approximation of LRU.
+A hit only sets the reference mark of record atomically, so hits do not
+mutate any shared structure and can run under a shared lock. The clock
+hand sweeps records in index order on eviction, clears marks it passes and
+stops at the first unmarked record.
+*/
+class ClockEviction : private boost::noncopyable
+{
+public:
+
+ /// No per-record links, marks are kept in a compact array.
+ struct Hook
+ {
+ };
+
+ /// Hit sets mark atomically, shared lock is enough.
+ static const bool SharedHit = true;
+
+public:
+
+ explicit ClockEviction(const std::size_t n = 0) :
+  marks(new boost::atomic<unsigned char>[n ? n : 1]), size(n), hand(0), 
+  used(0), last(NilRecord)
+ {
+  for(std::size_t i = 0; i < size; i++)
+   marks[i].store(Free, boost::memory_order_relaxed);
+ }
+
+ /// Marks grow only, records are not taken back.
+ void Resize(const std::size_t n)
+ {
+  if(n <= size)
+   return;
+
+  boost::scoped_array<boost::atomic<unsigned char> > m(
+   new boost::atomic<unsigned char>[n]);
+
+  for(std::size_t i = 0; i < n; i++)
+   m[i].store(i < size ? marks[i].load(boost::memory_order_relaxed) : 
+                         (unsigned char)Free, 
+              boost::memory_order_relaxed);
+
+  marks.swap(m);
+  size = n;
+ }
+
+ template<typename R>
+ inline void Insert(R& /*records*/, const RecordIndex it)
+ {
+  marks[it].store(Unmarked, boost::memory_order_relaxed);
+  last = it;
+  used++;
+ }
+
+ template<typename R>
+ inline void Touch(R& /*records*/, const RecordIndex it) const
+ {
+  // Avoid writing cache line again if it is marked already.
+  if(marks[it].load(boost::memory_order_relaxed) != Marked)
+   marks[it].store(Marked, boost::memory_order_relaxed);
+ }
+
+ template<typename R>
+ RecordIndex Victim(R& /*records*/)
+ {
+  // Record just inserted is left alone, the hand would pass it forever.
+  if(used == 1 && last != NilRecord)
+   return last;
+
+  for(;;)
+  {
+   const RecordIndex it = (RecordIndex)hand;
+
+   if(++hand == size)
+    hand = 0;
+
+   const unsigned char m = marks[it].load(boost::memory_order_relaxed);
+
+   // Record just inserted is never the victim.
+   if(m == Unmarked && it != last)
+    return it;
+
+   // Second chance.
+   if(m == Marked)
+    marks[it].store(Unmarked, boost::memory_order_relaxed);
+  }
+ }
+
+ template<typename R>
+ inline void Erase(R& /*records*/, const RecordIndex it)
+ {
+  marks[it].store(Free, boost::memory_order_relaxed);
+  used--;
+
+  if(it == last)
+   last = NilRecord;
+ }
+
+ /**
+ Obtain keys in the order hand will reach them backward,
+ most recently passed first.
+ */
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  for(std::size_t i = 0; i < size; i++)
+  {
+   const std::size_t it = (hand + size - 1 - i) % size;
+
+   if(marks[it].load(boost::memory_order_relaxed) != Free)
+    *dst++ = records[it].key;
+  }
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Record marks.
+ enum
+ {
+  Free = 0,
+  Unmarked = 1,
+  Marked = 2
+ };
+
+ /// Record marks.
+ boost::scoped_array<boost::atomic<unsigned char> > marks;
+
+ /// Number of records.
+ std::size_t size;
+
+ /// Clock hand.
+ std::size_t hand;
+
+ /// Number of records in use.
+ std::size_t used;
+
+ /// Last inserted record.
+ RecordIndex last;
+
+};
+
+/**
+Buffered eviction, defers hits of an exclusive policy (LRUEviction by
+default) so hits can run under a shared lock. A hit appends the record
+index to a ring buffer of its thread's stripe with one atomic increment,
+buffers are drained into the policy in hit order before any insertion or
+eviction, or by a reader that gets the exclusive lock by try-lock once a
+buffer is full. Hits arriving at a full buffer are dropped, the order is
+approximately LRU but the list is no longer mutated on every hit.
+
+@param Policy Eviction policy of deferred hits.
+@param Stripes Number of buffers, power of 2.
+@param Capacity Capacity of each buffer.
+*/
+template<
+ typename Policy = LRUEviction, 
+ std::size_t Stripes = 16, 
+ std::size_t Capacity = 64
+>
+class BufferedEviction : private boost::noncopyable
+{
+public:
+
+ typedef typename Policy::Hook Hook;
+
+ /// Hit is buffered atomically, shared lock is enough.
+ static const bool SharedHit = true;
+
+public:
+
+ explicit BufferedEviction(const std::size_t n = 0) : policy(n)
+ {
+  for(std::size_t i = 0; i < Stripes; i++)
+   stripes[i].count.store(0, boost::memory_order_relaxed);
+
+  full.store(false, boost::memory_order_relaxed);
+ }
+
+ inline void Resize(const std::size_t n)
+ {
+  policy.Resize(n);
+ }
+
+ template<typename R>
+ inline void Insert(R& records, const RecordIndex it)
+ {
+  Drain(records);
+  policy.Insert(records, it);
+ }
+
+ template<typename R>
+ inline void Touch(R& /*records*/, const RecordIndex it) const
+ {
+  Stripe& s = stripes[ThreadStripe(Stripes)];
+
+  const std::size_t n = s.count.fetch_add(1, boost::memory_order_relaxed);
+
+  if(n < Capacity)
+   s.hits[n].store(it, boost::memory_order_relaxed);
+  else if(n == Capacity)
+   full.store(true, boost::memory_order_relaxed);
+ }
+
+ template<typename R>
+ inline RecordIndex Victim(R& records)
+ {
+  Drain(records);
+
+  return policy.Victim(records);
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  Drain(records);
+  policy.Erase(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(R& records, IT& dst)
+ {
+  Drain(records);
+  policy.GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return full.load(boost::memory_order_relaxed);
+ }
+
+ /**
+ Apply buffered hits to policy, stripe by stripe.
+ Records are only erased after draining, so buffered indices are valid.
+
+ @param records Records.
+ */
+ template<typename R>
+ void Drain(R& records)
+ {
+  for(std::size_t i = 0; i < Stripes; i++)
+  {
+   Stripe& s = stripes[i];
+
+   std::size_t n = s.count.load(boost::memory_order_relaxed);
+   if(!n)
+    continue;
+
+   if(n > Capacity)
+    n = Capacity;
+
+   for(std::size_t j = 0; j < n; j++)
+    policy.Touch(records, s.hits[j].load(boost::memory_order_relaxed));
+
+   s.count.store(0, boost::memory_order_relaxed);
+  }
+
+  full.store(false, boost::memory_order_relaxed);
+ }
+
+private:
+
+ /// Ring buffer of hits, aligned to avoid false sharing.
+ struct Stripe
+ {
+  boost::atomic<std::size_t> count;
+  boost::atomic<RecordIndex> hits[Capacity];
+  char padding[64 - sizeof(boost::atomic<std::size_t>)];
+ };
+
+private:
+
+ /// Deferred eviction policy.
+ Policy policy;
+
+ /// Hit buffers.
+ mutable Stripe stripes[Stripes];
+
+ /// A buffer is full.
+ mutable boost::atomic<bool> full;
+
+};
+
+/**
+Count-min sketch of 4-bit counters to estimate access frequency of hashes.
+Each of 4 rows picks a 64-bit word of table and a counter in the word, the
+estimate is the minimum of them. Counters are halved after 10 times width
+increments (aging), so the sketch follows recent popularity.
+*/
+class FrequencySketch : private boost::noncopyable
+{
+public:
+
+ /**
+ Constructor.
+
+ @param n Expected number of distinct hashes to tell apart.
+ */
+ explicit FrequencySketch(const std::size_t n = 0) : width(16), additions(0)
+ {
+  while(width < n)
+   width <<= 1;
+
+  table.reset(new boost::uint64_t[width]);
+  for(std::size_t i = 0; i < width; i++)
+   table[i] = 0;
+
+  sample = width * 10;
+ }
+
+ /**
+ Estimate frequency of hash.
+
+ @param h Hash.
+ @return Frequency, up to 15.
+ */
+ unsigned Frequency(const boost::uint32_t h) const
+ {
+  unsigned f = 15;
+
+  for(unsigned i = 0; i < 4; i++)
+  {
+   const unsigned c = (unsigned)(table[Index(h, i)] >> Offset(h, i)) & 15;
+
+   if(c < f)
+    f = c;
+  }
+
+  return f;
+ }
+
+ /**
+ Increment frequency of hash, age all counters periodically.
+
+ @param h Hash.
+ */
+ void Increment(const boost::uint32_t h)
+ {
+  bool added = false;
+
+  for(unsigned i = 0; i < 4; i++)
+  {
+   boost::uint64_t& w = table[Index(h, i)];
+   const unsigned offset = Offset(h, i);
+
+   if(((w >> offset) & 15) != 15)
+   {
+    w += (boost::uint64_t)1 << offset;
+    added = true;
+   }
+  }
+
+  if(added && ++additions == sample)
+   Reset();
+ }
+
+private:
+
+ /// Word of row i.
+ inline std::size_t Index(const boost::uint32_t h, const unsigned i) const
+ {
+  static const boost::uint64_t seeds[] = {
+   0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 
+   0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+  };
+
+  boost::uint64_t x = (h + seeds[i]) * seeds[i];
+  x += x >> 32;
+
+  return (std::size_t)x & (width - 1);
+ }
+
+ /// Bit offset of counter of row i in its word.
+ static inline unsigned Offset(const boost::uint32_t h, const unsigned i)
+ {
+  return ((h >> (i << 3)) & 15) << 2;
+ }
+
+ /// Halve all counters.
+ void Reset()
+ {
+  for(std::size_t i = 0; i < width; i++)
+   table[i] = (table[i] >> 1) & 0x7777777777777777ULL;
+
+  additions /= 2;
+ }
+
+private:
+
+ /// Counters, 16 in a word.
+ boost::scoped_array<boost::uint64_t> table;
+
+ /// Number of words, power of 2.
+ std::size_t width;
+
+ /// Increments since last aging.
+ std::size_t additions;
+
+ /// Increments to age counters.
+ std::size_t sample;
+
+};
+
+/**
+W-TinyLFU eviction: a newcomer enters a small window LRU (1% of capacity),
+when the window overflows, its least-recently-used record is admitted to
+the main segmented LRU only if its estimated frequency is higher than the
+main victim's, otherwise the newcomer is purged. Frequencies are kept in a
+FrequencySketch of hash tags, including keys already purged, so one-hit
+wonders of a scan can not flush frequently used records.
+
+Main is a segmented LRU: admitted records are on probation, a hit on
+probation promotes record to protected (80% of main), records overflowing
+protected are demoted back to probation, victims are taken from probation.
+*/
+class TinyLFUEviction : private boost::noncopyable
+{
+public:
+
+ /// Segments.
+ enum
+ {
+  Window = 0,
+  Probation = 1,
+  Protected = 2
+ };
+
+ typedef SegmentList<3>::Hook Hook;
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ explicit TinyLFUEviction(const std::size_t n = 0) : sketch(n)
+ {
+  Resize(n);
+ }
+
+ /// Shares of segments follow capacity, sketch keeps its width.
+ void Resize(const std::size_t n)
+ {
+  capacity = n ? n - 1 : 0;
+  windowCapacity = capacity / 100;
+
+  if(windowCapacity == 0)
+   windowCapacity = 1;
+
+  protectedCapacity = 
+   capacity > windowCapacity ? (capacity - windowCapacity) * 4 / 5 : 0;
+ }
+
+ template<typename R>
+ void Insert(R& records, const RecordIndex it)
+ {
+  sketch.Increment(records[it].tag);
+
+  segments.Link(records, it, Window);
+
+  // Not full yet, admit without competing.
+  if(segments[Window].Size() > windowCapacity && 
+     segments.Size() <= capacity)
+   segments.Move(records, segments[Window].Head(), Probation);
+ }
+
+ template<typename R>
+ void Touch(R& records, const RecordIndex it)
+ {
+  sketch.Increment(records[it].tag);
+
+  if(records[it].hook.segment != Probation)
+  {
+   segments.Touch(records, it);
+
+   return;
+  }
+
+  segments.Move(records, it, Protected);
+
+  if(segments[Protected].Size() > protectedCapacity)
+   segments.Move(records, segments[Protected].Head(), Probation);
+ }
+
+ template<typename R>
+ RecordIndex Victim(R& records)
+ {
+  const RecordIndex victim = segments[Probation].Size() ? 
+   segments[Probation].Head() : segments[Protected].Head();
+
+  if(victim == NilRecord)
+   return segments[Window].Head();
+
+  if(segments[Window].Size() <= windowCapacity)
+   return victim;
+
+  // Window candidate competes with main victim.
+  const RecordIndex candidate = segments[Window].Head();
+
+  if(sketch.Frequency(records[candidate].tag) > 
+     sketch.Frequency(records[victim].tag))
+  {
+   segments.Move(records, candidate, Probation);
+
+   return victim;
+  }
+
+  return candidate;
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  segments.Remove(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  segments[Protected].GetKeys(records, dst);
+  segments[Probation].GetKeys(records, dst);
+  segments[Window].GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Maximum number of records.
+ std::size_t capacity;
+
+ /// Maximum number of records in window.
+ std::size_t windowCapacity;
+
+ /// Maximum number of records in protected segment.
+ std::size_t protectedCapacity;
+
+ /// Window, probation and protected segments.
+ SegmentList<3> segments;
+
+ /// Access frequencies.
+ FrequencySketch sketch;
+
+};
+
+/**
+Segmented LRU eviction: a newcomer is put on probation, a hit on probation
+promotes record to protected (80% of capacity), records overflowing
+protected are demoted back to probation. Victims are taken from probation,
+records hit only once are purged before records hit twice.
+*/
+class SLRUEviction : private boost::noncopyable
+{
+public:
+
+ /// Segments.
+ enum
+ {
+  Probation = 0,
+  Protected = 1
+ };
+
+ typedef SegmentList<2>::Hook Hook;
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ explicit SLRUEviction(const std::size_t n = 0) :
+  protectedCapacity((n ? n - 1 : 0) * 4 / 5), last(NilRecord)
+ {
+ }
+
+ inline void Resize(const std::size_t n)
+ {
+  protectedCapacity = (n ? n - 1 : 0) * 4 / 5;
+ }
+
+ template<typename R>
+ inline void Insert(R& records, const RecordIndex it)
+ {
+  segments.Link(records, it, Probation);
+  last = it;
+ }
+
+ template<typename R>
+ void Touch(R& records, const RecordIndex it)
+ {
+  if(records[it].hook.segment == Protected)
+  {
+   segments.Touch(records, it);
+
+   return;
+  }
+
+  segments.Move(records, it, Protected);
+
+  if(segments[Protected].Size() > protectedCapacity)
+   segments.Move(records, segments[Protected].Head(), Probation);
+ }
+
+ template<typename R>
+ inline RecordIndex Victim(R& /*records*/)
+ {
+  // Record just inserted is the victim only if it is the only one.
+  const RecordIndex it = segments[Probation].Head();
+  const RecordIndex p = segments[Protected].Head();
+
+  return it != NilRecord && (it != last || p == NilRecord) ? it : p;
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  segments.Remove(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  segments[Protected].GetKeys(records, dst);
+  segments[Probation].GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Maximum number of records in protected segment.
+ std::size_t protectedCapacity;
+
+ /// Last inserted record.
+ RecordIndex last;
+
+ /// Probation and protected segments.
+ SegmentList<2> segments;
+
+};
+
+/**
+2Q eviction (full version, Johnson and Shasha): a newcomer enters A1in, a
+FIFO of 25% of capacity, a hit in A1in does not move record. Records
+purged from A1in are remembered in ghost list A1out (50% of capacity),
+a key missed while in A1out is reused, it enters Am, the main LRU.
+A1in is purged first once it exceeds its share, so a scan only flushes
+A1in.
+*/
+class TwoQueueEviction : private boost::noncopyable
+{
+public:
+
+ /// Segments.
+ enum
+ {
+  A1in = 0,
+  Am = 1
+ };
+
+ typedef SegmentList<2>::Hook Hook;
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ explicit TwoQueueEviction(const std::size_t n = 0) :
+  inCapacity((n ? n - 1 : 0) / 4), out((n ? n - 1 : 0) / 2), 
+  last(NilRecord)
+ {
+ }
+
+ /// A1in and A1out follow capacity.
+ inline void Resize(const std::size_t n)
+ {
+  inCapacity = (n ? n - 1 : 0) / 4;
+  out.Resize((n ? n - 1 : 0) / 2);
+ }
+
+ template<typename R>
+ inline void Insert(R& records, const RecordIndex it)
+ {
+  segments.Link(records, it, out.Remove(records[it].tag) ? Am : A1in);
+  last = it;
+ }
+
+ template<typename R>
+ inline void Touch(R& records, const RecordIndex it)
+ {
+  if(records[it].hook.segment == Am)
+   segments.Touch(records, it);
+ }
+
+ template<typename R>
+ RecordIndex Victim(R& records)
+ {
+  const RecordIndex in = segments[A1in].Head();
+  const RecordIndex am = segments[Am].Head();
+
+  // Record just inserted is the victim only if it is the only one.
+  if(in != NilRecord && 
+     (am == NilRecord || 
+      (in != last && (segments[A1in].Size() > inCapacity || am == last))))
+  {
+   out.Add(records[in].tag);
+
+   return in;
+  }
+
+  return am;
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  segments.Remove(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  segments[Am].GetKeys(records, dst);
+  segments[A1in].GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Maximum number of records in A1in.
+ std::size_t inCapacity;
+
+ /// A1out.
+ GhostList out;
+
+ /// Last inserted record.
+ RecordIndex last;
+
+ /// A1in and Am segments.
+ SegmentList<2> segments;
+
+};
+
+/**
+ARC eviction (Megiddo and Modha): T1 holds records seen once recently, T2
+records seen at least twice, ghost lists B1 and B2 remember keys purged
+from T1 and T2. A key missed while in B1 grows target size of T1, in B2
+shrinks it, so the split between recency and frequency adapts to the
+workload. Reused ghosts enter T2, other newcomers enter T1.
+*/
+class ARCEviction : private boost::noncopyable
+{
+public:
+
+ /// Segments.
+ enum
+ {
+  T1 = 0,
+  T2 = 1
+ };
+
+ typedef SegmentList<2>::Hook Hook;
+
+ /// Hit relocates record in list, exclusive lock is required.
+ static const bool SharedHit = false;
+
+public:
+
+ explicit ARCEviction(const std::size_t n = 0) :
+  capacity(n ? n - 1 : 0), target(0), b1(capacity), b2(capacity), 
+  last(NilRecord), ghost(false)
+ {
+ }
+
+ /// Target, B1 and B2 follow capacity.
+ inline void Resize(const std::size_t n)
+ {
+  capacity = n ? n - 1 : 0;
+  target = (std::min)(target, capacity);
+  b1.Resize(capacity);
+  b2.Resize(capacity);
+ }
+
+ template<typename R>
+ void Insert(R& records, const RecordIndex it)
+ {
+  const boost::uint32_t tag = records[it].tag;
+  const std::size_t s1 = b1.Size(), s2 = b2.Size();
+
+  last = it;
+  ghost = false;
+
+  if(b1.Remove(tag))
+  {
+   // Recency would have hit, grow T1.
+   target = (std::min)(capacity, target + (std::max)(s2 / s1, 
+                                                     (std::size_t)1));
+   segments.Link(records, it, T2);
+  }
+  else if(b2.Remove(tag))
+  {
+   // Frequency would have hit, shrink T1.
+   const std::size_t d = (std::max)(s1 / s2, (std::size_t)1);
+   target = target > d ? target - d : 0;
+   segments.Link(records, it, T2);
+   ghost = true;
+  }
+  else
+  {
+   segments.Link(records, it, T1);
+
+   // Keep T1 + B1 and the directory (records and ghosts) within bounds.
+   if(segments[T1].Size() + b1.Size() > capacity && b1.Size())
+    b1.PopFront();
+   else if(segments.Size() + b1.Size() + b2.Size() > capacity * 2 && 
+           b2.Size())
+    b2.PopFront();
+  }
+ }
+
+ template<typename R>
+ inline void Touch(R& records, const RecordIndex it)
+ {
+  if(records[it].hook.segment == T2)
+   segments.Touch(records, it);
+  else
+   segments.Move(records, it, T2);
+ }
+
+ template<typename R>
+ RecordIndex Victim(R& records)
+ {
+  const RecordIndex t1 = segments[T1].Head();
+  const RecordIndex t2 = segments[T2].Head();
+  const std::size_t s1 = segments[T1].Size();
+
+  // Record just inserted is the victim only if it is the only one.
+  if(t1 != NilRecord && 
+     (t2 == NilRecord || 
+      (t1 != last && (s1 > target || (ghost && s1 == target) || t2 == last))))
+  {
+   b1.Add(records[t1].tag);
+
+   return t1;
+  }
+
+  b2.Add(records[t2].tag);
+
+  return t2;
+ }
+
+ template<typename R>
+ inline void Erase(R& records, const RecordIndex it)
+ {
+  segments.Remove(records, it);
+ }
+
+ template<typename R, typename IT>
+ void GetKeys(const R& records, IT& dst) const
+ {
+  segments[T2].GetKeys(records, dst);
+  segments[T1].GetKeys(records, dst);
+ }
+
+ inline bool Pending() const
+ {
+  return false;
+ }
+
+ template<typename R>
+ inline void Drain(R& /*records*/)
+ {
+ }
+
+private:
+
+ /// Maximum number of records.
+ std::size_t capacity;
+
+ /// Target size of T1.
+ std::size_t target;
+
+ /// Ghosts of T1.
+ GhostList b1;
+
+ /// Ghosts of T2.
+ GhostList b2;
+
+ /// Last inserted record.
+ RecordIndex last;
+
+ /// Last inserted record was a ghost of T2.
+ bool ghost;
+
+ /// T1 and T2 segments.
+ SegmentList<2> segments;
+
+};
+}
+
+#endif
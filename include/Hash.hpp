@@ -0,0 +1,369 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_HASH_
+#define _NUWAINFO_LRU_HASH_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include <boost/tuple/tuple.hpp>
+
+#include <boost/preprocessor/repetition.hpp>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace LRUImpl
+{
+
+/**
+Mixing functions of wyhash (https://github.com/wangyi-fudan/wyhash),
+folded 64x64->128-bit multiplications spread every input bit over the
+whole hash, so sequential keys do not cluster in power-of-two tables.
+*/
+struct WyHash
+{
+ /// Secrets.
+ static const boost::uint64_t P0 = 0xa0761d6478bd642fULL;
+ static const boost::uint64_t P1 = 0xe7037ed1a0b428dbULL;
+ static const boost::uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+ static const boost::uint64_t P3 = 0x589965cc75374cc3ULL;
+
+ /**
+ Multiply to 128 bits.
+
+ @param a Input, output low half of product.
+ @param b Input, output high half of product.
+ */
+ static inline void Multiply(boost::uint64_t& a, boost::uint64_t& b)
+ {
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 Wide;
+
+  const Wide r = (Wide)a * b;
+
+  a = (boost::uint64_t)r;
+  b = (boost::uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  a = _umul128(a, b, &b);
+#else
+  const boost::uint64_t ha = a >> 32, hb = b >> 32;
+  const boost::uint64_t la = (boost::uint32_t)a, lb = (boost::uint32_t)b;
+  const boost::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la;
+  const boost::uint64_t rl = la * lb, t = rl + (rm0 << 32);
+
+  boost::uint64_t c = t < rl;
+
+  a = t + (rm1 << 32);
+  c += a < t;
+  b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+ }
+
+ /**
+ Multiply to 128 bits and fold halves.
+
+ @param a Input.
+ @param b Input.
+ @return Low half xor high half of product.
+ */
+ static inline boost::uint64_t Mum(boost::uint64_t a, boost::uint64_t b)
+ {
+  Multiply(a, b);
+
+  return a ^ b;
+ }
+
+ /**
+ Hash of an integer.
+
+ @param v Integer.
+ @return Hash.
+ */
+ static inline boost::uint64_t Mix(const boost::uint64_t v)
+ {
+  boost::uint64_t a = v ^ P0, b = P1;
+  Multiply(a, b);
+
+  return Mum(a ^ P0, b ^ P1);
+ }
+
+ /**
+ Hash of a sequence, combined with hash of next element.
+
+ @param seed Hash of sequence so far.
+ @param h Hash of next element.
+ @return Hash.
+ */
+ static inline boost::uint64_t Combine(const boost::uint64_t seed,
+                                       const boost::uint64_t h)
+ {
+  return Mum(seed ^ P2, h ^ P3);
+ }
+
+ /**
+ Hash of bytes, 48 bytes a step in three independent lanes for long keys.
+
+ @param data Bytes.
+ @param n Number of bytes.
+ @param seed Seed.
+ @return Hash.
+ */
+ static boost::uint64_t Bytes(const void* data, const std::size_t n,
+                              boost::uint64_t seed = 0)
+ {
+  const unsigned char* p = (const unsigned char*)data;
+  boost::uint64_t a, b;
+
+  seed ^= Mum(seed ^ P0, P1);
+
+  if(n <= 16)
+  {
+   if(n >= 4)
+   {
+    const std::size_t m = (n >> 3) << 2;
+
+    a = (Read4(p) << 32) | Read4(p + m);
+    b = (Read4(p + n - 4) << 32) | Read4(p + n - 4 - m);
+   }
+   else if(n > 0)
+   {
+    a = ((boost::uint64_t)p[0] << 16) | ((boost::uint64_t)p[n >> 1] << 8) |
+        p[n - 1];
+    b = 0;
+   }
+   else
+   {
+    a = b = 0;
+   }
+  }
+  else
+  {
+   std::size_t i = n;
+
+   if(i > 48)
+   {
+    boost::uint64_t s1 = seed, s2 = seed;
+
+    do
+    {
+     seed = Mum(Read8(p) ^ P1, Read8(p + 8) ^ seed);
+     s1 = Mum(Read8(p + 16) ^ P2, Read8(p + 24) ^ s1);
+     s2 = Mum(Read8(p + 32) ^ P3, Read8(p + 40) ^ s2);
+     p += 48;
+     i -= 48;
+    }
+    while(i > 48);
+
+    seed ^= s1 ^ s2;
+   }
+
+   while(i > 16)
+   {
+    seed = Mum(Read8(p) ^ P1, Read8(p + 8) ^ seed);
+    p += 16;
+    i -= 16;
+   }
+
+   a = Read8(p + i - 16);
+   b = Read8(p + i - 8);
+  }
+
+  a ^= P1;
+  b ^= seed;
+  Multiply(a, b);
+
+  return Mum(a ^ P0 ^ n, b ^ P1);
+ }
+
+private:
+
+ static inline boost::uint64_t Read8(const unsigned char* p)
+ {
+  boost::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+
+  return v;
+ }
+
+ static inline boost::uint64_t Read4(const unsigned char* p)
+ {
+  boost::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+
+  return v;
+ }
+};
+
+/**
+Hash of cache keys, see LRUHash. It is a customization point, specialize
+it for types hashed faster or better another way:
+
+Hash(v)                   Well-mixed 64-bit hash of v, every bit of it is
+                          used (low bits index tables, high bits route
+                          shards). Pass a weak hash through WyHash::Mix.
+
+Integers are mixed, strings and vectors of integers are hashed as bytes,
+pairs and tuples (and views of them, see LRUKeyView) combine hashes of
+their elements. Other types are hashed by boost::hash, then mixed.
+
+@param T Type.
+*/
+template<typename T, typename Enable = void>
+struct LRUHasher
+{
+ static inline boost::uint64_t Hash(const T& v)
+ {
+  return WyHash::Mix(boost::hash<T>()(v));
+ }
+};
+
+template<typename T>
+struct LRUHasher<T, typename boost::enable_if_c<
+ boost::is_integral<T>::value || boost::is_enum<T>::value
+>::type>
+{
+ static inline boost::uint64_t Hash(const T& v)
+ {
+  return WyHash::Mix((boost::uint64_t)v);
+ }
+};
+
+template<typename C, typename TR, typename A>
+struct LRUHasher<std::basic_string<C, TR, A> >
+{
+ static inline boost::uint64_t Hash(const std::basic_string<C, TR, A>& v)
+ {
+  return WyHash::Bytes(v.data(), v.size() * sizeof(C));
+ }
+};
+
+template<typename T, typename A>
+struct LRUHasher<std::vector<T, A> >
+{
+ static inline boost::uint64_t Hash(const std::vector<T, A>& v)
+ {
+  return Hash(v, boost::integral_constant<bool, 
+   boost::is_integral<T>::value && !boost::is_same<T, bool>::value
+  >());
+ }
+
+private:
+
+ /// Integers are equal if their bytes are (bits of bool are packed).
+ static inline boost::uint64_t Hash(const std::vector<T, A>& v,
+                                    boost::true_type)
+ {
+  return WyHash::Bytes(v.empty() ? NULL : &v[0], v.size() * sizeof(T));
+ }
+
+ /// Hash elements one by one.
+ static boost::uint64_t Hash(const std::vector<T, A>& v, boost::false_type)
+ {
+  boost::uint64_t h = WyHash::Mix(v.size());
+
+  for(typename std::vector<T, A>::const_iterator i = v.begin();
+      i != v.end(); ++i)
+   h = WyHash::Combine(h, LRUHasher<T>::Hash(*i));
+
+  return h;
+ }
+};
+
+template<typename T1, typename T2>
+struct LRUHasher<std::pair<T1, T2> >
+{
+ static inline boost::uint64_t Hash(const std::pair<T1, T2>& v)
+ {
+  return WyHash::Combine(LRUHasher<T1>::Hash(v.first),
+                         LRUHasher<T2>::Hash(v.second));
+ }
+};
+
+/// Tuples combine their elements in order, elements of views are
+/// references.
+template<typename H, typename T>
+struct LRUHasher<boost::tuples::cons<H, T> >
+{
+ typedef typename boost::remove_cv<
+  typename boost::remove_reference<H>::type
+ >::type Head;
+
+ static inline boost::uint64_t Hash(const boost::tuples::cons<H, T>& v)
+ {
+  return WyHash::Combine(LRUHasher<Head>::Hash(v.head),
+                         LRUHasher<T>::Hash(v.tail));
+ }
+};
+
+template<typename H>
+struct LRUHasher<boost::tuples::cons<H, boost::tuples::null_type> >
+{
+ typedef typename boost::remove_cv<
+  typename boost::remove_reference<H>::type
+ >::type Head;
+
+ static inline boost::uint64_t Hash(
+  const boost::tuples::cons<H, boost::tuples::null_type>& v)
+ {
+  return LRUHasher<Head>::Hash(v.head);
+ }
+};
+
+template<BOOST_PP_ENUM_PARAMS(10, typename T)>
+struct LRUHasher<boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)> > :
+ LRUHasher<
+  typename boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)>::inherited
+ >
+{
+};
+
+/**
+Hash of keys by LRUHasher, a view of key (see LRUKeyView) is hashed as it
+is, not converted to key.
+*/
+struct LRUHash
+{
+ typedef std::size_t result_type;
+
+ template<typename Q>
+ inline std::size_t operator()(const Q& k) const
+ {
+  return (std::size_t)LRUHasher<Q>::Hash(k);
+ }
+};
+
+/**
+Equality of keys, a view of key (see LRUKeyView) is compared as it is, not
+converted to key.
+*/
+struct LRUEqual
+{
+ typedef bool result_type;
+
+ template<typename A, typename B>
+ inline bool operator()(const A& a, const B& b) const
+ {
+  return a == b;
+ }
+};
+
+}
+
+#endif
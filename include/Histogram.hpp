@@ -0,0 +1,301 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_HISTOGRAM_
+#define _NUWAINFO_LRU_HISTOGRAM_
+
+#include <vector>
+#include <cmath>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <boost/chrono/chrono.hpp>
+
+#include "Parallel.hpp"
+
+namespace LRUImpl
+{
+
+/**
+Percentiles of latencies in nanoseconds.
+*/
+struct LatencySummary
+{
+ LatencySummary() : count(0), p50(0), p99(0), p999(0)
+ {
+ }
+
+ /// Number of latencies recorded.
+ boost::uint64_t count;
+
+ /// Median.
+ boost::uint64_t p50;
+
+ /// 99th percentile.
+ boost::uint64_t p99;
+
+ /// 99.9th percentile.
+ boost::uint64_t p999;
+};
+
+/**
+Log (HDR style) buckets of values.
+
+A value is counted in the bucket of its highest bit and the next SubBits
+bits, so buckets are exact below 2^SubBits and relative error is below
+2^-SubBits (12.5%) up to 2^Bits, larger values are counted in the last
+bucket.
+*/
+struct LogBuckets
+{
+ /// Bits of sub-bucket index.
+ static const unsigned SubBits = 3;
+
+ /// Bits of the largest value.
+ static const unsigned Bits = 40;
+
+ /// Number of buckets.
+ static const std::size_t Buckets = (Bits - SubBits + 1) << SubBits;
+
+ /**
+ Bucket of value.
+
+ @param v Value.
+ @return Bucket index.
+ */
+ static inline std::size_t Bucket(boost::uint64_t v)
+ {
+  if(v >> Bits)
+   v = (1ULL << Bits) - 1;
+
+  if(v < (1u << SubBits))
+   return (std::size_t)v;
+
+  // Highest bit.
+  unsigned e = 0;
+  for(unsigned s = 32; s; s >>= 1)
+   if(v >> (e + s))
+    e += s;
+
+  return ((e - SubBits + 1) << SubBits) +
+         (std::size_t)((v >> (e - SubBits)) & ((1u << SubBits) - 1));
+ }
+
+ /**
+ Upper bound of bucket.
+
+ @param b Bucket index.
+ @return Largest value of bucket.
+ */
+ static inline boost::uint64_t Highest(const std::size_t b)
+ {
+  if(b < (1u << SubBits))
+   return b;
+
+  const unsigned shift = (unsigned)(b >> SubBits) - 1;
+  const boost::uint64_t m = (1u << SubBits) + (b & ((1u << SubBits) - 1));
+
+  return ((m + 1) << shift) - 1;
+ }
+
+ /**
+ Lower bound of bucket.
+
+ @param b Bucket index.
+ @return Smallest value of bucket.
+ */
+ static inline boost::uint64_t Lowest(const std::size_t b)
+ {
+  return b ? Highest(b - 1) + 1 : 0;
+ }
+};
+
+/**
+Log-bucketed histogram of latencies in nanoseconds, see LogBuckets, 
+latencies up to 2^40 ns (18 minutes) are told apart. Percentiles report 
+the upper bound of bucket.
+
+Counts are kept in stripes picked by thread (see ThreadStripe) and
+incremented by relaxed 64-bit atomics, so recording threads rarely share a
+cache line and counts of hot caches do not wrap; stripes are merged on read.
+
+@param Stripes Number of stripes, power of 2.
+*/
+template<std::size_t Stripes = 8>
+class LatencyHistogram : private boost::noncopyable
+{
+public:
+
+ /// Number of buckets.
+ static const std::size_t Buckets = LogBuckets::Buckets;
+
+public:
+
+ LatencyHistogram()
+ {
+  for(std::size_t i = 0; i < Stripes; i++)
+   for(std::size_t j = 0; j < Buckets; j++)
+    stripes[i].counts[j].store(0, boost::memory_order_relaxed);
+ }
+
+ /**
+ Obtain current time of monotonic clock.
+
+ @return Nanoseconds.
+ */
+ static inline boost::uint64_t Now()
+ {
+  return (boost::uint64_t)boost::chrono::duration_cast<
+   boost::chrono::nanoseconds
+  >(boost::chrono::steady_clock::now().time_since_epoch()).count();
+ }
+
+ /**
+ Record latency.
+
+ @param v Nanoseconds.
+ */
+ inline void Record(const boost::uint64_t v)
+ {
+  stripes[ThreadStripe(Stripes)].counts[Bucket(v)].fetch_add(
+   1, boost::memory_order_relaxed);
+ }
+
+ /**
+ Merge counts of stripes.
+
+ @param counts Output counts of buckets.
+ @return Number of latencies.
+ */
+ boost::uint64_t Merge(std::vector<boost::uint64_t>& counts) const
+ {
+  boost::uint64_t n = 0;
+
+  counts.assign(Buckets, 0);
+
+  for(std::size_t i = 0; i < Stripes; i++)
+  {
+   for(std::size_t j = 0; j < Buckets; j++)
+   {
+    const boost::uint64_t c =
+     stripes[i].counts[j].load(boost::memory_order_relaxed);
+
+    counts[j] += c;
+    n += c;
+   }
+  }
+
+  return n;
+ }
+
+ /**
+ Obtain percentile.
+
+ @param q Quantile in [0, 1].
+ @return Nanoseconds, 0 if nothing is recorded.
+ */
+ boost::uint64_t Percentile(const double q) const
+ {
+  std::vector<boost::uint64_t> counts;
+  const boost::uint64_t n = Merge(counts);
+
+  return Percentile(counts, n, q);
+ }
+
+ /**
+ Obtain median, 99th and 99.9th percentiles.
+
+ @return Summary.
+ */
+ LatencySummary Summarize() const
+ {
+  std::vector<boost::uint64_t> counts;
+  LatencySummary s;
+
+  s.count = Merge(counts);
+  s.p50 = Percentile(counts, s.count, 0.5);
+  s.p99 = Percentile(counts, s.count, 0.99);
+  s.p999 = Percentile(counts, s.count, 0.999);
+
+  return s;
+ }
+
+ /**
+ Bucket of latency.
+
+ @param v Nanoseconds.
+ @return Bucket index.
+ */
+ static inline std::size_t Bucket(const boost::uint64_t v)
+ {
+  return LogBuckets::Bucket(v);
+ }
+
+ /**
+ Upper bound of bucket.
+
+ @param b Bucket index.
+ @return Nanoseconds.
+ */
+ static inline boost::uint64_t Highest(const std::size_t b)
+ {
+  return LogBuckets::Highest(b);
+ }
+
+private:
+
+ /**
+ Obtain percentile of merged counts.
+
+ @param counts Counts of buckets.
+ @param n Number of latencies.
+ @param q Quantile.
+ @return Nanoseconds.
+ */
+ static boost::uint64_t Percentile(const std::vector<boost::uint64_t>& counts,
+                                   const boost::uint64_t n, const double q)
+ {
+  if(!n)
+   return 0;
+
+  boost::uint64_t rank = (boost::uint64_t)std::ceil(q * n);
+  if(rank < 1)
+   rank = 1;
+
+  boost::uint64_t sum = 0;
+  for(std::size_t i = 0; i < Buckets; i++)
+  {
+   sum += counts[i];
+
+   if(sum >= rank)
+    return Highest(i);
+  }
+
+  return Highest(Buckets - 1);
+ }
+
+ /// Counts of a thread stripe.
+ struct Stripe
+ {
+  boost::atomic<boost::uint64_t> counts[Buckets];
+ };
+
+private:
+
+ /// Stripes.
+ Stripe stripes[Stripes];
+
+};
+
+}
+
+#endif
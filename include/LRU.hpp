@@ -1,619 +1,4339 @@
-/**
-$Id: LRU.hpp 773 2014-02-10 06:48:20Z Bear $
-
-Copyright (c) 2014 Nuwa Information Co., Ltd, All Rights Reserved.
-
-Distributed under the Boost Software License, Version 1.0.
-See accompanying file LICENSE_1_0.txt or copy at
-http://www.boost.org/LICENSE_1_0.txt
-
-See the License for the specific language governing permissions and
-limitations under the License.
-
-$Author: Bear $
-$Date: 2014-02-10 14:48:20 +0800 (週一, 10 二月 2014) $
-$Revision: 773 $
-*/
-#ifndef _NUWAINFO_LRU_
-#define _NUWAINFO_LRU_
-
-#include <boost/bimap.hpp>
-#include <boost/bimap/list_of.hpp>
-#include <boost/bimap/unordered_set_of.hpp>
-
-#include <boost/function.hpp>
-
-#include <boost/type_traits.hpp>
-#include <boost/typeof/typeof.hpp>
-
-#include <boost/pool/detail/singleton.hpp> 
-
-#include <boost/unordered_map.hpp>
-
-#include <boost/any.hpp>
-
-#include <boost/preprocessor/repetition.hpp>
-#include <boost/preprocessor/iteration/local.hpp>
-#include <boost/preprocessor/iteration/iterate.hpp>
-#include <boost/preprocessor/arithmetic/inc.hpp>
-#include <boost/preprocessor/arithmetic/sub.hpp>
-#include <boost/preprocessor/slot/slot.hpp>
-
-#include <boost/shared_ptr.hpp>
-
-#include <boost/tuple/tuple.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-
-#include "Patch/boost/tuple/detail/hash_tuple.hpp"
-
-#include "Parallel.hpp"
-
-#ifndef LRU_DEFAULT_CAPACITY
-#define LRU_DEFAULT_CAPACITY   4096
-#endif
-
-#ifndef LRU_DEFAULT_LOCK_LEVEL
-#define LRU_DEFAULT_LOCK_LEVEL 1
-#endif
-
-#if LRU_DEFAULT_LOCK_LEVEL == 0
-#define LRU_DEFAULT_LOCK_IMPL          NullLockable
-#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultNullLockable
-#elif LRU_DEFAULT_LOCK_LEVEL == 1
-#define LRU_DEFAULT_LOCK_IMPL          ObjectLevelLockable
-#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultObjectLevelLockable
-#else
-#define LRU_DEFAULT_LOCK_IMPL          ClassLevelLockable
-#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultClassLevelLockable
-#endif
-
-namespace LRUImpl
-{
-
-/**
-Fixed-size (by number of records) LRU-replacement cache.
-Reference: 
-http://timday.bitbucket.org/lru.html
-http://patrickaudley.com/code/project/lrucache
-
-@param K Key type.
-@param V Value type.
-@param C Capacity.
-@param ThreadPolicy Thread policy class.
-*/
-template<
- typename K, 
- typename V, 
- std::size_t C = LRU_DEFAULT_CAPACITY, 
- template <class> class ThreadPolicy = DefaultNullLockable
-> 
-class LRU : public ThreadPolicy<LRU<K, V, C, ThreadPolicy> >
-{
-public:
-
-#ifdef __GNUG__
-  typedef ThreadPolicy<LRU<K, V, C, ThreadPolicy> > ThreadPolicyType;
-#endif
-
-  typedef K KeyType;
-  typedef V ValueType;
-  
-  typedef boost::bimaps::bimap<
-   boost::bimaps::unordered_set_of<K>,
-   boost::bimaps::list_of<V>
-  > ContainerType;
-  
-  typedef boost::function<V(const K&)> FunctionType;
-  
-public:    
-
-  /**
-  Constuctor specifies the cached function and the maximum number of records 
-  to be stored.  
-  
-  @param c Maximum number of records.
-  @param f Value store function.  
-  */
-  LRU(const std::size_t c = C, const FunctionType f = 0) : capacity(c), fn(f)
-  {
-  }
-  
-  /**
-  Obtain value of the cached function for k. 
-  
-  Return stored pointer for performance consideration (avoid data copy),
-  but it must keep in mind that pointer might invalid after cache update.
-  If you want a safer operation, please use Get method or keep a copy of 
-  data by yourself.
-  
-  @param k Key.
-  @param found A boolean indicator to indicate whether we found key or not.
-  @return Value pointer which stored in cache.
-  */
-  V* operator()(const K& k, bool* found = NULL) 
-  {
-   OBJECT_LEVEL_LOCK;
-
-   // Attempt to find existing record.
-   typename ContainerType::left_iterator it = container.left.find(k);
-
-   if(it == container.left.end()) 
-   {
-    if(found)
-     *found = false;
-
-    // We don't have it:
-    // Evaluate function and create new record.
-    if(fn)
-    {
-     Put(k, fn(k));
-     
-     it = container.left.find(k);
-     return &it->second;
-    }
-    else
-    {
-     return NULL;
-    }
-   } 
-
-   if(found)
-    *found = true;
-
-   // We do have it.
-   Update(it);
-      
-   // Return the retrieved value.
-   return &it->second;
-  }
-  
-  /**
-  Put value into cache.
-  
-  @param k Key.
-  @param v Value.
-  */
-  void Put(const K& k,const V& v) 
-  {
-   if(capacity == 0) /* Disabled */
-    return;
-        
-   OBJECT_LEVEL_LOCK;
-
-   // If necessary, make space.
-   if(container.size() == capacity) 
-   {
-    // By purging the least-recently-used element.
-    container.right.erase(container.right.begin());
-   }
-    
-   // Create a new record from the key and the value bimap's list_view 
-   // defaults to inserting this at the list tail 
-   // (considered most-recently-used).
-   container.insert(typename ContainerType::value_type(k, v));
-  }  
-  
-  /**
-  Get value from cache.
-  
-  @param k Key.
-  @param default Return value if cache missed.
-  @param found A boolean indicator to indicate whether we found key or not.
-  @return Value.
-  */
-  V Get(const K& k, V* _default = NULL, bool* found = NULL)
-  {
-   OBJECT_LEVEL_LOCK;
-
-   // Attempt to find existing record.
-   const typename ContainerType::left_iterator it = container.left.find(k);
-
-   if(it == container.left.end()) 
-   {
-    if(found)
-     *found = false;
-
-    // We don't have it:
-    // Evaluate function and create new record
-    if(fn)
-    {
-     const V v = fn(k);     
-     Put(k, v);
-     
-     return v;
-    }
-    else if(_default)
-    {
-     return *_default;
-    }
-    else
-    {
-     return V();
-    }
-   } 
-
-   if(found)
-    *found = true;
-
-   // We do have it:
-   Update(it);
-      
-   // Return the retrieved value.
-   return it->second;
-  }  
-  
-  /**
-  Obtain the cached keys, most recently used element at head, 
-  least recently used at tail.
-  
-  @param dst Result container iterator.
-  */
-  template<typename IT> 
-  void GetKeys(IT& dst) const 
-  {
-   OBJECT_LEVEL_LOCK;
-
-   typename ContainerType::right_const_reverse_iterator src =
-    container.right.rbegin();
-    
-   while(src != container.right.rend()) 
-    *dst++ = (*src++).second;
-  }
-  
-  /**
-  Cached key exists or not?
-  
-  @param key Key.
-  @return True if exists.
-  */
-  inline bool Exists(const K& key) const
-  {  
-   OBJECT_LEVEL_LOCK;
-
-   return container.left.find(key) != container.left.end();
-  }
-
-  /**
-  Resize capacity.
-
-  @param size Capacity.
-  */
-  inline void Resize(const std::size_t size)
-  {
-   capacity = size;
-  }
-  
-private:
- 
- /**
- Update internal container.
- 
- @param it Retrived value iterator.
- */
- inline void Update(const typename ContainerType::left_iterator& it)
- {
-  // Update the access record view.
-  container.right.relocate(container.right.end(), 
-                           container.project_right(it));                           
- }
-  
-
-private:
-  
- /// Value store function.
- const FunctionType fn;
-  
- /// Capacity (maximum records).
- const std::size_t capacity;
- 
- /// Internal container.
- ContainerType container;
- 
-};
-
-/**
-Internal LRUPool to cache all LRU cache objects by function unique key.
-This is a helper to provide central control mechanism of all function caches.
-It should not be used directly.
-*/
-class _LRUPool : public LRU_DEFAULT_LOCK_IMPL<_LRUPool>
-{
-public:
-
- /// Pool storage, key: function unique id, value: LRU object.
- typedef boost::unordered_map<int, boost::any> PoolTable;
-
-public:
-
- /**
- Constructor.
-
- @param c Capacity for all caches.
- */
- _LRUPool(const std::size_t c = LRU_DEFAULT_CAPACITY) : capacity(c)
- {
- }
-
- // Helper macro.
- #define _LRUPOOL_TUPLE_REMOVE_QUALIFIERS(z, i, var)                           \
-  typename boost::remove_const<                                                \
-   typename boost::remove_reference<T##i>::type>::type,
-
- /**
- Get cache value by function unique key and its arguments.
- 
- @param funcUnique Function unique key generated by compiler.
- @param found Output reference to indicate cache found or not.
- @param ... Function arguments.
- @return Cached result or default value. 
- */
- #define _LRUPOOL_GET(z, n, unused)                                           \
- template<typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>                   \
- TR Get(int funcUnique, bool& found, BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t))   \
- {                                                                            \
-  typedef boost::tuple<                                                       \
-   BOOST_PP_REPEAT(BOOST_PP_SUB(n, 1), _LRUPOOL_TUPLE_REMOVE_QUALIFIERS, T)   \
-   typename boost::remove_const<                                              \
-    typename boost::remove_reference<                                         \
-     BOOST_PP_CAT(T, BOOST_PP_SUB(n, 1))>::type                               \
-    >::type                                                                   \
-  > ArgsTuple;                                                                \
-  typedef LRU<ArgsTuple, TR,                                                  \
-   LRU_DEFAULT_CAPACITY,                                                      \
-   LRU_DEFAULT_DEFAULT_LOCK_IMPL                                              \
-  > Cache;                                                                    \
-  typedef boost::shared_ptr<Cache> CachePtr;                                  \
-                                                                              \
-  found = false;                                                              \
-                                                                              \
-  if(capacity == 0) /* Disabled */                                            \
-   return TR();                                                               \
-                                                                              \
-  OBJECT_LEVEL_LOCK;                                                          \
-                                                                              \
-  PoolTable::iterator i = pool.find(funcUnique);                              \
-  if(i != pool.end())                                                         \
-  {                                                                           \
-   CachePtr cache = boost::any_cast<CachePtr>(i->second);                     \
-                                                                              \
-   ArgsTuple tuple(boost::make_tuple(BOOST_PP_ENUM_PARAMS(n, t)));            \
-   if(cache->Exists(tuple))                                                   \
-   {                                                                          \
-    found = true;                                                             \
-    return cache->Get(tuple);                                                 \
-   }                                                                          \
-  }                                                                           \
-  else                                                                        \
-  {                                                                           \
-   pool[funcUnique] = CachePtr(new Cache(capacity));                          \
-  }                                                                           \
-                                                                              \
-  return TR();                                                                \
- }
-
- #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_GET(~, n, ~)
- #define BOOST_PP_LOCAL_LIMITS   (1, 10)
- #include BOOST_PP_LOCAL_ITERATE()
-
- /**
- Put function result into cache by function unique key and its arguments.
- 
- @param funcUnique Function unique key generated by compiler.
- @param r Function result.
- @param ... Function arguments.
- */
- #define _LRUPOOL_PUT(z, n, unused)                                           \
- template<typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>                   \
- void Put(int funcUnique, TR& r, BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t))       \
- {                                                                            \
-  typedef boost::tuple<                                                       \
-   BOOST_PP_REPEAT(BOOST_PP_SUB(n, 1), _LRUPOOL_TUPLE_REMOVE_QUALIFIERS, T)   \
-   typename boost::remove_const<                                              \
-    typename boost::remove_reference<                                         \
-     BOOST_PP_CAT(T, BOOST_PP_SUB(n, 1))>::type                               \
-    >::type                                                                   \
-  > ArgsTuple;                                                                \
-  typedef LRU<ArgsTuple, TR,                                                  \
-   LRU_DEFAULT_CAPACITY,                                                      \
-   LRU_DEFAULT_DEFAULT_LOCK_IMPL                                              \
-  > Cache;                                                                    \
-  typedef boost::shared_ptr<Cache> CachePtr;                                  \
-                                                                              \
-  if(capacity == 0) /* Disabled */                                            \
-   return;                                                                    \
-                                                                              \
-  ArgsTuple tuple(boost::make_tuple(BOOST_PP_ENUM_PARAMS(n, t)));             \
-                                                                              \
-  OBJECT_LEVEL_LOCK;                                                          \
-                                                                              \
-  PoolTable::iterator i = pool.find(funcUnique);                              \
-  if(i != pool.end())                                                         \
-  {                                                                           \
-   CachePtr cache = boost::any_cast<CachePtr>(i->second);                     \
-   cache->Put(tuple, r);                                                      \
-  }                                                                           \
-  else                                                                        \
-  {                                                                           \
-   CachePtr cache(new Cache(capacity));                                       \
-                                                                              \
-   cache->Put(tuple, r);                                                      \
-   pool[funcUnique] = cache;                                                  \
-  }                                                                           \
- }
-
- #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_PUT(~, n, ~)
- #define BOOST_PP_LOCAL_LIMITS   (1, 10)
- #include BOOST_PP_LOCAL_ITERATE()
-
- /**
- Configure capacity or other parameters for caches.
-
- @param size Capacity for all caches.
- */
- void Configure(const std::size_t size)
- {
-  capacity = size;
- }
-
-private:
-
- /// Pool storate instance.
- PoolTable pool;
-
- /// Capacity for all caches.
- std::size_t capacity;
-
-};
-
-/// LRUPool public typedef, singleton.
-typedef boost::details::pool::singleton_default<_LRUPool> LRUPool;
-
-}
-
-#ifdef LRU_DISABLED
-#define _LRU_CACHED_IMPL(TRet, TFunc, ... )
-#else
-
-// Function Unique can be produced by these and its combination:
-//
-// http://boost.2283326.n4.nabble.com/
-// Preprocessor-library-inrement-a-macro-td2560393.html
-// http://alexander-stoyan.blogspot.tw/2012/07/
-// getting-pseudo-random-numbers-at.html
-// 
-// But we keep it as simple as possible.
-
-#define _LRU_CACHED_IMPL(TRet, TFunc, ... )                                 \
- bool found;                                                                \
-                                                                            \
- int funcUnique = 0x1e3f75a9 + __COUNTER__;                                 \
- TRet ret = LRUImpl::LRUPool::instance().Get<TRet>(funcUnique, found,       \
-                                                   __VA_ARGS__);            \
- if(found)                                                                  \
-  return ret;                                                               \
-                                                                            \
- TRet ret2 = TFunc##Impl(__VA_ARGS__);                                      \
-                                                                            \
- LRUImpl::LRUPool::instance().Put(funcUnique, ret2, __VA_ARGS__);           \
- return ret2;
-
-#endif
-
-// LRU_CACHED Decorators, support up to 10 arguments.
-// TODO: Eliminate LRU_DECL macros for normal function usage.
-#define LRU_DECL1(TRet, TFunc, T0, A0)                                      \
- TRet TFunc##Impl(T0 A0);
-
-#define LRU_DECL2(TRet, TFunc, T0, A0, T1, A1)                              \
- TRet TFunc##Impl(T0 A0, T1 A1);
-
-#define LRU_DELC3(TRet, TFunc, T0, A0, T1, A1, T2, A2)                      \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2);
-
-#define LRU_DELC4(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3)              \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3);
-
-#define LRU_DELC5(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4)      \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4);
-
-#define LRU_DELC6(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,      \
-                  T5, A5)                                                   \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5);
-
- #define LRU_DELC7(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
-                   T5, A5, T6, A6)                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6);
-
- #define LRU_DELC8(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
-                   T5, A5, T6, A6, T7, A7)                                  \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7);
-
-#define LRU_DELC9(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,      \
-                  T5, A5, T6, A6, T7, A7, T8, A8)                           \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
-                  T8 A8);
-
-#define LRU_DELC10(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
-                   T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)                  \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
-                  T8 A8, T9 A9);
-
-#define LRU_CACHED1(TRet, TFunc, T0, A0)                                    \
- TRet TFunc(T0 A0)                                                          \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0)                                         \
- }                                                                          \
- TRet TFunc##Impl(T0 A0)
-
-#define LRU_CACHED2(TRet, TFunc, T0, A0, T1, A1)                            \
- TRet TFunc(T0 A0, T1 A1)                                                   \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1)                                     \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1)
-
-#define LRU_CACHED3(TRet, TFunc, T0, A0, T1, A1, T2, A2)                    \
- TRet TFunc(T0 A0, T1 A1, T2 A2)                                            \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2)                                 \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2)
-
-#define LRU_CACHED4(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3)            \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3)                                     \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3)                             \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3)
-
-#define LRU_CACHED5(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4)    \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)                              \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4)                         \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)
-
-#define LRU_CACHED6(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
-                    T5, A5)                                                 \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5)                       \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4, A5)                     \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5)
-
-#define LRU_CACHED7(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
-                    T5, A5, T6, A6)                                         \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6)                \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4, A5, A6)                 \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6)
-
-#define LRU_CACHED8(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
-                    T5, A5, T6, A6, T7, A7)                                 \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7)         \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7)             \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7)
-
-#define LRU_CACHED9(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
-                    T5, A5, T6, A6, T7, A7, T8, A8)                         \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7, T8 A8)  \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7, A8)         \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
-                  T8 A8)
-
-#define LRU_CACHED10(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,   \
-                     T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)                \
- TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7, T8 A8,  \
-            T9, A9)                                                         \
- {                                                                          \
-  _LRU_CACHED_IMPL(TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7, A8, A9)     \
- }                                                                          \
- TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
-                  T8 A8, T9 A9)
-
-#endif
+/**
+$Id: LRU.hpp 773 2014-02-10 06:48:20Z Bear $
+
+Copyright (c) 2014 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+
+$Author: Bear $
+$Date: 2014-02-10 14:48:20 +0800 (週一, 10 二月 2014) $
+$Revision: 773 $
+*/
+#ifndef _NUWAINFO_LRU_
+#define _NUWAINFO_LRU_
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/function.hpp>
+
+#include <boost/type_traits.hpp>
+#include <boost/call_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/typeof/typeof.hpp>
+
+#include <boost/pool/detail/singleton.hpp> 
+
+#include <boost/unordered_map.hpp>
+
+#include <boost/any.hpp>
+
+#include <boost/mpl/if.hpp>
+
+#include <boost/preprocessor/repetition.hpp>
+#include <boost/preprocessor/iteration/local.hpp>
+#include <boost/preprocessor/iteration/iterate.hpp>
+#include <boost/preprocessor/arithmetic/inc.hpp>
+#include <boost/preprocessor/arithmetic/sub.hpp>
+#include <boost/preprocessor/slot/slot.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <boost/thread/once.hpp>
+#include <boost/thread/future.hpp>
+
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
+#include "Patch/boost/tuple/detail/hash_tuple.hpp"
+
+#include "Parallel.hpp"
+#include "Container.hpp"
+#include "TimerWheel.hpp"
+#include "Histogram.hpp"
+#include "ReuseSampler.hpp"
+#include "Snapshot.hpp"
+
+#ifndef LRU_DEFAULT_CAPACITY
+#define LRU_DEFAULT_CAPACITY   4096
+#endif
+
+#ifndef LRU_DEFAULT_LOCK_LEVEL
+#define LRU_DEFAULT_LOCK_LEVEL 1
+#endif
+
+#ifndef LRU_DEFAULT_SHARDS
+#define LRU_DEFAULT_SHARDS     0
+#endif
+
+#ifndef LRU_DEFAULT_STORAGE
+#ifdef LRU_DEFAULT_EVICTION
+#define LRU_DEFAULT_STORAGE    FlatStorage<LRU_DEFAULT_EVICTION>
+#else
+#define LRU_DEFAULT_STORAGE    BimapStorage
+#endif
+#endif
+
+#ifndef LRU_DEFAULT_SINGLE_FLIGHT
+#define LRU_DEFAULT_SINGLE_FLIGHT 0
+#endif
+
+#ifndef LRU_DEFAULT_MAX_WEIGHT
+#define LRU_DEFAULT_MAX_WEIGHT 0
+#endif
+
+#ifndef LRU_DEFAULT_TTL
+#define LRU_DEFAULT_TTL        0
+#endif
+
+#ifndef LRU_DEFAULT_EXPIRE_AFTER_ACCESS
+#define LRU_DEFAULT_EXPIRE_AFTER_ACCESS 0
+#endif
+
+#ifndef LRU_DEFAULT_REFRESH_AFTER
+#define LRU_DEFAULT_REFRESH_AFTER 0
+#endif
+
+#ifndef LRU_DEFAULT_REFRESH_THREADS
+#define LRU_DEFAULT_REFRESH_THREADS 2
+#endif
+
+#ifndef LRU_DEFAULT_REFRESH_QUEUE
+#define LRU_DEFAULT_REFRESH_QUEUE 1024
+#endif
+
+#ifndef LRU_DEFAULT_LATENCY
+#define LRU_DEFAULT_LATENCY    0
+#endif
+
+#ifndef LRU_DEFAULT_SAMPLE_RATE
+#define LRU_DEFAULT_SAMPLE_RATE 0
+#endif
+
+#ifndef LRU_DEFAULT_BUDGET
+#define LRU_DEFAULT_BUDGET     0
+#endif
+
+#ifndef LRU_DEFAULT_REBALANCE_INTERVAL
+#define LRU_DEFAULT_REBALANCE_INTERVAL 1000
+#endif
+
+#ifndef LRU_DEFAULT_ASYNC_THREADS
+#define LRU_DEFAULT_ASYNC_THREADS 4
+#endif
+
+#ifndef LRU_DEFAULT_ASYNC_QUEUE
+#define LRU_DEFAULT_ASYNC_QUEUE 65536
+#endif
+
+#if LRU_DEFAULT_LOCK_LEVEL == 0
+#define LRU_DEFAULT_LOCK_IMPL          NullLockable
+#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultNullLockable
+#elif LRU_DEFAULT_LOCK_LEVEL == 1
+#define LRU_DEFAULT_LOCK_IMPL          ObjectLevelLockable
+#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultObjectLevelLockable
+#elif LRU_DEFAULT_LOCK_LEVEL == 3
+#define LRU_DEFAULT_LOCK_IMPL          ObjectLevelRWLockable
+#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultObjectLevelRWLockable
+#else
+#define LRU_DEFAULT_LOCK_IMPL          ClassLevelLockable
+#define LRU_DEFAULT_DEFAULT_LOCK_IMPL  DefaultClassLevelLockable
+#endif
+
+namespace LRUImpl
+{
+
+/**
+Weigher of cached keys and values, weight is sizeof(T) by default.
+Specialize it to weigh a type owning memory, for example:
+
+namespace LRUImpl
+{
+template<>
+struct LRUWeigher<Image>
+{
+ static std::size_t Weight(const Image& v)
+ {
+  return sizeof(v) + v.width * v.height * 4;
+ }
+};
+}
+*/
+template<typename T>
+struct LRUWeigher
+{
+ static inline std::size_t Weight(const T&)
+ {
+  return sizeof(T);
+ }
+};
+
+template<typename C, typename T, typename A>
+struct LRUWeigher<std::basic_string<C, T, A> >
+{
+ static inline std::size_t Weight(const std::basic_string<C, T, A>& v)
+ {
+  return sizeof(v) + v.capacity() * sizeof(C);
+ }
+};
+
+template<typename T, typename A>
+struct LRUWeigher<std::vector<T, A> >
+{
+ static inline std::size_t Weight(const std::vector<T, A>& v)
+ {
+  return Weight(v, boost::is_pod<T>());
+ }
+
+private:
+
+ /// Elements do not own memory.
+ static inline std::size_t Weight(const std::vector<T, A>& v, 
+                                  boost::true_type)
+ {
+  return sizeof(v) + v.capacity() * sizeof(T);
+ }
+
+ /// Weigh elements one by one.
+ static std::size_t Weight(const std::vector<T, A>& v, boost::false_type)
+ {
+  std::size_t w = sizeof(v) + (v.capacity() - v.size()) * sizeof(T);
+
+  for(typename std::vector<T, A>::const_iterator i = v.begin(); 
+      i != v.end(); ++i)
+   w += LRUWeigher<T>::Weight(*i);
+
+  return w;
+ }
+};
+
+/**
+Statistics of cache, see LRU::Stats.
+*/
+struct LRUStats
+{
+ /// Capacities of curve, multiples of capacity from 1/10 to 10.
+ static const std::size_t CurvePoints = 13;
+
+ LRUStats() : hits(0), misses(0), inserts(0), evictions(0), expirations(0), 
+              loadTime(0), ghostHits(0), size(0), capacity(0)
+ {
+ }
+
+ /**
+ Capacity of a point of curve.
+
+ @param c Capacity.
+ @param i Point, 0 to CurvePoints - 1.
+ @return Capacity of point, c * 10^(i / 6 - 1).
+ */
+ static inline std::size_t CurveCapacity(const std::size_t c, 
+                                         const std::size_t i)
+ {
+  return (std::size_t)(c * std::pow(10.0, (double)i / 6 - 1) + 0.5);
+ }
+
+ /**
+ Hit rate.
+
+ @return Hits of lookups, 0 if nothing is looked up.
+ */
+ inline double HitRate() const
+ {
+  return hits + misses ? (double)hits / (hits + misses) : 0;
+ }
+
+ /**
+ Accumulate statistics of another cache, e.g. shards.
+
+ @param s Statistics.
+ @return This.
+ */
+ LRUStats& operator+=(const LRUStats& s)
+ {
+  // Hit ratios are weighed by lookups.
+  if(curve.empty())
+  {
+   curve = s.curve;
+  }
+  else if(curve.size() == s.curve.size())
+  {
+   const double w = (double)(hits + misses);
+   const double sw = (double)(s.hits + s.misses);
+
+   for(std::size_t i = 0; i < curve.size(); i++)
+   {
+    curve[i].first += s.curve[i].first;
+    curve[i].second = w + sw ? 
+     (curve[i].second * w + s.curve[i].second * sw) / (w + sw) : 0;
+   }
+  }
+
+  hits += s.hits;
+  misses += s.misses;
+  inserts += s.inserts;
+  evictions += s.evictions;
+  expirations += s.expirations;
+  loadTime += s.loadTime;
+  ghostHits += s.ghostHits;
+  size += s.size;
+  capacity += s.capacity;
+
+  return *this;
+ }
+
+ /// Lookups found.
+ boost::uint64_t hits;
+
+ /// Lookups missed.
+ boost::uint64_t misses;
+
+ /// Records inserted.
+ boost::uint64_t inserts;
+
+ /// Records purged for capacity or weight.
+ boost::uint64_t evictions;
+
+ /// Records purged for expiry.
+ boost::uint64_t expirations;
+
+ /// Milliseconds taken to evaluate values put by Complete or Refresh.
+ boost::uint64_t loadTime;
+
+ /// Misses of keys recently purged to make space, see LRU::Ghosts.
+ boost::uint64_t ghostHits;
+
+ /// Number of records.
+ std::size_t size;
+
+ /// Maximum number of records.
+ std::size_t capacity;
+
+ /// Estimated hit ratios by capacity (miss ratio curve), at CurvePoints 
+ /// multiples of capacity, empty if keys are not sampled, see LRU::Sample.
+ std::vector<std::pair<std::size_t, double> > curve;
+};
+
+/**
+Element of a view of argument tuple, see LRUKeyView. Small scalars are kept
+by value, others by reference.
+It should not be used directly.
+*/
+template<typename T>
+struct _LRUViewOf
+{
+ typedef typename boost::call_traits<T>::param_type type;
+};
+
+template<>
+struct _LRUViewOf<boost::tuples::null_type>
+{
+ typedef boost::tuples::null_type type;
+};
+
+/**
+Non-owning view of key to probe a cache without copying key, it hashes and 
+compares equal to the key it views, and converts to key when the key is 
+inserted. A view of argument tuple refers to the arguments, other keys are 
+their own views.
+
+@param K Key type.
+*/
+template<typename K>
+struct LRUKeyView
+{
+ typedef K type;
+};
+
+template<BOOST_PP_ENUM_PARAMS(10, typename T)>
+struct LRUKeyView<boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)> >
+{
+ #define _LRU_KEY_VIEW_OF(z, i, unused) typename _LRUViewOf<T##i>::type
+
+ typedef boost::tuple<BOOST_PP_ENUM(10, _LRU_KEY_VIEW_OF, ~)> type;
+
+ #undef _LRU_KEY_VIEW_OF
+};
+
+/**
+Fixed-size (by number of records) LRU-replacement cache, optionally 
+bounded by total weight of records too (see LRUWeigher and MaxWeight), 
+records may expire (see Expire) or go stale and be refreshed while still 
+served (see RefreshAfter).
+Reference: 
+http://timday.bitbucket.org/lru.html
+http://patrickaudley.com/code/project/lrucache
+
+@param K Key type.
+@param V Value type.
+@param C Capacity.
+@param ThreadPolicy Thread policy class.
+@param Storage Storage engine selector, BimapStorage or FlatStorage, 
+ FlatStorage takes eviction policy (see Eviction.hpp).
+*/
+template<
+ typename K, 
+ typename V, 
+ std::size_t C = LRU_DEFAULT_CAPACITY, 
+ template <class> class ThreadPolicy = DefaultNullLockable,
+ typename Storage = BimapStorage
+> 
+class LRU : public ThreadPolicy<LRU<K, V, C, ThreadPolicy, Storage> >
+{
+public:
+
+#ifdef __GNUG__
+  typedef ThreadPolicy<LRU<K, V, C, ThreadPolicy, Storage> > ThreadPolicyType;
+#endif
+
+  typedef K KeyType;
+  typedef V ValueType;
+  
+  typedef typename Storage::template apply<K, V>::type ContainerType;
+
+  typedef typename ContainerType::Iterator Iterator;
+
+  /// Probe position kept between two phases of get-or-compute.
+  typedef typename ContainerType::Position PositionType;
+
+  /// Non-owning view of key to probe by, see LRUKeyView.
+  typedef typename LRUKeyView<K>::type ViewType;
+  
+  typedef boost::function<V(const K&)> FunctionType;
+
+  /// In-flight computations by key, used in single-flight mode.
+  typedef boost::unordered_map<
+   K, boost::shared_ptr<SharedResult<V> >, LRUHash 
+  > FlightTable;
+
+  /// Expiration timers.
+  typedef TimerWheel<K> TimerType;
+
+  /// Clock of expiry and refreshing, returns milliseconds.
+  typedef boost::uint32_t (*ClockType)();
+
+  /// Records purged at most by a step of shrinking, see Resize.
+  static const std::size_t TrimStep = 32;
+
+  /// Counters of statistics, relaxed atomics if cache is locked.
+  typedef typename ThreadPolicyType::template Atomic<boost::uint64_t> 
+   Counter;
+  
+public:    
+
+  /**
+  Constuctor specifies the cached function and the maximum number of records 
+  to be stored.  
+  
+  @param c Maximum number of records.
+  @param f Value store function.  
+  */
+  LRU(const std::size_t c = C, const FunctionType f = 0) : 
+   capacity(c), fn(f), container(c), singleFlight(false), maxWeight(0), 
+   weight(0), ttl(0), afterAccess(false), expiring(false), 
+   clock(&TimerType::Now), timers(TimerType::Now()), refreshAge(0), 
+   beta(1.0)
+  {
+  }
+  
+  /**
+  Obtain value of the cached function for k. 
+  
+  Return stored pointer for performance consideration (avoid data copy),
+  but it must keep in mind that pointer might invalid after cache update.
+  If you want a safer operation, please use Get method or keep a copy of 
+  data by yourself.
+  
+  @param k Key.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value pointer which stored in cache.
+  */
+  V* operator()(const K& k, bool* found = NULL) 
+  {
+   OBJECT_LEVEL_LOCK;
+
+   // Attempt to find existing record.
+   PositionType pos;
+   Iterator it = Lookup(k, pos);
+
+   if(it == container.End()) 
+   {
+    if(found)
+     *found = false;
+
+    Miss(k);
+
+    // We don't have it:
+    // Evaluate function and create new record.
+    if(fn)
+    {
+     it = Insert(k, fn(k), &pos, ttl);
+     
+     return it != container.End() ? &container.Value(it) : NULL;
+    }
+    else
+    {
+     return NULL;
+    }
+   } 
+
+   if(found)
+    *found = true;
+
+   // We do have it.
+   ExclusiveUpdate(it);
+      
+   // Return the retrieved value.
+   return &container.Value(it);
+  }
+  
+  /**
+  Put value into cache.
+  
+  @param k Key.
+  @param v Value.
+  */
+  void Put(const K& k,const V& v) 
+  {
+   if(capacity == 0) /* Disabled */
+    return;
+        
+   OBJECT_LEVEL_LOCK;
+
+   Insert(k, v, NULL, ttl);
+  }  
+
+  /**
+  Put value into cache with its own time to live.
+  
+  @param k Key.
+  @param v Value.
+  @param t Time to live in milliseconds, 0 means never expires.
+  */
+  void Put(const K& k, const V& v, const std::size_t t) 
+  {
+   if(capacity == 0) /* Disabled */
+    return;
+        
+   OBJECT_LEVEL_LOCK;
+
+   if(t)
+    expiring = true;
+
+   Insert(k, v, NULL, (boost::uint32_t)t);
+  }  
+  
+  /**
+  Get value from cache.
+  
+  @param k Key.
+  @param default Return value if cache missed.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  V Get(const K& k, V* _default = NULL, bool* found = NULL)
+  {
+   return GetKey(k, _default, found);
+  }
+
+  /**
+  Get value from cache by view of key, key is built only if it is missed 
+  and evaluated, see Get.
+  
+  @param k View of key.
+  @param default Return value if cache missed.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  template<typename Q>
+  V Get(const Q& k, V* _default = NULL, bool* found = NULL, 
+        typename boost::enable_if_c<
+         boost::is_same<Q, ViewType>::value && !boost::is_same<Q, K>::value
+        >::type* = NULL)
+  {
+   return GetKey(k, _default, found);
+  }
+
+  /**
+  Get values of keys in one batch, see Get. Keys are hashed before the 
+  lock is taken, the lock is taken once, and index of keys is prefetched 
+  a few keys ahead of probing, so cache misses of probes overlap.
+  
+  @param keys Keys.
+  @param values Output values in order of keys, default value if missed 
+   and there is no function to evaluate it.
+  @param found Output indicators to indicate whether we found keys or not, 
+   could be NULL.
+  @return Number of keys found.
+  */
+  std::size_t GetMany(const std::vector<K>& keys, std::vector<V>& values, 
+                      std::vector<bool>* found = NULL)
+  {
+   const std::size_t n = keys.size();
+   std::vector<PositionType> pos(n);
+   std::size_t hits = 0;
+
+   for(std::size_t i = 0; i < n; i++)
+    ContainerType::Hash(keys[i], pos[i]);
+
+   values.assign(n, V());
+
+   if(found)
+    found->assign(n, false);
+
+   OBJECT_LEVEL_LOCK;
+
+   const boost::uint32_t now = expiring ? clock() : 0;
+
+   for(std::size_t i = 0; i < n && i < PrefetchAhead; i++)
+    container.Prefetch(pos[i]);
+
+   for(std::size_t i = 0; i < n; i++)
+   {
+    if(i + PrefetchAhead < n)
+     container.Prefetch(pos[i + PrefetchAhead]);
+
+    Iterator it = container.FindHashed(keys[i], pos[i]);
+
+    if(it != container.End() && expiring && Expired(it, now))
+    {
+     Purge(it);
+     Counter::Increment(counters.expirations);
+     it = container.End();
+    }
+
+    if(it == container.End()) 
+    {
+     Miss(keys[i]);
+
+     // Evaluate function and create new record.
+     if(fn)
+     {
+      values[i] = fn(keys[i]);
+      Insert(keys[i], values[i], &pos[i], ttl);
+     }
+
+     continue;
+    }
+
+    ExclusiveUpdate(it);
+
+    values[i] = container.Value(it);
+    hits++;
+
+    if(found)
+     (*found)[i] = true;
+   }
+
+   return hits;
+  }
+
+  /**
+  Put values of keys in one batch, see Put and GetMany.
+  
+  @param keys Keys.
+  @param values Values in order of keys.
+  */
+  void PutMany(const std::vector<K>& keys, const std::vector<V>& values)
+  {
+   if(capacity == 0) /* Disabled */
+    return;
+
+   const std::size_t n = (std::min)(keys.size(), values.size());
+   std::vector<PositionType> pos(n);
+
+   for(std::size_t i = 0; i < n; i++)
+    ContainerType::Hash(keys[i], pos[i]);
+
+   OBJECT_LEVEL_LOCK;
+
+   for(std::size_t i = 0; i < n && i < PrefetchAhead; i++)
+    container.Prefetch(pos[i]);
+
+   for(std::size_t i = 0; i < n; i++)
+   {
+    if(i + PrefetchAhead < n)
+     container.Prefetch(pos[i + PrefetchAhead]);
+
+    if(container.FindHashed(keys[i], pos[i]) == container.End())
+     Insert(keys[i], values[i], &pos[i], ttl);
+   }
+  }
+  
+  /**
+  Get value from cache, or evaluate function and put its result if missed.
+
+  Key is probed once on hit. On miss, f is evaluated without holding the 
+  lock (it may call back into this cache, e.g. recursive function) and its 
+  result is inserted at the position kept from the probe, the key is not 
+  hashed again (bimap storage can not keep it and hashes once more). 
+  If another thread put the same key meanwhile, the existing record is kept.
+  In single-flight mode, concurrent misses of the same key wait for the 
+  first one instead of evaluating f again.
+  
+  @param k Key.
+  @param f Nullary function object to evaluate value.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  template<typename F>
+  V GetOrCompute(const K& k, F f, bool* found = NULL)
+  {
+   bool hit;
+   PositionType pos;
+   const V cached = Acquire(k, hit, &pos);
+
+   if(found)
+    *found = hit;
+
+   if(hit)
+    return cached;
+
+   try
+   {
+    const boost::uint32_t start = TimerType::Now();
+    const V v = f();
+    Complete(k, v, &pos, TimerType::Now() - start);
+
+    return v;
+   }
+   catch(...)
+   {
+    Abort(k, boost::current_exception());
+    throw;
+   }
+  }
+
+  /**
+  First phase of a two-phase get-or-compute, probe key once.
+  
+  On miss, caller is expected to evaluate the value and call Complete, or 
+  call Abort if evaluation failed. In single-flight mode, if another caller 
+  is evaluating the same key, wait for its result (or rethrow its 
+  exception) and report it as found.
+  
+  If storage hits can run under a shared lock (e.g. FlatStorage with 
+  ClockEviction or BufferedEviction), hit is served under SharedLock of ThreadPolicy 
+  (ObjectLevelRWLockable), only miss takes the exclusive lock.
+
+  In refresh mode (see RefreshAfter), a hit on a stale record is reported 
+  to one caller only, who is expected to evaluate the value again and call 
+  Refresh, while the stale value keeps being served.
+  
+  @param k Key.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @param pos Output probe position to pass to Complete, could be NULL.
+  @param stale Output indicator of stale hit to refresh, NULL if caller 
+   does not refresh.
+  @return Value, default value if not found.
+  */
+  V Acquire(const K& k, bool& found, PositionType* pos = NULL, 
+            bool* stale = NULL)
+  {
+   return AcquireKey(k, found, pos, stale);
+  }
+
+  /**
+  First phase of a two-phase get-or-compute by view of key, key is built 
+  only if it is missed in single-flight mode, see Acquire.
+  
+  @param k View of key.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @param pos Output probe position to pass to Complete, could be NULL.
+  @param stale Output indicator of stale hit to refresh, could be NULL.
+  @return Value, default value if not found.
+  */
+  template<typename Q>
+  V Acquire(const Q& k, bool& found, PositionType* pos = NULL, 
+            bool* stale = NULL, 
+            typename boost::enable_if_c<
+             boost::is_same<Q, ViewType>::value && 
+             !boost::is_same<Q, K>::value
+            >::type* = NULL)
+  {
+   return AcquireKey(k, found, pos, stale);
+  }
+
+  /**
+  Second phase of a two-phase get-or-compute, put evaluated value and 
+  hand it to callers waiting for it.
+  
+  @param k Key.
+  @param v Value.
+  @param pos Probe position from Acquire, could be NULL.
+  @param cost Milliseconds taken to evaluate value, see RefreshAfter.
+  */
+  void Complete(const K& k, const V& v, PositionType* pos = NULL, 
+                const std::size_t cost = 0)
+  {
+   boost::shared_ptr<SharedResult<V> > flight = Land(k, &v, pos, 
+                                                     (boost::uint32_t)cost);
+
+   if(flight)
+    flight->Set(v);
+  }
+
+  /**
+  Second phase of a two-phase get-or-compute when evaluation failed, 
+  hand exception to callers waiting for it.
+  
+  @param k Key.
+  @param e Exception.
+  */
+  void Abort(const K& k, const boost::exception_ptr& e)
+  {
+   boost::shared_ptr<SharedResult<V> > flight = Land(k, NULL, NULL, 0);
+
+   if(flight)
+    flight->Fail(e);
+  }
+
+  /**
+  Put refreshed value of a stale hit reported by Acquire, the record is 
+  loaded again. If it was purged meanwhile, the value is dropped.
+
+  @param k Key.
+  @param v Value, NULL if evaluation failed, record will be reported stale 
+   again.
+  @param cost Milliseconds taken to evaluate value.
+  */
+  void Refresh(const K& k, const V* v, const std::size_t cost = 0)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   PositionType pos;
+   const Iterator it = container.Find(k, pos);
+
+   if(it == container.End())
+    return;
+
+   Expiry& e = container.Expiration(it);
+
+   e.refreshing = false;
+
+   if(!v)
+    return;
+
+   const std::size_t w = Weigh(k, *v);
+
+   if(maxWeight && w > maxWeight) /* Never fits */
+   {
+    Purge(it);
+    return;
+   }
+
+   weight -= Weigh(container.Key(it), container.Value(it));
+   container.Value(it) = *v;
+   weight += Weigh(container.Key(it), container.Value(it));
+
+   e.loaded = clock();
+   e.cost = (boost::uint32_t)cost;
+
+   Counter::Add(counters.loadTime, cost);
+
+   // Written again, timer is scheduled again when due.
+   if(e.ttl && !afterAccess)
+    e.deadline = e.loaded + e.ttl;
+
+   MakeSpace();
+  }
+
+  /**
+  Obtain the cached keys, most recently used element at head, 
+  least recently used at tail.
+  
+  @param dst Result container iterator.
+  */
+  template<typename IT> 
+  void GetKeys(IT& dst) const 
+  {
+   OBJECT_LEVEL_LOCK;
+
+   container.GetKeys(dst);
+  }
+
+  /**
+  Obtain the cached records in order of GetKeys, expired ones are skipped.
+  
+  @param dst Result container iterator of std::pair<K, V>.
+  */
+  template<typename IT> 
+  void GetRecords(IT& dst)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   std::vector<K> keys;
+   std::back_insert_iterator<std::vector<K> > it(keys);
+   container.GetKeys(it);
+
+   const boost::uint32_t now = clock();
+
+   for(std::size_t i = 0; i < keys.size(); i++)
+   {
+    PositionType pos;
+    const Iterator r = container.Find(keys[i], pos);
+
+    if(r != container.End() && !(expiring && Expired(r, now)))
+     *dst++ = std::make_pair(keys[i], container.Value(r));
+   }
+  }
+  
+  /**
+  Cached key exists or not?
+  
+  @param key Key.
+  @return True if exists.
+  */
+  inline bool Exists(const K& key) const
+  {  
+   OBJECT_LEVEL_LOCK;
+
+   return container.Contains(key);
+  }
+
+  /**
+  Remove cached key.
+  
+  @param k Key.
+  */
+  void Erase(const K& k)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   PositionType pos;
+   const Iterator it = container.Find(k, pos);
+
+   if(it != container.End())
+    Purge(it);
+  }
+
+  /**
+  Enable or disable single-flight mode, concurrent misses of the same key 
+  are evaluated once and the others wait for its result.
+
+  @param enable Enable or not.
+  */
+  inline void SingleFlight(const bool enable)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   singleFlight = enable;
+  }
+
+  /**
+  Expire records after time to live, expired records are missed and 
+  reclaimed by a timer wheel. Records put with their own time to live 
+  keep it.
+
+  @param t Time to live in milliseconds of records put without one, 0 means 
+   never expires.
+  @param access Expire after last access rather than after write.
+  */
+  inline void Expire(const std::size_t t, const bool access = false)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   ttl = (boost::uint32_t)t;
+   afterAccess = access;
+
+   if(t)
+    expiring = true;
+  }
+
+  /**
+  Replace clock of expiry and refreshing, for instance by a simulated one 
+  in tests. Set it before putting records with time to live.
+
+  @param c Function returning current time in milliseconds, see 
+   TimerWheel::Now.
+  */
+  inline void Clock(const ClockType c)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   clock = c;
+   timers.Reset(clock());
+  }
+
+  /**
+  Refresh records after write, a record older than refresh age is still 
+  served but reported stale to one caller to refresh it, see Acquire. 
+  To spread refreshes out, a record may be reported stale earlier, with 
+  probability rising as it ages and scaled by its evaluation cost 
+  (XFetch, Vattani et al. "Optimal Probabilistic Cache Stampede 
+  Prevention").
+
+  @param t Refresh age in milliseconds, 0 means never refreshes.
+  @param b Scale of early refresh, 0 means refreshing at refresh age 
+   exactly, greater than 1 favors earlier refreshes.
+  */
+  inline void RefreshAfter(const std::size_t t, const double b = 1.0)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   refreshAge = (boost::uint32_t)t;
+   beta = b;
+  }
+
+  /**
+  Bound total weight of records, purge least-recently-used ones until 
+  it fits. A record heavier than the limit is not cached.
+
+  @param w Maximum weight, 0 means unbounded.
+  */
+  inline void MaxWeight(const std::size_t w)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   maxWeight = w;
+
+   while(MakeSpace(TrimStep));
+  }
+
+  /**
+  Obtain total weight of records.
+
+  @return Weight.
+  */
+  inline std::size_t Weight() const
+  {
+   OBJECT_LEVEL_LOCK;
+
+   return weight;
+  }
+
+  /**
+  Obtain statistics.
+
+  @return Statistics.
+  */
+  LRUStats Stats() const
+  {
+   LRUStats s;
+
+   s.hits = Counter::Load(counters.hits);
+   s.misses = Counter::Load(counters.misses);
+   s.inserts = Counter::Load(counters.inserts);
+   s.evictions = Counter::Load(counters.evictions);
+   s.expirations = Counter::Load(counters.expirations);
+   s.loadTime = Counter::Load(counters.loadTime);
+   s.ghostHits = Counter::Load(counters.ghostHits);
+
+   {
+    OBJECT_LEVEL_SHARED_LOCK;
+
+    s.size = container.Size();
+    s.capacity = capacity;
+
+    for(std::size_t i = 0; sampler && i < LRUStats::CurvePoints; i++)
+    {
+     const std::size_t c = LRUStats::CurveCapacity(capacity, i);
+
+     s.curve.push_back(std::make_pair(c, sampler->HitRatio(c)));
+    }
+   }
+
+   return s;
+  }
+
+  /**
+  Resize capacity. Storage grows without rehashing all at once (see 
+  FlatContainer). If it shrinks, least-recently-used records are purged 
+  TrimStep at a time: once here, then on every insert or Trim, so lookups 
+  are not stalled by purging a large cache. Storage returns memory of 
+  purged records as they are purged (see Container Compact).
+
+  @param size Capacity, 0 disables cache.
+  */
+  void Resize(const std::size_t size)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   container.Resize(size);
+
+   if(size < capacity)
+    container.Compact();
+
+   capacity = size;
+
+   MakeSpace(TrimStep);
+  }
+
+  /**
+  Purge least-recently-used records over capacity or maximum weight, a 
+  step of incremental shrinking, see Resize.
+
+  @param n Maximum number of records to purge.
+  @return True if records are still over.
+  */
+  bool Trim(const std::size_t n = TrimStep)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   return MakeSpace(n);
+  }
+
+  /**
+  Obtain capacity.
+
+  @return Maximum number of records.
+  */
+  inline std::size_t Capacity() const
+  {
+   OBJECT_LEVEL_SHARED_LOCK;
+
+   return capacity;
+  }
+
+  /**
+  Remember hashes of up to n keys recently purged to make space, misses of 
+  them are counted as ghost hits (see LRUStats), which are hits about n 
+  more records would gain. Ghosts share slots by hash, a newer one takes 
+  the slot, they are forgotten if n changes.
+
+  @param n Number of ghosts, 0 stops counting.
+  */
+  void Ghosts(const std::size_t n)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   if(ghosts.size() != n)
+    std::vector<std::size_t>(n, 0).swap(ghosts);
+  }
+
+  /**
+  Sample reuse distances of one of rate keys (see ReuseSampler), which 
+  estimate hit ratio at capacities from 1/10 to 10 times capacity, see 
+  HitRatio and LRUStats curve. Lookups of other keys pay a hash and a 
+  division, memory is about 10 * capacity / rate keys. Samples restart on 
+  every call.
+
+  @param rate Sampling rate, 0 stops sampling.
+  */
+  void Sample(const std::size_t rate)
+  {
+   OBJECT_LEVEL_LOCK;
+
+   sampler.reset(rate ? new ReuseSampler(rate) : NULL);
+  }
+
+  /**
+  Estimate hit ratio at capacity by sampled reuse distances, see Sample.
+
+  @param c Capacity, up to 10 times capacity.
+  @return Hit ratio, 0 if keys are not sampled.
+  */
+  double HitRatio(const std::size_t c) const
+  {
+   OBJECT_LEVEL_SHARED_LOCK;
+
+   return sampler ? sampler->HitRatio(c) : 0;
+  }
+  
+private:
+
+ /// Keys prefetched ahead of probing in batches.
+ static const std::size_t PrefetchAhead = 8;
+ 
+ /**
+ Insert a new record as most-recently-used, purge the least-recently-used 
+ one if capacity is exceeded, the record already there is kept. 
+ Lock must be held by caller.
+ 
+ @param k Key.
+ @param v Value.
+ @param pos Probe position, NULL if not probed.
+ @param t Time to live, 0 means never expires.
+ @param cost Time taken to evaluate value.
+ @return Record iterator, end if cache is disabled.
+ */
+ Iterator Insert(const K& k, const V& v, PositionType* pos, 
+                 const boost::uint32_t t, const boost::uint32_t cost = 0)
+ {
+  if(capacity == 0) /* Disabled */
+   return container.End();
+
+  const std::size_t w = Weigh(k, v);
+
+  if(maxWeight && w > maxWeight) /* Never fits */
+   return container.End();
+
+  const boost::uint32_t now = expiring || refreshAge ? clock() : 0;
+
+  // Reclaim expired records first, they may make space.
+  if(expiring)
+  {
+   Reclaimer reclaimer(*this, now);
+   timers.Advance(now, reclaimer);
+  }
+
+  const std::pair<Iterator, bool> r = container.Insert(k, v, pos);
+
+  if(r.second)
+  {
+   Counter::Increment(counters.inserts);
+
+   // Weigh stored copy, purge weighs the same.
+   weight += Weigh(container.Key(r.first), container.Value(r.first));
+
+   Expiry& e = container.Expiration(r.first);
+
+   e.loaded = now;
+   e.cost = cost;
+
+   if(t)
+   {
+    e.ttl = t;
+    e.deadline = e.scheduled = now + t;
+
+    timers.Schedule(k, e.deadline);
+   }
+
+   // If necessary, make space.
+   MakeSpace();
+  }
+
+  return r.first;
+ }
+
+ /**
+ Get value from cache, see Get.
+
+ @param k Key or view of key.
+ @param default Return value if cache missed.
+ @param found A boolean indicator to indicate whether we found key or not.
+ @return Value.
+ */
+ template<typename Q>
+ V GetKey(const Q& k, V* _default, bool* found)
+ {
+  OBJECT_LEVEL_LOCK;
+
+  // Attempt to find existing record.
+  PositionType pos;
+  const Iterator it = Lookup(k, pos);
+
+  if(it == container.End()) 
+  {
+   if(found)
+    *found = false;
+
+   Miss(k);
+
+   // We don't have it:
+   // Evaluate function and create new record
+   if(fn)
+   {
+    const K& key = Owned(k);
+    const V v = fn(key);     
+    Insert(key, v, &pos, ttl);
+    
+    return v;
+   }
+   else if(_default)
+   {
+    return *_default;
+   }
+   else
+   {
+    return V();
+   }
+  } 
+
+  if(found)
+   *found = true;
+
+  // We do have it:
+  ExclusiveUpdate(it);
+     
+  // Return the retrieved value.
+  return container.Value(it);
+ }
+
+ /**
+ First phase of a two-phase get-or-compute, see Acquire.
+
+ @param k Key or view of key.
+ @param found A boolean indicator to indicate whether we found key or not.
+ @param pos Output probe position to pass to Complete, could be NULL.
+ @param stale Output indicator of stale hit to refresh, could be NULL.
+ @return Value, default value if not found.
+ */
+ template<typename Q>
+ V AcquireKey(const Q& k, bool& found, PositionType* pos, bool* stale)
+ {
+  boost::shared_ptr<SharedResult<V> > flight;
+  PositionType p;
+
+  if(stale)
+   *stale = false;
+
+  // Expire-after-access writes deadline on hit, exclusive lock required.
+  if(ContainerType::SharedHit && !(expiring && afterAccess))
+  {
+   V v = V();
+   found = false;
+
+   {
+    // Hit only marks or buffers record atomically, readers run 
+    // concurrently.
+    OBJECT_LEVEL_SHARED_LOCK;
+
+    PositionType& q = pos ? *pos : p;
+    const Iterator it = container.Find(k, q);
+
+    if(it != container.End()) 
+    {
+     const boost::uint32_t now = expiring || refreshAge ? clock() : 0;
+
+     if(expiring && Expired(it, now))
+     {
+      // Purge it with exclusive lock.
+      q = PositionType();
+     }
+     else if(stale && refreshAge && Stale(it, now))
+     {
+      // Mark it with exclusive lock.
+      q = PositionType();
+     }
+     else
+     {
+      found = true;
+
+      Update(it);
+
+      v = container.Value(it);
+     }
+    }
+   }
+
+   if(found)
+   {
+    // Drain deferred hits if no one else holds the lock.
+    if(container.Pending())
+    {
+     OBJECT_LEVEL_TRY_LOCK;
+
+     if(_lock.owns_lock())
+      container.Drain();
+    }
+
+    return v;
+   }
+  }
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   // Probe again if writers came in between.
+   const Iterator it = Lookup(k, pos ? *pos : p, ContainerType::SharedHit);
+
+   if(it != container.End()) 
+   {
+    found = true;
+
+    if(stale && refreshAge && Stale(it, clock()))
+    {
+     // Other callers keep getting stale value until refreshed.
+     container.Expiration(it).refreshing = true;
+     *stale = true;
+    }
+
+    ExclusiveUpdate(it);
+
+    return container.Value(it);
+   }
+
+   found = false;
+
+   Miss(k);
+
+   if(!singleFlight)
+    return V();
+
+   const K& key = Owned(k);
+
+   typename FlightTable::iterator i = flights.find(key);
+   if(i == flights.end())
+   {
+    // We are the first one, other callers wait for us.
+    flights[key].reset(new SharedResult<V>());
+
+    return V();
+   }
+
+   flight = i->second;
+  }
+
+  const V v = flight->Wait();
+  found = true;
+
+  return v;
+ }
+
+ /**
+ Key of a key, no copy.
+
+ @param k Key.
+ @return Key.
+ */
+ static inline const K& Owned(const K& k)
+ {
+  return k;
+ }
+
+ /**
+ Key of a view of key, built from it.
+
+ @param k View of key.
+ @return Key.
+ */
+ template<typename Q>
+ static inline K Owned(const Q& k)
+ {
+  return K(k);
+ }
+
+ /**
+ Probe key with exclusive lock held, expired record is purged and missed.
+
+ @param k Key.
+ @param pos Probe position.
+ @param refind Probe again after shared lock, see Container Refind.
+ @return Record iterator, end if not found.
+ */
+ template<typename Q>
+ Iterator Lookup(const Q& k, PositionType& pos, const bool refind = false)
+ {
+  const Iterator it = refind ? container.Refind(k, pos) : 
+                               container.Find(k, pos);
+
+  if(it != container.End() && expiring && Expired(it, clock()))
+  {
+   Purge(it);
+   Counter::Increment(counters.expirations);
+
+   return container.End();
+  }
+
+  return it;
+ }
+
+ /**
+ Record is expired?
+
+ @param it Record iterator.
+ @param now Current time.
+ @return True if expired.
+ */
+ inline bool Expired(const Iterator& it, const boost::uint32_t now) const
+ {
+  const Expiry& e = container.Expiration(it);
+
+  return e.ttl && !TimerType::Before(now, e.deadline);
+ }
+
+ /**
+ Record is stale and not being refreshed? Record is stale at refresh age, 
+ or earlier at random by XFetch: age - cost * beta * log(u) >= refresh age, 
+ u is uniform in (0, 1].
+
+ @param it Record iterator.
+ @param now Current time.
+ @return True if stale.
+ */
+ bool Stale(const Iterator& it, const boost::uint32_t now) const
+ {
+  const Expiry& e = container.Expiration(it);
+
+  if(e.refreshing)
+   return false;
+
+  const boost::uint32_t age = now - e.loaded;
+
+  if(age >= refreshAge)
+   return true;
+
+  if(!e.cost || beta <= 0)
+   return false;
+
+  // Hash time and record into u, no shared state is written.
+  boost::uint32_t h = now * 0x9e3779b1u ^ e.loaded ^ 
+                      (boost::uint32_t)(std::size_t)&e;
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+
+  const double u = ((h >> 8) + 1) * (1.0 / (1 << 24));
+
+  return age - e.cost * beta * std::log(u) >= refreshAge;
+ }
+
+ /**
+ Timer of key is due, purge record if expired, or schedule it again if 
+ accessed since. Timers of purged or replaced records are stale.
+
+ @param k Key.
+ @param deadline Deadline of timer.
+ @param now Current time.
+ */
+ void Reclaim(const K& k, const boost::uint32_t deadline, 
+              const boost::uint32_t now)
+ {
+  PositionType pos;
+  const Iterator it = container.Find(k, pos);
+
+  if(it == container.End())
+   return;
+
+  Expiry& e = container.Expiration(it);
+
+  if(!e.ttl || e.scheduled != deadline)
+   return;
+
+  if(TimerType::Before(now, e.deadline))
+  {
+   e.scheduled = e.deadline;
+   timers.Schedule(k, e.deadline);
+  }
+  else
+  {
+   Purge(it);
+   Counter::Increment(counters.expirations);
+  }
+ }
+
+ /// Timer wheel callback.
+ struct Reclaimer
+ {
+  Reclaimer(LRU& c, const boost::uint32_t n) : cache(c), now(n)
+  {
+  }
+
+  inline void operator()(const K& k, const boost::uint32_t deadline)
+  {
+   cache.Reclaim(k, deadline, now);
+  }
+
+  LRU& cache;
+  const boost::uint32_t now;
+ };
+
+ /**
+ Purge record. Lock must be held by caller.
+
+ @param it Record iterator.
+ */
+ inline void Purge(const Iterator& it)
+ {
+  weight -= Weigh(container.Key(it), container.Value(it));
+  container.Evict(it);
+ }
+
+ /**
+ Purge records until both capacity and maximum weight are met, the record 
+ just inserted is kept. A disabled cache (capacity 0) is cleared at once. 
+ Lock must be held by caller.
+
+ @param n Maximum number of records to purge.
+ @return True if records are still over.
+ */
+ bool MakeSpace(std::size_t n = TrimStep)
+ {
+  if(capacity == 0)
+   n = container.Size();
+
+  for(; n && Over(); n--)
+  {
+   const Iterator it = container.Victim();
+
+   if(!ghosts.empty())
+    Ghost(container.Key(it)) = GhostOf(container.Key(it));
+
+   Purge(it);
+   Counter::Increment(counters.evictions);
+  }
+
+  return Over();
+ }
+
+ /**
+ Records are over capacity or maximum weight? Lock must be held by caller.
+
+ @return True if over.
+ */
+ inline bool Over() const
+ {
+  return container.Size() > capacity || 
+         (maxWeight && weight > maxWeight && container.Size() > 1);
+ }
+
+ /**
+ Count miss of key, and ghost hit if key is a ghost. Lock must be held by 
+ caller.
+
+ @param k Key.
+ */
+ template<typename Q>
+ inline void Miss(const Q& k)
+ {
+  Counter::Increment(counters.misses);
+  Track(k);
+
+  if(!ghosts.empty() && Ghost(k) == GhostOf(k))
+   Counter::Increment(counters.ghostHits);
+ }
+
+ /**
+ Ghost slot of key.
+
+ @param k Key.
+ @return Slot.
+ */
+ template<typename Q>
+ inline std::size_t& Ghost(const Q& k)
+ {
+  return ghosts[LRUHash()(k) % ghosts.size()];
+ }
+
+ /**
+ Ghost of key, never 0 (empty slot).
+
+ @param k Key.
+ @return Ghost.
+ */
+ template<typename Q>
+ static inline std::size_t GhostOf(const Q& k)
+ {
+  return LRUHash()(k) | 1;
+ }
+
+ /**
+ Feed lookup of key to sampler if it is sampled, shared lock is enough.
+
+ @param k Key.
+ */
+ template<typename Q>
+ inline void Track(const Q& k) const
+ {
+  if(!sampler)
+   return;
+
+  const std::size_t h = LRUHash()(k);
+
+  if(sampler->Sampled(h))
+   sampler->Access(h, capacity);
+ }
+
+ /**
+ Weigh record.
+
+ @param k Key.
+ @param v Value.
+ @return Weight.
+ */
+ static inline std::size_t Weigh(const K& k, const V& v)
+ {
+  return LRUWeigher<K>::Weight(k) + LRUWeigher<V>::Weight(v);
+ }
+
+ /**
+ Put value if any and remove in-flight record of key.
+ 
+ @param k Key.
+ @param v Value, NULL if evaluation failed.
+ @param pos Probe position, NULL if not probed.
+ @param cost Time taken to evaluate value.
+ @return In-flight record, NULL if no one is waiting.
+ */
+ boost::shared_ptr<SharedResult<V> > Land(const K& k, const V* v, 
+                                          PositionType* pos, 
+                                          const boost::uint32_t cost)
+ {
+  boost::shared_ptr<SharedResult<V> > flight;
+
+  OBJECT_LEVEL_LOCK;
+
+  if(v)
+  {
+   Insert(k, *v, pos, ttl, cost);
+   Counter::Add(counters.loadTime, cost);
+  }
+
+  if(singleFlight)
+  {
+   typename FlightTable::iterator i = flights.find(k);
+   if(i != flights.end())
+   {
+    flight = i->second;
+    flights.erase(i);
+   }
+  }
+
+  return flight;
+ }
+
+ /**
+ Update internal container.
+ 
+ @param it Retrived value iterator.
+ */
+ inline void Update(const Iterator& it)
+ {
+  container.Touch(it);
+
+  Counter::Increment(counters.hits);
+  Track(container.Key(it));
+ }
+
+ /**
+ Update internal container with exclusive lock held, drain deferred hits 
+ if storage asks to.
+ 
+ @param it Retrived value iterator.
+ */
+ inline void ExclusiveUpdate(const Iterator& it)
+ {
+  container.Touch(it);
+
+  Counter::Increment(counters.hits);
+  Track(container.Key(it));
+
+  if(container.Pending())
+   container.Drain();
+
+  if(expiring && afterAccess)
+  {
+   Expiry& e = container.Expiration(it);
+
+   // Timer is scheduled again when due.
+   if(e.ttl)
+    e.deadline = clock() + e.ttl;
+  }
+ }
+  
+
+private:
+  
+ /// Value store function.
+ const FunctionType fn;
+  
+ /// Capacity (maximum records).
+ std::size_t capacity;
+ 
+ /// Internal container.
+ ContainerType container;
+
+ /// Single-flight mode.
+ bool singleFlight;
+
+ /// Maximum total weight, 0 means unbounded.
+ std::size_t maxWeight;
+
+ /// Total weight of records.
+ std::size_t weight;
+
+ /// Time to live of records put without one, 0 means never expires.
+ boost::uint32_t ttl;
+
+ /// Expire after last access rather than after write.
+ bool afterAccess;
+
+ /// Some records may expire.
+ bool expiring;
+
+ /// Clock of expiry and refreshing.
+ ClockType clock;
+
+ /// Expiration timers.
+ TimerType timers;
+
+ /// Refresh age, 0 means never refreshes.
+ boost::uint32_t refreshAge;
+
+ /// Scale of early refresh.
+ double beta;
+
+ /// In-flight computations.
+ FlightTable flights;
+
+ /// Hashes of keys recently purged to make space, 0 is empty slot.
+ std::vector<std::size_t> ghosts;
+
+ /// Reuse distances of sampled keys, NULL if not sampled.
+ boost::shared_ptr<ReuseSampler> sampler;
+
+ /// Counters of statistics.
+ struct Counters
+ {
+  Counters() : hits(0), misses(0), inserts(0), evictions(0), expirations(0), 
+               loadTime(0), ghostHits(0)
+  {
+  }
+
+  typename Counter::Type hits;
+  typename Counter::Type misses;
+  typename Counter::Type inserts;
+  typename Counter::Type evictions;
+  typename Counter::Type expirations;
+  typename Counter::Type loadTime;
+  typename Counter::Type ghostHits;
+ };
+
+ /// Statistics.
+ Counters counters;
+ 
+};
+
+/**
+LRU cache partitioned into independently locked shards.
+Keys are routed by hash, every shard is a LRU with its own lock and recency 
+list, so threads working on different shards never contend. Replacement is 
+per shard, which approximates LRU of the whole cache.
+
+@param K Key type.
+@param V Value type.
+@param Shards Number of shards.
+@param C Capacity of whole cache.
+@param ThreadPolicy Thread policy class of each shard.
+@param Storage Storage engine selector of each shard.
+*/
+template<
+ typename K, 
+ typename V, 
+ std::size_t Shards = 16,
+ std::size_t C = LRU_DEFAULT_CAPACITY, 
+ template <class> class ThreadPolicy = DefaultObjectLevelLockable,
+ typename Storage = BimapStorage
+> 
+class ShardedLRU
+{
+public:
+
+  typedef K KeyType;
+  typedef V ValueType;
+
+  /// Shard type.
+  typedef LRU<K, V, (C + Shards - 1) / Shards, ThreadPolicy, Storage> 
+   ShardType;
+
+  /// Probe position kept between two phases of get-or-compute.
+  typedef typename ShardType::PositionType PositionType;
+
+  /// Non-owning view of key to probe by, see LRUKeyView.
+  typedef typename ShardType::ViewType ViewType;
+
+public:
+
+  /**
+  Constructor specifies the maximum number of records to be stored, 
+  which is divided among shards.
+  
+  @param c Maximum number of records.
+  */
+  ShardedLRU(const std::size_t c = C)
+  {
+   // Allocate shards separately, so their locks do not share cache line.
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i].reset(new ShardType((c + Shards - 1) / Shards));
+  }
+
+  /**
+  Put value into cache.
+  
+  @param k Key.
+  @param v Value.
+  */
+  inline void Put(const K& k, const V& v) 
+  {
+   Shard(k).Put(k, v);
+  }
+
+  /**
+  Put value into cache with its own time to live, see LRU::Put.
+  
+  @param k Key.
+  @param v Value.
+  @param t Time to live in milliseconds, 0 means never expires.
+  */
+  inline void Put(const K& k, const V& v, const std::size_t t) 
+  {
+   Shard(k).Put(k, v, t);
+  }
+
+  /**
+  Get value from cache, see LRU::Get.
+  
+  @param k Key.
+  @param default Return value if cache missed.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  inline V Get(const K& k, V* _default = NULL, bool* found = NULL)
+  {
+   return Shard(k).Get(k, _default, found);
+  }
+
+  /**
+  Get value from cache by view of key, see LRU::Get.
+  
+  @param k View of key.
+  @param default Return value if cache missed.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  template<typename Q>
+  inline V Get(const Q& k, V* _default = NULL, bool* found = NULL, 
+               typename boost::enable_if_c<
+                boost::is_same<Q, ViewType>::value && 
+                !boost::is_same<Q, K>::value
+               >::type* = NULL)
+  {
+   return Shard(k).Get(k, _default, found);
+  }
+
+  /**
+  Get values of keys in one batch, keys are grouped by shard and each 
+  shard takes its lock once, see LRU::GetMany.
+  
+  @param keys Keys.
+  @param values Output values in order of keys.
+  @param found Output indicators to indicate whether we found keys or not, 
+   could be NULL.
+  @return Number of keys found.
+  */
+  std::size_t GetMany(const std::vector<K>& keys, std::vector<V>& values, 
+                      std::vector<bool>* found = NULL)
+  {
+   std::vector<K> parts[Shards];
+   std::vector<std::size_t> indices[Shards];
+   std::vector<V> v;
+   std::vector<bool> f;
+   std::size_t hits = 0;
+
+   Split(keys, parts, indices);
+
+   values.resize(keys.size());
+
+   if(found)
+    found->resize(keys.size());
+
+   for(std::size_t s = 0; s < Shards; s++)
+   {
+    if(parts[s].empty())
+     continue;
+
+    hits += shards[s]->GetMany(parts[s], v, &f);
+
+    for(std::size_t j = 0; j < v.size(); j++)
+    {
+     values[indices[s][j]] = v[j];
+
+     if(found)
+      (*found)[indices[s][j]] = f[j];
+    }
+   }
+
+   return hits;
+  }
+
+  /**
+  Put values of keys in one batch, see GetMany.
+  
+  @param keys Keys.
+  @param values Values in order of keys.
+  */
+  void PutMany(const std::vector<K>& keys, const std::vector<V>& values)
+  {
+   std::vector<K> parts[Shards];
+   std::vector<std::size_t> indices[Shards];
+   std::vector<V> v;
+
+   Split(keys, parts, indices);
+
+   for(std::size_t s = 0; s < Shards; s++)
+   {
+    if(parts[s].empty())
+     continue;
+
+    v.clear();
+    for(std::size_t j = 0; j < indices[s].size(); j++)
+     if(indices[s][j] < values.size())
+      v.push_back(values[indices[s][j]]);
+
+    shards[s]->PutMany(parts[s], v);
+   }
+  }
+
+  /**
+  Get value from cache, or evaluate function and put its result if missed, 
+  see LRU::GetOrCompute.
+  
+  @param k Key.
+  @param f Nullary function object to evaluate value.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @return Value.
+  */
+  template<typename F>
+  inline V GetOrCompute(const K& k, F f, bool* found = NULL)
+  {
+   return Shard(k).GetOrCompute(k, f, found);
+  }
+
+  /**
+  First phase of a two-phase get-or-compute, see LRU::Acquire.
+  
+  @param k Key.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @param pos Output probe position to pass to Complete, could be NULL.
+  @param stale Output indicator of stale hit to refresh, could be NULL.
+  @return Value, default value if not found.
+  */
+  inline V Acquire(const K& k, bool& found, PositionType* pos = NULL, 
+                   bool* stale = NULL)
+  {
+   return Shard(k).Acquire(k, found, pos, stale);
+  }
+
+  /**
+  First phase of a two-phase get-or-compute by view of key, see 
+  LRU::Acquire.
+  
+  @param k View of key.
+  @param found A boolean indicator to indicate whether we found key or not.
+  @param pos Output probe position to pass to Complete, could be NULL.
+  @param stale Output indicator of stale hit to refresh, could be NULL.
+  @return Value, default value if not found.
+  */
+  template<typename Q>
+  inline V Acquire(const Q& k, bool& found, PositionType* pos = NULL, 
+                   bool* stale = NULL, 
+                   typename boost::enable_if_c<
+                    boost::is_same<Q, ViewType>::value && 
+                    !boost::is_same<Q, K>::value
+                   >::type* = NULL)
+  {
+   return Shard(k).Acquire(k, found, pos, stale);
+  }
+
+  /**
+  Second phase of a two-phase get-or-compute, see LRU::Complete.
+  
+  @param k Key.
+  @param v Value.
+  @param pos Probe position from Acquire, could be NULL.
+  @param cost Milliseconds taken to evaluate value.
+  */
+  inline void Complete(const K& k, const V& v, PositionType* pos = NULL, 
+                       const std::size_t cost = 0)
+  {
+   Shard(k).Complete(k, v, pos, cost);
+  }
+
+  /**
+  Second phase of a two-phase get-or-compute when evaluation failed, 
+  see LRU::Abort.
+  
+  @param k Key.
+  @param e Exception.
+  */
+  inline void Abort(const K& k, const boost::exception_ptr& e)
+  {
+   Shard(k).Abort(k, e);
+  }
+
+  /**
+  Put refreshed value of a stale hit, see LRU::Refresh.
+
+  @param k Key.
+  @param v Value, NULL if evaluation failed.
+  @param cost Milliseconds taken to evaluate value.
+  */
+  inline void Refresh(const K& k, const V* v, const std::size_t cost = 0)
+  {
+   Shard(k).Refresh(k, v, cost);
+  }
+
+  /**
+  Obtain the cached keys shard by shard, most recently used element at head
+  of each shard.
+  
+  @param dst Result container iterator.
+  */
+  template<typename IT> 
+  void GetKeys(IT& dst) const 
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->GetKeys(dst);
+  }
+
+  /**
+  Obtain the cached records shard by shard, see LRU::GetRecords.
+  
+  @param dst Result container iterator of std::pair<K, V>.
+  */
+  template<typename IT> 
+  void GetRecords(IT& dst)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->GetRecords(dst);
+  }
+
+  /**
+  Cached key exists or not?
+  
+  @param key Key.
+  @return True if exists.
+  */
+  inline bool Exists(const K& key) const
+  {
+   return Shard(key).Exists(key);
+  }
+
+  /**
+  Remove cached key.
+  
+  @param k Key.
+  */
+  inline void Erase(const K& k)
+  {
+   Shard(k).Erase(k);
+  }
+
+  /**
+  Enable or disable single-flight mode of all shards.
+
+  @param enable Enable or not.
+  */
+  void SingleFlight(const bool enable)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->SingleFlight(enable);
+  }
+
+  /**
+  Expire records of all shards, see LRU::Expire.
+
+  @param t Time to live in milliseconds, 0 means never expires.
+  @param access Expire after last access rather than after write.
+  */
+  void Expire(const std::size_t t, const bool access = false)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->Expire(t, access);
+  }
+
+  /**
+  Replace clock of all shards, see LRU::Clock.
+
+  @param c Function returning current time in milliseconds.
+  */
+  void Clock(const typename ShardType::ClockType c)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->Clock(c);
+  }
+
+  /**
+  Refresh records of all shards after write, see LRU::RefreshAfter.
+
+  @param t Refresh age in milliseconds, 0 means never refreshes.
+  @param b Scale of early refresh.
+  */
+  void RefreshAfter(const std::size_t t, const double b = 1.0)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->RefreshAfter(t, b);
+  }
+
+  /**
+  Bound total weight of records, which is divided among shards.
+
+  @param w Maximum weight, 0 means unbounded.
+  */
+  void MaxWeight(const std::size_t w)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->MaxWeight((w + Shards - 1) / Shards);
+  }
+
+  /**
+  Obtain total weight of records of all shards.
+
+  @return Weight.
+  */
+  std::size_t Weight() const
+  {
+   std::size_t w = 0;
+
+   for(std::size_t i = 0; i < Shards; i++)
+    w += shards[i]->Weight();
+
+   return w;
+  }
+
+  /**
+  Resize capacity, which is divided among shards, see LRU::Resize.
+
+  @param size Capacity.
+  */
+  void Resize(const std::size_t size)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->Resize((size + Shards - 1) / Shards);
+  }
+
+  /**
+  Purge records over capacity of shards, see LRU::Trim.
+
+  @param n Maximum number of records to purge from a shard.
+  @return True if records of any shard are still over.
+  */
+  bool Trim(const std::size_t n = ShardType::TrimStep)
+  {
+   bool over = false;
+
+   for(std::size_t i = 0; i < Shards; i++)
+    over = shards[i]->Trim(n) || over;
+
+   return over;
+  }
+
+  /**
+  Obtain capacity of all shards.
+
+  @return Maximum number of records.
+  */
+  std::size_t Capacity() const
+  {
+   std::size_t c = 0;
+
+   for(std::size_t i = 0; i < Shards; i++)
+    c += shards[i]->Capacity();
+
+   return c;
+  }
+
+  /**
+  Remember keys recently purged to make space, which are divided among 
+  shards, see LRU::Ghosts.
+
+  @param n Number of ghosts, 0 stops counting.
+  */
+  void Ghosts(const std::size_t n)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->Ghosts((n + Shards - 1) / Shards);
+  }
+
+  /**
+  Sample reuse distances of keys of all shards, see LRU::Sample.
+
+  @param rate Sampling rate, 0 stops sampling.
+  */
+  void Sample(const std::size_t rate)
+  {
+   for(std::size_t i = 0; i < Shards; i++)
+    shards[i]->Sample(rate);
+  }
+
+  /**
+  Estimate hit ratio at capacity, which is divided among shards, see 
+  LRU::HitRatio. Keys are routed by hash, shards are weighed evenly.
+
+  @param c Capacity.
+  @return Hit ratio, 0 if keys are not sampled.
+  */
+  double HitRatio(const std::size_t c) const
+  {
+   double r = 0;
+
+   for(std::size_t i = 0; i < Shards; i++)
+    r += shards[i]->HitRatio((c + Shards - 1) / Shards);
+
+   return r / Shards;
+  }
+
+  /**
+  Obtain statistics of all shards.
+
+  @return Statistics.
+  */
+  LRUStats Stats() const
+  {
+   LRUStats s;
+
+   for(std::size_t i = 0; i < Shards; i++)
+    s += shards[i]->Stats();
+
+   return s;
+  }
+
+private:
+
+ /**
+ Route key to its shard.
+
+ @param k Key or view of key.
+ @return Shard.
+ */
+ template<typename Q>
+ inline ShardType& Shard(const Q& k) const
+ {
+  return *shards[ShardOf(k)];
+ }
+
+ /**
+ Route key to its shard.
+
+ @param k Key or view of key.
+ @return Shard index.
+ */
+ template<typename Q>
+ static inline std::size_t ShardOf(const Q& k)
+ {
+  // Shard's own hash table is indexed by low bits of the same hash value.
+  return (std::size_t)((LRUHasher<Q>::Hash(k) >> 32) % Shards);
+ }
+
+ /**
+ Group keys of a batch by shard.
+
+ @param keys Keys.
+ @param parts Output keys of shards.
+ @param indices Output indices of keys of shards in batch.
+ */
+ static void Split(const std::vector<K>& keys, std::vector<K>* parts, 
+                   std::vector<std::size_t>* indices)
+ {
+  for(std::size_t i = 0; i < keys.size(); i++)
+  {
+   const std::size_t s = ShardOf(keys[i]);
+
+   parts[s].push_back(keys[i]);
+   indices[s].push_back(i);
+  }
+ }
+
+private:
+
+ /// Shards.
+ boost::shared_ptr<ShardType> shards[Shards];
+
+};
+
+struct LRUExecutor;
+
+/**
+Default configuration of cached functions.
+Derive from it and hide members to configure a function decorated by 
+LRU_CACHED_EX# macros, for example:
+
+struct Scoring : LRUImpl::LRUConfig
+{
+ static const bool SingleFlight = true;
+};
+*/
+struct LRUConfig
+{
+ /// Storage engine selector, BimapStorage or FlatStorage<Eviction>.
+ typedef LRU_DEFAULT_STORAGE Storage;
+
+ /// Number of shards, cache is sharded if it is greater than 1.
+ static const std::size_t Shards = LRU_DEFAULT_SHARDS;
+
+ /// Evaluate concurrent misses of the same arguments only once.
+ static const bool SingleFlight = LRU_DEFAULT_SINGLE_FLIGHT;
+
+ /// Maximum total weight of records (see LRUWeigher), 0 means unbounded.
+ static const std::size_t MaxWeight = LRU_DEFAULT_MAX_WEIGHT;
+
+ /// Time to live of results in milliseconds, 0 means never expires.
+ static const std::size_t TTL = LRU_DEFAULT_TTL;
+
+ /// Results expire after last access rather than after evaluation.
+ static const bool ExpireAfterAccess = LRU_DEFAULT_EXPIRE_AFTER_ACCESS;
+
+ /// Clock of time to live and refreshing, a class with 
+ /// static boost::uint32_t Now() returning milliseconds.
+ typedef TimerWheel<int> Clock;
+
+ /// Results older than this (in milliseconds) are still returned but 
+ /// evaluated again in background, 0 means never refreshes.
+ static const std::size_t RefreshAfter = LRU_DEFAULT_REFRESH_AFTER;
+
+ /// Executor evaluating misses of LRU_CACHED_ASYNC functions, a class with 
+ /// static void Execute(const boost::function<void()>& task).
+ typedef LRUExecutor Executor;
+
+ /// Record latency histograms of lookups and evaluations of misses, 
+ /// see LRUPool GetLatency.
+ static const bool Latency = LRU_DEFAULT_LATENCY;
+
+ /// Sample one of SampleRate keys to estimate hit ratios at other 
+ /// capacities (see LRU::Sample and LRUStats curve), 0 means not sampled.
+ static const std::size_t SampleRate = LRU_DEFAULT_SAMPLE_RATE;
+};
+
+/**
+Latency percentiles of a cached function.
+*/
+struct LRULatencyStats
+{
+ /// Probing cache, including waiting for lock.
+ LatencySummary lookup;
+
+ /// Evaluating function on miss.
+ LatencySummary load;
+};
+
+/**
+Latency histograms of a cached function.
+It should not be used directly.
+*/
+struct _LRULatency
+{
+ /// Probing cache.
+ LatencyHistogram<> lookup;
+
+ /// Evaluating function on miss.
+ LatencyHistogram<> load;
+};
+
+/**
+Configuration of asynchronous cached functions, the in-flight future is 
+cached at once, concurrent misses wait only until it is.
+It should not be used directly.
+*/
+template<typename TConfig>
+struct _LRUAsyncConfig : TConfig
+{
+ static const bool SingleFlight = true;
+
+ /// Futures are not refreshed.
+ static const std::size_t RefreshAfter = 0;
+};
+
+// Helper macro.
+#define _LRU_TRAITS_BARE_TYPEDEF(z, i, unused)                                 \
+ typedef typename boost::remove_const<                                        \
+  typename boost::remove_reference<T##i>::type>::type Bare##i;
+
+/**
+Argument tuple and cache types of a cached function, unused trailing 
+parameters are boost::tuples::null_type.
+
+@param TConfig Configuration, see LRUConfig.
+@param TR Function result type.
+@param T# Function argument types (qualifiers are removed).
+*/
+template<
+ typename TConfig,
+ typename TR, 
+ BOOST_PP_ENUM_PARAMS_WITH_A_DEFAULT(10, typename T, boost::tuples::null_type)
+>
+struct _LRUTraits
+{
+ BOOST_PP_REPEAT(10, _LRU_TRAITS_BARE_TYPEDEF, ~)
+
+ /// Configuration.
+ typedef TConfig Config;
+
+ /// Cache key type.
+ typedef boost::tuple<BOOST_PP_ENUM_PARAMS(10, Bare)> ArgsTuple;
+
+ /// View of arguments to probe the cache without copying them.
+ typedef typename LRUKeyView<ArgsTuple>::type ArgsView;
+
+ /// Cache type, sharded if configured shards is greater than 1.
+ typedef typename boost::mpl::if_c<(Config::Shards > 1),
+  ShardedLRU<ArgsTuple, TR, 
+   (Config::Shards > 1 ? Config::Shards : 1),
+   LRU_DEFAULT_CAPACITY, 
+   LRU_DEFAULT_DEFAULT_LOCK_IMPL,
+   typename Config::Storage
+  >,
+  LRU<ArgsTuple, TR, 
+   LRU_DEFAULT_CAPACITY, 
+   LRU_DEFAULT_DEFAULT_LOCK_IMPL,
+   typename Config::Storage
+  >
+ >::type Cache;
+
+ /// Shared cache pointer kept by the pool.
+ typedef boost::shared_ptr<Cache> CachePtr;
+};
+
+/**
+Function call with copies of arguments, the refresh and asynchronous jobs 
+of cached functions without lambdas (C++03), see _LRUBind.
+It should not be used directly.
+*/
+template<typename R, typename F, typename Args>
+struct _LRUCall
+{
+ _LRUCall(F f, const Args& a) : fn(f), args(a)
+ {
+ }
+
+ inline R operator()() const
+ {
+  return Call(args);
+ }
+
+ /// Function.
+ F fn;
+
+ /// Copies of arguments.
+ const Args args;
+
+private:
+
+ #define _LRUCALL_GET(z, n, a) boost::get<n>(a)
+
+ #define _LRUCALL_CALL(z, n, unused)                                          \
+ template<BOOST_PP_ENUM_PARAMS(n, typename A)>                                \
+ inline R Call(const boost::tuple<BOOST_PP_ENUM_PARAMS(n, A)>& a) const       \
+ {                                                                            \
+  return fn(BOOST_PP_ENUM(n, _LRUCALL_GET, a));                               \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUCALL_CALL(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+};
+
+/**
+Bind function to copies of arguments, see _LRUCall.
+
+@param f Function.
+@param ... Arguments.
+@return Nullary function object.
+*/
+#define _LRU_BIND(z, n, unused)                                               \
+template<typename R, BOOST_PP_ENUM_PARAMS(n, typename T),                     \
+         BOOST_PP_ENUM_PARAMS(n, typename A)>                                 \
+boost::function<R()> _LRUBind(R (*f)(BOOST_PP_ENUM_PARAMS(n, T)),             \
+                              BOOST_PP_ENUM_BINARY_PARAMS(n, const A, &a))    \
+{                                                                             \
+ return _LRUCall<                                                             \
+  R, R (*)(BOOST_PP_ENUM_PARAMS(n, T)),                                       \
+  boost::tuple<BOOST_PP_ENUM_PARAMS(n, A)>                                    \
+ >(f, boost::tuple<BOOST_PP_ENUM_PARAMS(n, A)>(BOOST_PP_ENUM_PARAMS(n, a)));  \
+}
+
+#define BOOST_PP_LOCAL_MACRO(n) _LRU_BIND(~, n, ~)
+#define BOOST_PP_LOCAL_LIMITS   (1, 10)
+#include BOOST_PP_LOCAL_ITERATE()
+
+/**
+Background refresh of a stale function result, see _LRUProbe::Revalidate.
+It should not be used directly.
+*/
+template<typename Cache, typename F>
+struct _LRURefresh
+{
+ typedef typename Cache::KeyType KeyType;
+ typedef typename Cache::ValueType ValueType;
+
+ _LRURefresh(Cache* c, const KeyType& k, const F& f) : cache(c), key(k), fn(f)
+ {
+ }
+
+ void operator()()
+ {
+  try
+  {
+   const boost::uint32_t start = TimerWheel<KeyType>::Now();
+   const ValueType v = fn();
+
+   cache->Refresh(key, &v, TimerWheel<KeyType>::Now() - start);
+  }
+  catch(...)
+  {
+   // Keep stale result, refresh again later.
+   cache->Refresh(key, NULL);
+  }
+ }
+
+ /// Cache owned by the pool.
+ Cache* cache;
+
+ /// Function arguments.
+ const KeyType key;
+
+ /// Nullary function to evaluate result.
+ F fn;
+};
+
+/**
+Asynchronous evaluation of a function result, see _LRUProbe::Launch.
+A failed result is removed from cache, so the next call evaluates it again.
+It should not be used directly.
+*/
+template<typename Cache, typename R, typename F>
+struct _LRUAsync
+{
+ typedef typename Cache::KeyType KeyType;
+
+ _LRUAsync(Cache* c, const KeyType& k, 
+           const boost::shared_ptr<boost::promise<R> >& p, const F& f) : 
+  cache(c), key(k), promise(p), fn(f)
+ {
+ }
+
+ void operator()()
+ {
+  try
+  {
+   promise->set_value(fn());
+  }
+  catch(...)
+  {
+   if(cache)
+    cache->Erase(key);
+
+   promise->set_exception(boost::current_exception());
+  }
+ }
+
+ /// Cache owned by the pool, NULL if caching is disabled.
+ Cache* cache;
+
+ /// Function arguments.
+ const KeyType key;
+
+ /// Result to set.
+ boost::shared_ptr<boost::promise<R> > promise;
+
+ /// Nullary function to evaluate result.
+ F fn;
+};
+
+/**
+Result of probing a function cache, two-phase form of LRU::GetOrCompute for 
+decorated functions: the arguments are probed once by a view of them (see 
+LRUKeyView), the argument tuple is built from the view only if missed, to 
+put the result, see LRU::Acquire.
+A stale result (see LRUConfig::RefreshAfter) is found and refreshed too, 
+by Revalidate in background, or by Put if it is evaluated in place.
+Without cache (caching is disabled), nothing is found or put.
+It should not be used directly.
+*/
+template<typename Traits>
+class _LRUProbe
+{
+public:
+
+ typedef typename Traits::Cache Cache;
+ typedef typename Traits::ArgsTuple ArgsTuple;
+ typedef typename Traits::ArgsView ArgsView;
+ typedef typename Cache::ValueType ValueType;
+ typedef typename Cache::PositionType PositionType;
+
+public:
+
+ /**
+ Constructor, probe the cache.
+
+ @param c Cache object, NULL if caching is disabled.
+ @param l Latency histograms, NULL if latency is not recorded.
+ @param ... Function arguments.
+ */
+ #define _LRUPROBE_CTOR(z, n, unused)                                         \
+ template<BOOST_PP_ENUM_PARAMS(n, typename T)>                                \
+ _LRUProbe(Cache* c, _LRULatency* l, BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t)) : \
+  cache(c), key(BOOST_PP_ENUM_PARAMS(n, t)), found(false), stale(false),     \
+  latency(l), stamp(l ? LatencyHistogram<>::Now() : 0),                       \
+  value(c ? c->Acquire(key, found, &position, &stale) : ValueType()),         \
+  start(found && !stale ? 0 : TimerWheel<ArgsTuple>::Now())                   \
+ {                                                                            \
+  if(latency)                                                                 \
+  {                                                                           \
+   const boost::uint64_t now = LatencyHistogram<>::Now();                     \
+                                                                              \
+   latency->lookup.Record(now - stamp);                                       \
+   stamp = now;                                                               \
+  }                                                                           \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPROBE_CTOR(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Cached value found or not?
+
+ @return True if found.
+ */
+ inline bool Found() const
+ {
+  return found;
+ }
+
+ /**
+ Cached value is stale and should be refreshed by this caller?
+
+ @return True if stale.
+ */
+ inline bool Stale() const
+ {
+  return stale;
+ }
+
+ /**
+ Cached value, default value if not found.
+
+ @return Value.
+ */
+ inline const ValueType& Value() const
+ {
+  return value;
+ }
+
+ /**
+ Put function result into cache, stale value is replaced.
+
+ @param r Function result.
+ @return Function result.
+ */
+ inline const ValueType& Put(const ValueType& r)
+ {
+  const std::size_t cost = TimerWheel<ArgsTuple>::Now() - start;
+
+  if(latency)
+   latency->load.Record(LatencyHistogram<>::Now() - stamp);
+
+  if(!cache)
+   return r;
+
+  if(stale)
+   cache->Refresh(key, &r, cost);
+  else
+   cache->Complete(key, r, &position, cost);
+
+  return r;
+ }
+
+ /**
+ Function failed, must be called in catch block.
+ */
+ inline void Fail()
+ {
+  if(!cache)
+   return;
+
+  if(stale)
+   cache->Refresh(key, NULL);
+  else
+   cache->Abort(key, boost::current_exception());
+ }
+
+ /**
+ Refresh stale value in background, it is refreshed later if workers are 
+ busy.
+
+ @param workers Worker pool.
+ @param f Nullary function object to evaluate result, it is copied.
+ */
+ template<typename F>
+ void Revalidate(WorkerPool& workers, const F& f)
+ {
+  if(!workers.Submit(_LRURefresh<Cache, F>(cache, key, f)))
+   cache->Refresh(key, NULL);
+ }
+
+ /**
+ Evaluate function result by executor, value type is future of result. 
+ The in-flight future is put into cache at once and shared by callers.
+
+ @param f Nullary function object to evaluate result, it is copied.
+ @return Future of result.
+ */
+ template<typename Executor, typename R, typename F>
+ ValueType Launch(const F& f)
+ {
+  const boost::shared_ptr<boost::promise<R> > p(new boost::promise<R>());
+  const ValueType r(p->get_future());
+  const ArgsTuple k(key);
+
+  if(cache)
+   cache->Complete(k, r, &position);
+
+  Executor::Execute(_LRUAsync<Cache, R, F>(cache, k, p, f));
+
+  return r;
+ }
+
+ /**
+ Put function result evaluated in place, value type is future of result.
+
+ @param v Function result.
+ @return Ready future of result.
+ */
+ template<typename R>
+ ValueType Ready(const R& v)
+ {
+  boost::promise<R> p;
+  p.set_value(v);
+
+  return Put(ValueType(p.get_future()));
+ }
+
+ /**
+ Function evaluated in place failed, must be called in catch block, value 
+ type is future of result. The failure is not cached.
+
+ @return Future of result holding current exception.
+ */
+ template<typename R>
+ ValueType Failed()
+ {
+  Fail();
+
+  boost::promise<R> p;
+  p.set_exception(boost::current_exception());
+
+  return ValueType(p.get_future());
+ }
+
+private:
+
+ /// Probed cache, NULL if caching is disabled.
+ Cache* cache;
+
+ /// View of function arguments, they outlive the probe.
+ const ArgsView key;
+
+ /// Probe position.
+ PositionType position;
+
+ /// Cache found or not.
+ bool found;
+
+ /// Cached value is stale.
+ bool stale;
+
+ /// Latency histograms, NULL if latency is not recorded.
+ _LRULatency* const latency;
+
+ /// Time probed, then time probe returned, in nanoseconds.
+ boost::uint64_t stamp;
+
+ /// Cached value or function result.
+ ValueType value;
+
+ /// Time probed, to measure evaluation cost.
+ const boost::uint32_t start;
+
+};
+
+/**
+Handle of a function cache registered in the pool.
+
+A cached function resolves its handle once and keeps it in a function-local 
+static, so every call goes straight to its own cache without touching the 
+pool table, the pool lock or the shared pointer reference count.
+The cache object is owned by the pool, handle only keeps a raw pointer.
+Handle has no constructor, a static one is zero-initialized before any call
+and filled by the pool, see _LRUPool::Resolve.
+It should not be used directly.
+*/
+class _LRUHandle
+{
+ friend class _LRUPool;
+
+public:
+
+ /**
+ Probe cache by function arguments, nothing is found or put while caching 
+ is disabled, see _LRUPool::Configure.
+ 
+ @param ... Function arguments.
+ @return Probe result, its key is reused to put the result if missed.
+ */
+ #define _LRUHANDLE_PROBE(z, n, unused)                                       \
+ template<typename TC, typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>      \
+ _LRUProbe<_LRUTraits<TC, TR, BOOST_PP_ENUM_PARAMS(n, T)> >                   \
+ Probe(BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t)) const                           \
+ {                                                                            \
+  typedef _LRUTraits<TC, TR, BOOST_PP_ENUM_PARAMS(n, T)> Traits;              \
+                                                                              \
+  return _LRUProbe<Traits>(                                                   \
+   *capacity ? static_cast<typename Traits::Cache*>(cache) : NULL,            \
+   latency, BOOST_PP_ENUM_PARAMS(n, t));                                      \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUHANDLE_PROBE(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+private:
+
+ /// Cache object owned by the pool, type is erased and restored by 
+ /// argument types.
+ void* cache;
+
+ /// Latency histograms owned by the pool.
+ _LRULatency* latency;
+
+ /// Capacity of pool, 0 disables caching.
+ const std::size_t* capacity;
+
+};
+
+/**
+Internal LRUPool to cache all LRU cache objects by function unique key.
+This is a helper to provide central control mechanism of all function caches.
+It should not be used directly.
+*/
+class _LRUPool : public LRU_DEFAULT_LOCK_IMPL<_LRUPool>
+{
+public:
+
+ /// Registered cache.
+ struct Entry
+ {
+  Entry() : capacity(0), ghostHits(0)
+  {
+  }
+
+  /// Cache pointer, type is erased.
+  boost::any cache;
+
+  /// Function name, empty if not registered by a decorated function.
+  std::string name;
+
+  /// Stable key in snapshots, empty if cache has no name, see SnapshotKey.
+  std::string key;
+
+  /// Obtain statistics of cache.
+  boost::function<LRUStats()> stats;
+
+  /// Latency histograms, NULL if latency is not recorded.
+  boost::shared_ptr<_LRULatency> latency;
+
+  /// Resize cache and its ghosts, return capacity resized to.
+  boost::function<std::size_t(std::size_t, std::size_t)> resize;
+
+  /// Purge a step of records over capacity, return true if more remain.
+  boost::function<bool()> trim;
+
+  /// Write records to snapshot, see SaveRecords.
+  boost::function<std::size_t(std::ostream&)> save;
+
+  /// Put records of snapshot, see LoadRecords.
+  boost::function<std::size_t(const char*, const char*)> load;
+
+  /// Capacity given by pool.
+  std::size_t capacity;
+
+  /// Ghost hits seen by last rebalance.
+  boost::uint64_t ghostHits;
+ };
+
+ /// Pool storage, key: function unique id, value: LRU object.
+ typedef boost::unordered_map<int, Entry> PoolTable;
+
+public:
+
+ /**
+ Constructor.
+
+ @param c Capacity for all caches.
+ */
+ _LRUPool(const std::size_t c = LRU_DEFAULT_CAPACITY) : capacity(c), 
+  budget(LRU_DEFAULT_BUDGET), 
+  interval(LRU_DEFAULT_BUDGET ? LRU_DEFAULT_REBALANCE_INTERVAL : 0), 
+  next(0), balancing(false), 
+  workers(LRU_DEFAULT_REFRESH_THREADS, LRU_DEFAULT_REFRESH_QUEUE),
+  asyncWorkers(LRU_DEFAULT_ASYNC_THREADS, LRU_DEFAULT_ASYNC_QUEUE)
+ {
+ }
+
+ /**
+ Register cache of a function and obtain its handle, cache is created 
+ with current capacity and given configuration if it does not exist.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param name Function name.
+ @param ... Function arguments, only their types are used.
+ @return Cache handle. 
+ */
+ #define _LRUPOOL_REGISTER(z, n, unused)                                      \
+ template<typename TC, typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>      \
+ _LRUHandle Register(int funcUnique, const char* name,                        \
+                     BOOST_PP_ENUM_BINARY_PARAMS(n, T, & BOOST_PP_INTERCEPT)) \
+ {                                                                            \
+  return HandleOf<_LRUTraits<TC, TR, BOOST_PP_ENUM_PARAMS(n, T)> >(           \
+   funcUnique, name);                                                         \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_REGISTER(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Register cache of a function into its handle once, see Register. Handle 
+ and flag are function-local statics initialized statically, so first 
+ calls racing are safe where function-local statics are not initialized 
+ thread-safely (before C++11 and VS2015): one registers, others wait.
+ 
+ @param h Handle of function.
+ @param once Flag of handle.
+ @param funcUnique Function unique key generated by compiler.
+ @param name Function name.
+ @param ... Function arguments, only their types are used.
+ */
+ #define _LRUPOOL_RESOLVE(z, n, unused)                                       \
+ template<typename TC, typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>      \
+ inline void Resolve(_LRUHandle& h, boost::once_flag& once, int funcUnique,   \
+                     const char* name,                                        \
+                     BOOST_PP_ENUM_BINARY_PARAMS(n, T, & BOOST_PP_INTERCEPT)) \
+ {                                                                            \
+  boost::call_once(once,                                                      \
+   Registrar<_LRUTraits<TC, TR, BOOST_PP_ENUM_PARAMS(n, T)> >(                \
+    this, &h, funcUnique, name));                                             \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_RESOLVE(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Get cache value by function unique key and its arguments.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param found Output reference to indicate cache found or not.
+ @param ... Function arguments.
+ @return Cached result or default value. 
+ */
+ #define _LRUPOOL_GET(z, n, unused)                                           \
+ template<typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>                   \
+ TR Get(int funcUnique, bool& found, BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t))   \
+ {                                                                            \
+  typedef _LRUTraits<LRUConfig, TR, BOOST_PP_ENUM_PARAMS(n, T)> Traits;       \
+                                                                              \
+  found = false;                                                              \
+                                                                              \
+  if(capacity == 0) /* Disabled */                                            \
+   return TR();                                                               \
+                                                                              \
+  return Find<Traits>(funcUnique)->Get(                                       \
+   typename Traits::ArgsView(BOOST_PP_ENUM_PARAMS(n, t)), NULL, &found);      \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_GET(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Put function result into cache by function unique key and its arguments.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param r Function result.
+ @param ... Function arguments.
+ */
+ #define _LRUPOOL_PUT(z, n, unused)                                           \
+ template<typename TR, BOOST_PP_ENUM_PARAMS(n, typename T)>                   \
+ void Put(int funcUnique, TR& r, BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t))       \
+ {                                                                            \
+  typedef _LRUTraits<LRUConfig, TR, BOOST_PP_ENUM_PARAMS(n, T)> Traits;       \
+                                                                              \
+  if(capacity == 0) /* Disabled */                                            \
+   return;                                                                    \
+                                                                              \
+  Find<Traits>(funcUnique)->Put(                                              \
+   typename Traits::ArgsTuple(BOOST_PP_ENUM_PARAMS(n, t)), r);                \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_PUT(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Get cache values by function unique key and a batch of argument tuples, 
+ see LRU::GetMany.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param keys Argument tuples.
+ @param values Output cached results or default values.
+ @param found Output indicators to indicate cache found or not, could be 
+  NULL.
+ @return Number of results found.
+ */
+ template<typename TR, BOOST_PP_ENUM_PARAMS(10, typename T)>
+ std::size_t GetMany(
+  int funcUnique, 
+  const std::vector<boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)> >& keys, 
+  std::vector<TR>& values, std::vector<bool>* found = NULL)
+ {
+  typedef _LRUTraits<LRUConfig, TR, BOOST_PP_ENUM_PARAMS(10, T)> Traits;
+
+  if(capacity == 0) /* Disabled */
+  {
+   values.assign(keys.size(), TR());
+
+   if(found)
+    found->assign(keys.size(), false);
+
+   return 0;
+  }
+
+  return Find<Traits>(funcUnique)->GetMany(keys, values, found);
+ }
+
+ /**
+ Put function results into cache by function unique key and a batch of 
+ argument tuples.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param keys Argument tuples.
+ @param values Function results.
+ */
+ template<typename TR, BOOST_PP_ENUM_PARAMS(10, typename T)>
+ void PutMany(
+  int funcUnique, 
+  const std::vector<boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)> >& keys, 
+  const std::vector<TR>& values)
+ {
+  typedef _LRUTraits<LRUConfig, TR, BOOST_PP_ENUM_PARAMS(10, T)> Traits;
+
+  if(capacity == 0) /* Disabled */
+   return;
+
+  Find<Traits>(funcUnique)->PutMany(keys, values);
+ }
+
+ /**
+ Get cache value by function unique key and its arguments, or evaluate 
+ function and put its result if missed, see LRU::GetOrCompute.
+ 
+ @param funcUnique Function unique key generated by compiler.
+ @param f Nullary function object to evaluate result.
+ @param found Output reference to indicate cache found or not.
+ @param ... Function arguments.
+ @return Cached or evaluated result. 
+ */
+ #define _LRUPOOL_GET_OR_COMPUTE(z, n, unused)                                \
+ template<typename TR, typename F, BOOST_PP_ENUM_PARAMS(n, typename T)>       \
+ TR GetOrCompute(int funcUnique, F f, bool& found,                            \
+                 BOOST_PP_ENUM_BINARY_PARAMS(n, T, &t))                       \
+ {                                                                            \
+  typedef _LRUTraits<LRUConfig, TR, BOOST_PP_ENUM_PARAMS(n, T)> Traits;       \
+                                                                              \
+  found = false;                                                              \
+                                                                              \
+  if(capacity == 0) /* Disabled */                                            \
+   return f();                                                                \
+                                                                              \
+  return Find<Traits>(funcUnique)->GetOrCompute(                              \
+   typename Traits::ArgsTuple(BOOST_PP_ENUM_PARAMS(n, t)), f, &found);        \
+ }
+
+ #define BOOST_PP_LOCAL_MACRO(n) _LRUPOOL_GET_OR_COMPUTE(~, n, ~)
+ #define BOOST_PP_LOCAL_LIMITS   (1, 10)
+ #include BOOST_PP_LOCAL_ITERATE()
+
+ /**
+ Configure capacity or other parameters for caches.
+ Capacity affects caches created afterward, but 0 disables caching of all 
+ functions at once, results are evaluated and not put until it is 
+ configured again.
+
+ @param size Capacity for all caches.
+ */
+ void Configure(const std::size_t size)
+ {
+  capacity = size;
+ }
+
+ /**
+ Share a total capacity (budget) among caches, caches are rebalanced by 
+ marginal hits: a round moves capacity from caches with fewest ghost hits 
+ per ghost (flat hit curve) to caches with most (thrashing), see 
+ LRU::Ghosts. Caches start with even shares, a cache registered later 
+ takes its share from others by next round. Like capacities, budget counts 
+ records, not bytes, weights of records (see MaxWeight) are not shared.
+
+ Rounds run on refresh workers every interval while cached functions 
+ miss, or when Rebalance is called.
+
+ @param size Total number of records. 0 is no budget rather than an empty 
+  one: it stops sharing and resizes caches back to capacity of Configure, 
+  Configure(0) disables caching.
+ @param ms Milliseconds between rounds, 0 means only Rebalance runs them.
+ */
+ void Budget(const std::size_t size, 
+             const std::size_t ms = LRU_DEFAULT_REBALANCE_INTERVAL)
+ {
+  std::vector<Entry> entries;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   budget = size;
+   interval.store(size ? (boost::uint32_t)ms : 0);
+
+   for(PoolTable::iterator i = pool.begin(); i != pool.end(); ++i)
+   {
+    i->second.capacity = size ? size / pool.size() : capacity;
+    entries.push_back(i->second);
+   }
+  }
+
+  if(size)
+  {
+   Rebalance();
+   return;
+  }
+
+  // Caches are resized one by one without the pool lock.
+  for(std::size_t i = 0; i < entries.size(); i++)
+  {
+   entries[i].resize(entries[i].capacity, 0);
+   Trim(entries[i]);
+  }
+ }
+
+ /**
+ Resize caches of a function, see LRU::Resize. Records over capacity of 
+ shrunk caches are purged by refresh workers a step at a time, lookups 
+ meanwhile are not stalled. A cache sharing a budget is rebalanced again 
+ by next round.
+
+ @param name Function name.
+ @param size Capacity, 0 disables caches.
+ @return Number of caches resized.
+ */
+ std::size_t Resize(const std::string& name, const std::size_t size)
+ {
+  std::vector<Entry> entries;
+  std::size_t ghosts;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   ghosts = budget && !pool.empty() ? GhostsOf(budget / pool.size()) : 0;
+
+   for(PoolTable::iterator i = pool.begin(); i != pool.end(); ++i)
+   {
+    if(i->second.name != name)
+     continue;
+
+    i->second.capacity = size;
+    entries.push_back(i->second);
+   }
+  }
+
+  // Caches are resized one by one without the pool lock.
+  for(std::size_t i = 0; i < entries.size(); i++)
+  {
+   entries[i].resize(size, ghosts);
+   Trim(entries[i]);
+  }
+
+  return entries.size();
+ }
+
+ /**
+ Save records of named caches to a snapshot file (see SnapshotFile), to 
+ warm caches up by Load after restart. File is written aside and renamed, 
+ so a crash does not leave a partial snapshot.
+
+ @param path File path.
+ @return Number of caches saved, 0 if file could not be written.
+ */
+ std::size_t Save(const std::string& path) const
+ {
+  std::vector<Entry> entries;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   for(PoolTable::const_iterator i = pool.begin(); i != pool.end(); ++i)
+    if(!i->second.key.empty())
+     entries.push_back(i->second);
+  }
+
+  const std::string temp = path + ".tmp";
+
+  {
+   std::ofstream os(temp.c_str(), std::ios::binary | std::ios::trunc);
+
+   SnapshotFile::WriteHeader(os);
+
+   // Caches are locked one by one without the pool lock.
+   for(std::size_t i = 0; i < entries.size(); i++)
+    SnapshotFile::WriteSection(os, entries[i].key, entries[i].save);
+
+   os.flush();
+
+   if(!os)
+   {
+    os.close();
+    std::remove(temp.c_str());
+
+    return 0;
+   }
+  }
+
+#ifdef BOOST_WINDOWS
+  // Rename does not replace an existing file.
+  std::remove(path.c_str());
+#endif
+
+  if(std::rename(temp.c_str(), path.c_str()))
+  {
+   std::remove(temp.c_str());
+   return 0;
+  }
+
+  return entries.size();
+ }
+
+ /**
+ Load records of a snapshot file saved by Save, records already cached are 
+ kept. Caches are matched by function name and types of arguments and 
+ result, not by function unique key, so a snapshot survives rebuilding. 
+ Caches registered afterward are loaded when they are created, so it is 
+ called at startup before cached functions are.
+
+ @param path File path.
+ @return Number of caches loaded now, 0 if file is missing or malformed.
+ */
+ std::size_t Load(const std::string& path)
+ {
+  boost::shared_ptr<SnapshotFile> file(new SnapshotFile(path));
+
+  std::vector<Entry> entries;
+  std::vector<std::pair<const char*, const char*> > sections;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   for(PoolTable::iterator i = pool.begin(); i != pool.end(); ++i)
+   {
+    std::pair<const char*, const char*> s;
+
+    if(!i->second.key.empty() && file->Take(i->second.key, s.first, s.second))
+    {
+     entries.push_back(i->second);
+     sections.push_back(s);
+    }
+   }
+
+   // The rest waits for caches registered afterward.
+   snapshot.reset();
+   if(file->Size())
+    snapshot = file;
+  }
+
+  // Caches are loaded one by one without the pool lock, file stays mapped.
+  for(std::size_t i = 0; i < entries.size(); i++)
+   entries[i].load(sections[i].first, sections[i].second);
+
+  return entries.size();
+ }
+
+ /**
+ Run a round of rebalancing, see Budget.
+ */
+ void Rebalance()
+ {
+  // One round at a time.
+  if(balancing.exchange(true))
+   return;
+
+  const Round round(balancing);
+
+  std::vector<int> ids;
+  std::vector<Entry> entries;
+  std::size_t total;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   total = budget;
+
+   for(PoolTable::const_iterator i = pool.begin(); i != pool.end(); ++i)
+   {
+    ids.push_back(i->first);
+    entries.push_back(i->second);
+   }
+  }
+
+  if(total && !entries.empty())
+  {
+   const std::size_t n = entries.size();
+   const std::size_t share = total / n;
+   const std::size_t ghosts = GhostsOf(share);
+
+   // Ghost hits per ghost since last round, ordered.
+   std::vector<std::pair<double, std::size_t> > gains(n);
+
+   for(std::size_t i = 0; i < n; i++)
+   {
+    const boost::uint64_t hits = entries[i].stats().ghostHits;
+
+    gains[i].first = (double)(hits - entries[i].ghostHits) / ghosts;
+    gains[i].second = i;
+    entries[i].ghostHits = hits;
+   }
+
+   std::sort(gains.begin(), gains.end());
+
+   // Pair caches of least gains with ones of most gains.
+   const std::size_t step = (std::max)(share / StepShare, (std::size_t)1);
+   const std::size_t least = share / FloorShare;
+
+   for(std::size_t lo = 0, hi = n - 1; 
+       lo < hi && gains[lo].first < gains[hi].first; lo++, hi--)
+   {
+    std::size_t& from = entries[gains[lo].second].capacity;
+    std::size_t& to = entries[gains[hi].second].capacity;
+    const std::size_t d = from > least ? (std::min)(from - least, step) : 0;
+
+    from -= d;
+    to += d;
+   }
+
+   // Fit budget, caches registered since last round have taken shares.
+   std::size_t sum = 0;
+   for(std::size_t i = 0; i < n; i++)
+    sum += entries[i].capacity;
+
+   for(std::size_t i = 0; i < n && sum; i++)
+   {
+    std::size_t& c = entries[i].capacity;
+
+    c = (std::size_t)((double)c * total / sum);
+    c = entries[i].resize((std::max)(c, (std::size_t)1), ghosts);
+
+    Trim(entries[i]);
+   }
+
+   OBJECT_LEVEL_LOCK;
+
+   for(std::size_t i = 0; i < n; i++)
+   {
+    PoolTable::iterator e = pool.find(ids[i]);
+    if(e == pool.end())
+     continue;
+
+    e->second.capacity = entries[i].capacity;
+    e->second.ghostHits = entries[i].ghostHits;
+   }
+  }
+ }
+
+ /**
+ Cached function missed, run a round of rebalancing on refresh workers if 
+ interval has passed.
+ */
+ void Tick()
+ {
+  const boost::uint32_t ms = interval.load(boost::memory_order_relaxed);
+  if(!ms)
+   return;
+
+  const boost::uint32_t now = TimerWheel<int>::Now();
+  boost::uint32_t due = next.load(boost::memory_order_relaxed);
+
+  if(TimerWheel<int>::Before(now, due) || 
+     !next.compare_exchange_strong(due, now + ms))
+   return;
+
+  workers.Submit(RebalanceTask(this));
+ }
+
+ /**
+ Workers refreshing stale results in background.
+
+ @return Worker pool.
+ */
+ inline WorkerPool& Workers()
+ {
+  return workers;
+ }
+
+ /**
+ Workers of asynchronous cached functions, see LRUExecutor.
+
+ @return Worker pool.
+ */
+ inline WorkerPool& AsyncWorkers()
+ {
+  return asyncWorkers;
+ }
+
+ /**
+ Obtain function names and statistics of all caches.
+
+ @param dst Result container iterator of std::pair<std::string, LRUStats>.
+ */
+ template<typename IT>
+ void GetStats(IT& dst) const
+ {
+  std::vector<Entry> entries;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   for(PoolTable::const_iterator i = pool.begin(); i != pool.end(); ++i)
+    entries.push_back(i->second);
+  }
+
+  // Caches are locked one by one without the pool lock.
+  for(std::size_t i = 0; i < entries.size(); i++)
+   *dst++ = std::make_pair(entries[i].name, entries[i].stats());
+ }
+
+ /**
+ Obtain function names and latency percentiles of caches recording latency.
+
+ @param dst Result container iterator of 
+            std::pair<std::string, LRULatencyStats>.
+ */
+ template<typename IT>
+ void GetLatency(IT& dst) const
+ {
+  std::vector<Entry> entries;
+
+  {
+   OBJECT_LEVEL_LOCK;
+
+   for(PoolTable::const_iterator i = pool.begin(); i != pool.end(); ++i)
+    if(i->second.latency)
+     entries.push_back(i->second);
+  }
+
+  // Histograms are merged without the pool lock.
+  for(std::size_t i = 0; i < entries.size(); i++)
+  {
+   LRULatencyStats s;
+   s.lookup = entries[i].latency->lookup.Summarize();
+   s.load = entries[i].latency->load.Summarize();
+
+   *dst++ = std::make_pair(entries[i].name, s);
+  }
+ }
+
+private:
+
+ /// Register cache of a function into its handle, see Resolve.
+ template<typename Traits>
+ struct Registrar
+ {
+  Registrar(_LRUPool* p, _LRUHandle* h, int f, const char* n) : 
+   pool(p), handle(h), funcUnique(f), name(n)
+  {
+  }
+
+  inline void operator()() const
+  {
+   *handle = pool->HandleOf<Traits>(funcUnique, name);
+  }
+
+  _LRUPool* pool;
+  _LRUHandle* handle;
+  int funcUnique;
+  const char* name;
+ };
+
+ /// Statistics of a cache.
+ template<typename Cache>
+ struct StatsOf
+ {
+  explicit StatsOf(const Cache* c) : cache(c)
+  {
+  }
+
+  inline LRUStats operator()() const
+  {
+   return cache->Stats();
+  }
+
+  const Cache* cache;
+ };
+
+ /// Resize cache and its ghosts.
+ template<typename Cache>
+ struct ResizeOf
+ {
+  explicit ResizeOf(Cache* c) : cache(c)
+  {
+  }
+
+  inline std::size_t operator()(const std::size_t size, 
+                                const std::size_t ghosts) const
+  {
+   cache->Resize(size);
+   cache->Ghosts(ghosts);
+
+   return cache->Capacity();
+  }
+
+  Cache* cache;
+ };
+
+ /// Purge a step of records over capacity of cache.
+ template<typename Cache>
+ struct TrimOf
+ {
+  explicit TrimOf(Cache* c) : cache(c)
+  {
+  }
+
+  inline bool operator()() const
+  {
+   return cache->Trim();
+  }
+
+  Cache* cache;
+ };
+
+ /// Write records of cache to snapshot.
+ template<typename Cache>
+ struct SaveOf
+ {
+  explicit SaveOf(Cache* c) : cache(c)
+  {
+  }
+
+  inline std::size_t operator()(std::ostream& os) const
+  {
+   return SaveRecords(*cache, os);
+  }
+
+  Cache* cache;
+ };
+
+ /// Put records of snapshot into cache.
+ template<typename Cache>
+ struct LoadOf
+ {
+  explicit LoadOf(Cache* c) : cache(c)
+  {
+  }
+
+  inline std::size_t operator()(const char* p, const char* end) const
+  {
+   return LoadRecords(*cache, p, end);
+  }
+
+  Cache* cache;
+ };
+
+ /// Purging of a shrunk cache run by workers, a step at a time.
+ struct TrimTask
+ {
+  explicit TrimTask(const boost::function<bool()>& t) : trim(t)
+  {
+  }
+
+  inline void operator()() const
+  {
+   while(trim());
+  }
+
+  boost::function<bool()> trim;
+ };
+
+ /// Round of rebalancing run by workers.
+ struct RebalanceTask
+ {
+  explicit RebalanceTask(_LRUPool* p) : pool(p)
+  {
+  }
+
+  inline void operator()() const
+  {
+   pool->Rebalance();
+  }
+
+  _LRUPool* pool;
+ };
+
+ /// Round of rebalancing in progress, it ends even if resizing throws.
+ struct Round : private boost::noncopyable
+ {
+  explicit Round(boost::atomic<bool>& b) : balancing(b)
+  {
+  }
+
+  ~Round()
+  {
+   balancing.store(false);
+  }
+
+  boost::atomic<bool>& balancing;
+ };
+
+ /// Ghosts of a cache are 1/GhostShare of an even share of budget.
+ static const std::size_t GhostShare = 4;
+
+ /// A round moves 1/StepShare of an even share of budget.
+ static const std::size_t StepShare = 8;
+
+ /// A cache keeps at least 1/FloorShare of an even share of budget.
+ static const std::size_t FloorShare = 8;
+
+ /**
+ Number of ghosts of a cache.
+
+ @param share Even share of budget.
+ @return Number of ghosts.
+ */
+ static inline std::size_t GhostsOf(const std::size_t share)
+ {
+  return (std::max)(share / GhostShare, (std::size_t)1);
+ }
+
+ /**
+ Purge records over capacity of a resized cache on refresh workers, or 
+ here if their queue is full.
+
+ @param e Cache entry.
+ */
+ void Trim(const Entry& e)
+ {
+  if(e.trim() && !workers.Submit(TrimTask(e.trim)))
+   TrimTask(e.trim)();
+ }
+
+ /**
+ Find cache by function unique key, create it if it does not exist.
+
+ @param funcUnique Function unique key.
+ @param name Function name.
+ @return Cache pointer.
+ */
+ template<typename Traits>
+ typename Traits::CachePtr Find(int funcUnique, const char* name = "")
+ {
+  typedef typename Traits::Cache Cache;
+  typedef typename Traits::CachePtr CachePtr;
+
+  OBJECT_LEVEL_LOCK;
+
+  PoolTable::iterator i = pool.find(funcUnique);
+  if(i != pool.end())
+   return boost::any_cast<CachePtr>(i->second.cache);
+
+  CachePtr cache(new Cache(capacity));
+  cache->SingleFlight(Traits::Config::SingleFlight);
+  cache->MaxWeight(Traits::Config::MaxWeight);
+  cache->Expire(Traits::Config::TTL, Traits::Config::ExpireAfterAccess);
+  cache->Clock(&Traits::Config::Clock::Now);
+  cache->RefreshAfter(Traits::Config::RefreshAfter);
+  cache->Sample(Traits::Config::SampleRate);
+
+  Entry& e = pool[funcUnique];
+  e.cache = cache;
+  e.name = name;
+  e.stats = StatsOf<Cache>(cache.get());
+  e.resize = ResizeOf<Cache>(cache.get());
+  e.trim = TrimOf<Cache>(cache.get());
+  e.save = SaveOf<Cache>(cache.get());
+  e.load = LoadOf<Cache>(cache.get());
+
+  if(*name)
+   e.key = SnapshotKey<Cache>(name);
+  e.capacity = capacity;
+
+  // Nobody holds lock of new cache, it is resized under the pool lock.
+  if(budget)
+  {
+   e.capacity = budget / pool.size();
+   e.capacity = e.resize(e.capacity, GhostsOf(e.capacity));
+  }
+
+  if(Traits::Config::Latency)
+   e.latency.reset(new _LRULatency());
+
+  // Warm up from snapshot, nobody holds lock of new cache.
+  const char* begin;
+  const char* end;
+
+  if(snapshot && !e.key.empty() && snapshot->Take(e.key, begin, end))
+  {
+   e.load(begin, end);
+
+   if(!snapshot->Size())
+    snapshot.reset();
+  }
+
+  return cache;
+ }
+
+ /**
+ Handle of cache of a function, create cache if it does not exist.
+
+ @param funcUnique Function unique key.
+ @param name Function name.
+ @return Cache handle.
+ */
+ template<typename Traits>
+ _LRUHandle HandleOf(int funcUnique, const char* name)
+ {
+  _LRUHandle h;
+  h.cache = Find<Traits>(funcUnique, name).get();
+
+  OBJECT_LEVEL_LOCK;
+
+  h.latency = pool[funcUnique].latency.get();
+  h.capacity = &capacity;
+
+  return h;
+ }
+
+private:
+
+ /// Pool storate instance.
+ PoolTable pool;
+
+ /// Capacity for all caches.
+ std::size_t capacity;
+
+ /// Total capacity shared by caches, 0 means not shared.
+ std::size_t budget;
+
+ /// Snapshot loaded for caches not registered yet, see Load.
+ boost::shared_ptr<SnapshotFile> snapshot;
+
+ /// Milliseconds between rounds of rebalancing, 0 means not run by Tick.
+ boost::atomic<boost::uint32_t> interval;
+
+ /// Time of next round.
+ boost::atomic<boost::uint32_t> next;
+
+ /// A round is running.
+ boost::atomic<bool> balancing;
+
+ /// Refresh workers, stopped before caches are destroyed.
+ WorkerPool workers;
+
+ /// Workers of asynchronous cached functions.
+ WorkerPool asyncWorkers;
+
+};
+
+/// LRUPool public typedef, singleton.
+typedef boost::details::pool::singleton_default<_LRUPool> LRUPool;
+
+/**
+Default executor of asynchronous cached functions, tasks run on workers of 
+the pool (LRU_DEFAULT_ASYNC_THREADS threads), or in place if 
+LRU_DEFAULT_ASYNC_QUEUE tasks are pending already.
+*/
+struct LRUExecutor
+{
+ static void Execute(const boost::function<void()>& task)
+ {
+  if(!LRUPool::instance().AsyncWorkers().Submit(task))
+   task();
+ }
+};
+
+}
+
+#ifdef LRU_DISABLED
+#define _LRU_CACHED_IMPL(TConfig, TRet, TFunc, ... )
+#define _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, ... )
+#define _LRU_JOB(TRet, TFunc, TParams, ... )
+#define _LRU_NO_JOB(TRet, TFunc, TParams)
+#else
+
+// Function Unique can be produced by these and its combination:
+//
+// http://boost.2283326.n4.nabble.com/
+// Preprocessor-library-inrement-a-macro-td2560393.html
+// http://alexander-stoyan.blogspot.tw/2012/07/
+// getting-pseudo-random-numbers-at.html
+// 
+// But we keep it as simple as possible.
+//
+// The cache handle is resolved once per function and kept in a function-local
+// static, so calls do not go through the pool table. The handle and its flag 
+// are initialized statically and filled by call_once, function-local statics 
+// initialized dynamically are not thread-safe before C++11 (and VS2015).
+// The probe keeps a view of arguments, the argument tuple is built only if 
+// missed to put the result.
+//
+// A stale result is returned at once and refreshed by pool workers, the
+// refresh captures arguments (and this of method) by copy. Without lambdas 
+// (C++03), the refresh is the job of function, TFunc##Job declared by 
+// LRU_DECL binds copies of arguments to TFunc##Impl (see _LRUBind). Methods 
+// have no job, this can not be bound without the class name, the fallback 
+// declared by LRU_CACHED returns an empty job (its first parameter is long,
+// so the job of LRU_DECL is preferred) and the caller seeing it stale 
+// refreshes it in place, others still get the stale result meanwhile.
+//
+// A miss ticks rebalancing of pool budget, see LRUPool Budget.
+
+#ifndef BOOST_NO_CXX11_LAMBDAS
+#define _LRU_JOB(TRet, TFunc, TParams, ... )
+#define _LRU_NO_JOB(TRet, TFunc, TParams)
+
+#define _LRU_CACHED_REVALIDATE(TRet, TFunc, ... )                           \
+ if(_lruProbe.Stale())                                                      \
+ {                                                                          \
+  _lruProbe.Revalidate(LRUImpl::LRUPool::instance().Workers(),              \
+                       [=]() { return TFunc##Impl(__VA_ARGS__); });         \
+                                                                            \
+  return _lruProbe.Value();                                                 \
+ }
+#else
+#define _LRU_JOB(TRet, TFunc, TParams, ... )                                \
+ inline boost::function<TRet()> TFunc##Job TParams                          \
+ {                                                                          \
+  return LRUImpl::_LRUBind(&TFunc##Impl, __VA_ARGS__);                      \
+ }
+
+#define _LRU_NO_JOB(TRet, TFunc, TParams)                                   \
+ inline boost::function<TRet()> TFunc##Job TParams                          \
+ {                                                                          \
+  return boost::function<TRet()>();                                         \
+ }
+
+#define _LRU_CACHED_REVALIDATE(TRet, TFunc, ... )                           \
+ if(_lruProbe.Stale())                                                      \
+ {                                                                          \
+  const boost::function<TRet()> _lruJob = TFunc##Job(0, __VA_ARGS__);       \
+                                                                            \
+  if(_lruJob)                                                               \
+  {                                                                         \
+   _lruProbe.Revalidate(LRUImpl::LRUPool::instance().Workers(), _lruJob);   \
+                                                                            \
+   return _lruProbe.Value();                                                \
+  }                                                                         \
+ }
+#endif
+
+#define _LRU_CACHED_IMPL(TConfig, TRet, TFunc, ... )                        \
+ static LRUImpl::_LRUHandle _lruHandle;                                     \
+ static boost::once_flag _lruOnce = BOOST_ONCE_INIT;                        \
+                                                                            \
+ LRUImpl::LRUPool::instance().Resolve<TConfig, TRet>(                       \
+  _lruHandle, _lruOnce, 0x1e3f75a9 + __COUNTER__, #TFunc, __VA_ARGS__);     \
+                                                                            \
+ BOOST_AUTO(_lruProbe, (_lruHandle.Probe<TConfig, TRet>(__VA_ARGS__)));     \
+ if(_lruProbe.Found() && !_lruProbe.Stale())                                \
+  return _lruProbe.Value();                                                 \
+                                                                            \
+ _LRU_CACHED_REVALIDATE(TRet, TFunc, __VA_ARGS__)                           \
+                                                                            \
+ LRUImpl::LRUPool::instance().Tick();                                       \
+                                                                            \
+ try                                                                        \
+ {                                                                          \
+  return _lruProbe.Put(TFunc##Impl(__VA_ARGS__));                           \
+ }                                                                          \
+ catch(...)                                                                 \
+ {                                                                          \
+  _lruProbe.Fail();                                                         \
+  throw;                                                                    \
+ }
+
+// Asynchronous cached functions cache futures of results, a miss puts its 
+// future at once and evaluates the result by executor of configuration, 
+// which captures arguments (and this of method) by copy. Without lambdas 
+// (C++03), the executor runs the job of function (see above), a miss of 
+// method is evaluated in place and returns a ready future.
+
+#ifndef BOOST_NO_CXX11_LAMBDAS
+#define _LRU_CACHED_LAUNCH(TConfig, TRet, TFunc, ... )                      \
+ return _lruProbe.Launch<TConfig::Executor, TRet>(                          \
+  [=]() { return TFunc##Impl(__VA_ARGS__); });
+#else
+#define _LRU_CACHED_LAUNCH(TConfig, TRet, TFunc, ... )                      \
+ const boost::function<TRet()> _lruJob = TFunc##Job(0, __VA_ARGS__);        \
+                                                                            \
+ if(_lruJob)                                                                \
+  return _lruProbe.Launch<TConfig::Executor, TRet>(_lruJob);                \
+                                                                            \
+ try                                                                        \
+ {                                                                          \
+  return _lruProbe.Ready<TRet>(TFunc##Impl(__VA_ARGS__));                   \
+ }                                                                          \
+ catch(...)                                                                 \
+ {                                                                          \
+  return _lruProbe.Failed<TRet>();                                          \
+ }
+#endif
+
+#define _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, ... )                  \
+ static LRUImpl::_LRUHandle _lruHandle;                                     \
+ static boost::once_flag _lruOnce = BOOST_ONCE_INIT;                        \
+                                                                            \
+ LRUImpl::LRUPool::instance().Resolve<                                      \
+  LRUImpl::_LRUAsyncConfig<TConfig>, boost::shared_future<TRet>             \
+ >(_lruHandle, _lruOnce, 0x1e3f75a9 + __COUNTER__, #TFunc, __VA_ARGS__);    \
+                                                                            \
+ BOOST_AUTO(_lruProbe, (_lruHandle.Probe<                                   \
+  LRUImpl::_LRUAsyncConfig<TConfig>, boost::shared_future<TRet>             \
+ >(__VA_ARGS__)));                                                          \
+ if(_lruProbe.Found())                                                      \
+  return _lruProbe.Value();                                                 \
+                                                                            \
+ LRUImpl::LRUPool::instance().Tick();                                       \
+                                                                            \
+ _LRU_CACHED_LAUNCH(TConfig, TRet, TFunc, __VA_ARGS__)
+
+#endif
+
+// LRU_CACHED Decorators, support up to 10 arguments.
+// TODO: Eliminate LRU_DECL macros for normal function usage.
+#define LRU_DECL1(TRet, TFunc, T0, A0)                                      \
+ TRet TFunc##Impl(T0 A0);                                                   \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0), A0)
+
+#define LRU_DECL2(TRet, TFunc, T0, A0, T1, A1)                              \
+ TRet TFunc##Impl(T0 A0, T1 A1);                                            \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1), A0, A1)
+
+#define LRU_DELC3(TRet, TFunc, T0, A0, T1, A1, T2, A2)                      \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2);                                     \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2), A0, A1, A2)
+
+#define LRU_DELC4(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3)              \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3);                              \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3), A0, A1, A2, A3)
+
+#define LRU_DELC5(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4)      \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4);                       \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4), A0, A1,    \
+          A2, A3, A4)
+
+#define LRU_DELC6(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,      \
+                  T5, A5)                                                   \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5);                \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5), A0, \
+          A1, A2, A3, A4, A5)
+
+ #define LRU_DELC7(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
+                   T5, A5, T6, A6)                                          \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6);         \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5,      \
+          T6 A6), A0, A1, A2, A3, A4, A5, A6)
+
+ #define LRU_DELC8(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
+                   T5, A5, T6, A6, T7, A7)                                  \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7);  \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5,      \
+          T6 A6, T7 A7), A0, A1, A2, A3, A4, A5, A6, A7)
+
+#define LRU_DELC9(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,      \
+                  T5, A5, T6, A6, T7, A7, T8, A8)                           \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8);                                                   \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5,      \
+          T6 A6, T7 A7, T8 A8), A0, A1, A2, A3, A4, A5, A6, A7, A8)
+
+#define LRU_DELC10(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,     \
+                   T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)                  \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8, T9 A9);                                            \
+ _LRU_JOB(TRet, TFunc, (int, T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5,      \
+          T6 A6, T7 A7, T8 A8, T9 A9), A0, A1, A2, A3, A4, A5, A6, A7, A8,  \
+          A9)
+
+#define LRU_CACHED1(TRet, TFunc, T0, A0)                                    \
+ LRU_CACHED_EX1(LRUImpl::LRUConfig, TRet, TFunc, T0, A0)
+
+#define LRU_CACHED2(TRet, TFunc, T0, A0, T1, A1)                            \
+ LRU_CACHED_EX2(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1)
+
+#define LRU_CACHED3(TRet, TFunc, T0, A0, T1, A1, T2, A2)                    \
+ LRU_CACHED_EX3(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2)
+
+#define LRU_CACHED4(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3)            \
+ LRU_CACHED_EX4(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3)
+
+#define LRU_CACHED5(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4)    \
+ LRU_CACHED_EX5(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3, T4, A4)
+
+#define LRU_CACHED6(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
+                    T5, A5)                                                 \
+ LRU_CACHED_EX6(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3, T4, A4, T5, A5)
+
+#define LRU_CACHED7(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
+                    T5, A5, T6, A6)                                         \
+ LRU_CACHED_EX7(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3, T4, A4, T5, A5, T6, A6)
+
+#define LRU_CACHED8(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
+                    T5, A5, T6, A6, T7, A7)                                 \
+ LRU_CACHED_EX8(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3, T4, A4, T5, A5, T6, A6, T7, A7)
+
+#define LRU_CACHED9(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,    \
+                    T5, A5, T6, A6, T7, A7, T8, A8)                         \
+ LRU_CACHED_EX9(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,    \
+                T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8)
+
+#define LRU_CACHED10(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, A4,   \
+                    T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)                 \
+ LRU_CACHED_EX10(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,   \
+                T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)
+
+// LRU_CACHED_EX Decorators take a configuration type derived from 
+// LRUImpl::LRUConfig as first argument, support up to 10 arguments.
+
+#define LRU_CACHED_EX1(TConfig, TRet, TFunc, T0, A0)                        \
+ TRet TFunc(T0 A0)                                                          \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0)                                \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0))                                       \
+ TRet TFunc##Impl(T0 A0)
+
+#define LRU_CACHED_EX2(TConfig, TRet, TFunc, T0, A0, T1, A1)                \
+ TRet TFunc(T0 A0, T1 A1)                                                   \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1)                            \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1))                                   \
+ TRet TFunc##Impl(T0 A0, T1 A1)
+
+#define LRU_CACHED_EX3(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2)        \
+ TRet TFunc(T0 A0, T1 A1, T2 A2)                                            \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2)                        \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2))                               \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2)
+
+#define LRU_CACHED_EX4(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3)                                                  \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3)                                     \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3)                    \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3))                           \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3)
+
+#define LRU_CACHED_EX5(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3, T4, A4)                                          \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)                              \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4)                \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4))                       \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)
+
+#define LRU_CACHED_EX6(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3, T4, A4, T5, A5)                                  \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5)                       \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5)            \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5))                   \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5)
+
+#define LRU_CACHED_EX7(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3, T4, A4, T5, A5, T6, A6)                          \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6)                \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6)        \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6))               \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6)
+
+#define LRU_CACHED_EX8(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3, T4, A4, T5, A5, T6, A6, T7, A7)                  \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7)         \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7)    \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7))           \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7)
+
+#define LRU_CACHED_EX9(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,        \
+                   T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8)          \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7, T8 A8)  \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7,    \
+                   A8)                                                      \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7, T8))       \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8)
+
+#define LRU_CACHED_EX10(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,       \
+                    T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8, T9, A9) \
+ TRet TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7, T8 A8,  \
+            T9 A9)                                                          \
+ {                                                                          \
+  _LRU_CACHED_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6, A7,    \
+                   A8, A9)                                                  \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7, T8, T9))   \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8, T9 A9)
+
+
+// LRU_CACHED_ASYNC Decorators return boost::shared_future of result, ready 
+// at once on hit, support up to 10 arguments. Declare implementation by 
+// LRU_DECL# for normal function, as LRU_CACHED#.
+
+#define LRU_CACHED_ASYNC1(TRet, TFunc, T0, A0)                              \
+ LRU_CACHED_ASYNC_EX1(LRUImpl::LRUConfig, TRet, TFunc, T0, A0)
+
+#define LRU_CACHED_ASYNC2(TRet, TFunc, T0, A0, T1, A1)                      \
+ LRU_CACHED_ASYNC_EX2(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1)
+
+#define LRU_CACHED_ASYNC3(TRet, TFunc, T0, A0, T1, A1, T2, A2)              \
+ LRU_CACHED_ASYNC_EX3(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2)
+
+#define LRU_CACHED_ASYNC4(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3)      \
+ LRU_CACHED_ASYNC_EX4(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3)
+
+#define LRU_CACHED_ASYNC5(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4,  \
+                          A4)                                               \
+ LRU_CACHED_ASYNC_EX5(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3, T4, A4)
+
+#define LRU_CACHED_ASYNC6(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4,  \
+                          A4, T5, A5)                                       \
+ LRU_CACHED_ASYNC_EX6(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3, T4, A4, T5, A5)
+
+#define LRU_CACHED_ASYNC7(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4,  \
+                          A4, T5, A5, T6, A6)                               \
+ LRU_CACHED_ASYNC_EX7(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3, T4, A4, T5, A5, T6, A6)
+
+#define LRU_CACHED_ASYNC8(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4,  \
+                          A4, T5, A5, T6, A6, T7, A7)                       \
+ LRU_CACHED_ASYNC_EX8(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3, T4, A4, T5, A5, T6, A6, T7, A7)
+
+#define LRU_CACHED_ASYNC9(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4,  \
+                          A4, T5, A5, T6, A6, T7, A7, T8, A8)               \
+ LRU_CACHED_ASYNC_EX9(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2,  \
+                      A2, T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8)
+
+#define LRU_CACHED_ASYNC10(TRet, TFunc, T0, A0, T1, A1, T2, A2, T3, A3, T4, \
+                           A4, T5, A5, T6, A6, T7, A7, T8, A8, T9, A9)      \
+ LRU_CACHED_ASYNC_EX10(LRUImpl::LRUConfig, TRet, TFunc, T0, A0, T1, A1, T2, \
+                       A2, T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8, A8,  \
+                       T9, A9)
+
+// LRU_CACHED_ASYNC_EX Decorators take a configuration type derived from 
+// LRUImpl::LRUConfig as first argument, its Executor evaluates misses.
+
+#define LRU_CACHED_ASYNC_EX1(TConfig, TRet, TFunc, T0, A0)                  \
+ boost::shared_future<TRet> TFunc(T0 A0)                                    \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0)                          \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0))                                       \
+ TRet TFunc##Impl(T0 A0)
+
+#define LRU_CACHED_ASYNC_EX2(TConfig, TRet, TFunc, T0, A0, T1, A1)          \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1)                             \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1)                      \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1))                                   \
+ TRet TFunc##Impl(T0 A0, T1 A1)
+
+#define LRU_CACHED_ASYNC_EX3(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2)  \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2)                      \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2)                  \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2))                               \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2)
+
+#define LRU_CACHED_ASYNC_EX4(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3)                                        \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3)               \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3)              \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3))                           \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3)
+
+#define LRU_CACHED_ASYNC_EX5(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3, T4, A4)                                \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)        \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4)          \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4))                       \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4)
+
+#define LRU_CACHED_ASYNC_EX6(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3, T4, A4, T5, A5)                        \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5) \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5)      \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5))                   \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5)
+
+#define LRU_CACHED_ASYNC_EX7(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3, T4, A4, T5, A5, T6, A6)                \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, \
+                                  T6 A6)                                    \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6)  \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6))               \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6)
+
+#define LRU_CACHED_ASYNC_EX8(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3, T4, A4, T5, A5, T6, A6, T7, A7)        \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, \
+                                  T6 A6, T7 A7)                             \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6,  \
+                         A7)                                                \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7))           \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7)
+
+#define LRU_CACHED_ASYNC_EX9(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2,  \
+                             T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8,    \
+                             A8)                                            \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, \
+                                  T6 A6, T7 A7, T8 A8)                      \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6,  \
+                         A7, A8)                                            \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7, T8))       \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8)
+
+#define LRU_CACHED_ASYNC_EX10(TConfig, TRet, TFunc, T0, A0, T1, A1, T2, A2, \
+                              T3, A3, T4, A4, T5, A5, T6, A6, T7, A7, T8,   \
+                              A8, T9, A9)                                   \
+ boost::shared_future<TRet> TFunc(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, \
+                                  T6 A6, T7 A7, T8 A8, T9 A9)               \
+ {                                                                          \
+  _LRU_CACHED_ASYNC_IMPL(TConfig, TRet, TFunc, A0, A1, A2, A3, A4, A5, A6,  \
+                         A7, A8, A9)                                        \
+ }                                                                          \
+ _LRU_NO_JOB(TRet, TFunc, (long, T0, T1, T2, T3, T4, T5, T6, T7, T8, T9))   \
+ TRet TFunc##Impl(T0 A0, T1 A1, T2 A2, T3 A3, T4 A4, T5 A5, T6 A6, T7 A7,   \
+                  T8 A8, T9 A9)
+
+#endif
@@ -1,249 +1,580 @@
-/**
-$Id: Parallel.hpp 775 2014-02-11 10:53:27Z Bear $
-
-Copyright (c) 2014 Nuwa Information Co., Ltd, All Rights Reserved.
-
-Distributed under the Boost Software License, Version 1.0.
-See accompanying file LICENSE_1_0.txt or copy at
-http://www.boost.org/LICENSE_1_0.txt
-
-See the License for the specific language governing permissions and
-limitations under the License.
-
-$Author: Bear $
-$Date: 2014-02-11 18:53:27 +0800 (週二, 11 二月 2014) $
-$Revision: 775 $
-*/
-#ifndef _NUWAINFO_PARALLEL_
-#define _NUWAINFO_PARALLEL_
-
-#include <boost/atomic.hpp>
-
-#include <boost/thread/thread.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/condition_variable.hpp>
-#include <boost/thread/locks.hpp>
-
-#include <boost/noncopyable.hpp>
-
-#include <boost/mpl/empty_base.hpp>
-
-#include <boost/shared_ptr.hpp>
-
-namespace LRUImpl
-{
-
-// Threading policies, 
-// Implementation of the ThreadingModel policy used by various classes,
-// Reference:
-// http://loki-lib.sourceforge.net/index.php?n=MT.LockingBaseClasses
-
-/**
-Implements a single-threaded model; no synchronization.
-*/
-template<
- typename H, 
- typename M = boost::mpl::empty_base,
- typename L = boost::mpl::empty_base
->
-class NullLockable
-{
-public:
-
- typedef NullLockable<H, M, L> ThreadPolicyType;
-
- /// Volatile type.
- typedef H VolatileType;
-
- /// Mutext type.
- typedef M MutexType;
-
- /// Lock type.
- typedef L LockType;
-
-public:
- 
- /// Dummy Lock class
- struct Lock
- {
-  Lock(MutexType& m) 
-  {
-  }
- };
-        
- template<typename T>
- struct Atomic
- {
-  typedef T Type;
-
-  static Type& Add(Type& lval, T val)
-  {
-   return lval += val; 
-  }
-
-  static Type& Sub(Type& lval, T val)
-  {
-   return lval -= val; 
-  }
-
-  static Type& Increment(Type& lval)
-  { 
-   return ++lval; 
-  }
-
-  static Type& Decrement(Type& lval)
-  { 
-   return --lval; 
-  }
-
-  static Type& Assign(Type& lval, T val)
-  { 
-   return lval = val; 
-  }
- };
-
-protected:
-
- /// Dummy mutex.
- mutable M _mutex; 
-
-};
-
-#define __PARALLEL_THREADS_ATOMIC                \
- template<typename T>                            \
- struct Atomic                                   \
- {                                               \
-  typedef boost::atomic<T> Type;                 \
-                                                 \
-  static Type& Add(Type& lval, T val)            \
-  {                                              \
-   return lval.fetch_add(val);                   \
-  }                                              \
-                                                 \
-  static Type& Sub(Type& lval, T val)            \
-  {                                              \
-   return lval.fetch_sub(val);                   \
-  }                                              \
-                                                 \
-  static Type& Increment(Type& lval)             \
-  {                                              \
-   return ++lval;                                \
-  }                                              \
-                                                 \
-  static Type& Decrement(Type& lval)             \
-  {                                              \
-   return --lval;                                \
-  }                                              \
-                                                 \
-  static Type& Assign(Type& lval, T val)         \
-  {                                              \
-   return lval.store(val);                       \
-  }                                              \
- };
-
-/**  
-Implements a object-level locking scheme.
-*/
-template<
- typename H, 
- typename M = boost::mutex, 
- typename L = boost::unique_lock<M> 
->
-class ObjectLevelLockable
-{
-public:
-
- typedef ObjectLevelLockable<H, M, L> ThreadPolicyType;
-
- /// Volatile type.
- typedef volatile H VolatileType;
-
- /// Mutext type.
- typedef M MutexType;
-
- /// Lock type.
- typedef L LockType;
-
-public:
-
- /// Lock.
- typedef LockType Lock;
-
- __PARALLEL_THREADS_ATOMIC
-
-protected:
-
- /// Mutex.
- mutable M _mutex;
-        
-};
-
-/// Handy macro to do object level lock.
-#define OBJECT_LEVEL_LOCK \
- typename ThreadPolicyType::Lock _lock(ThreadPolicyType::_mutex);
-
-/**  
-Implements a class-level locking scheme.
-*/
-template<
- typename H, 
- typename M = boost::mutex, 
- typename L = boost::unique_lock<M> 
->
-class ClassLevelLockable
-{
-public:
-
- typedef ClassLevelLockable<H, M, L> ThreadPolicyType;
-
- /// Volatile type.
- typedef volatile H VolatileType;
-
- /// Mutext type.
- typedef M MutexType;
-
- /// Lock type.
- typedef L LockType;
-
-public:
-
- /// Lock.
- typedef LockType Lock;
-
- __PARALLEL_THREADS_ATOMIC
-
-protected:
-
- /// Mutex.
- static M _mutex;
-        
-};
-
-/// Handy macro to do object level lock.
-#define CLASS_LEVEL_LOCK \
- typename ThreadPolicyType::Lock _lock(ThreadPolicyType::_mutex);
-
-// Handy type defines for C++98 lack of supporting default template value for 
-// template template parameter.
-// Use C++11 might solve this problem by using or variadic templates.
-// Reference: http://stackoverflow.com/questions/5301706/
-// default-values-in-templates-with-template-arguments-c
-
-template<typename H>
-struct DefaultNullLockable : public NullLockable<H>
-{
-};
-
-template<typename H>
-struct DefaultObjectLevelLockable : public ObjectLevelLockable<H>
-{
-};
-
-template<typename H>
-struct DefaultClassLevelLockable : public ClassLevelLockable<H>
-{
-};
-
-}
-
-#endif
+/**
+$Id: Parallel.hpp 775 2014-02-11 10:53:27Z Bear $
+
+Copyright (c) 2014 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+
+$Author: Bear $
+$Date: 2014-02-11 18:53:27 +0800 (週二, 11 二月 2014) $
+$Revision: 775 $
+*/
+#ifndef _NUWAINFO_PARALLEL_
+#define _NUWAINFO_PARALLEL_
+
+#include <deque>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <boost/exception_ptr.hpp>
+
+#include <boost/mpl/empty_base.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+namespace LRUImpl
+{
+
+// Threading policies, 
+// Implementation of the ThreadingModel policy used by various classes,
+// Reference:
+// http://loki-lib.sourceforge.net/index.php?n=MT.LockingBaseClasses
+
+/**
+Implements a single-threaded model; no synchronization.
+*/
+template<
+ typename H, 
+ typename M = boost::mpl::empty_base,
+ typename L = boost::mpl::empty_base
+>
+class NullLockable
+{
+public:
+
+ typedef NullLockable<H, M, L> ThreadPolicyType;
+
+ /// Volatile type.
+ typedef H VolatileType;
+
+ /// Mutext type.
+ typedef M MutexType;
+
+ /// Lock type.
+ typedef L LockType;
+
+public:
+ 
+ /// Dummy Lock class
+ struct Lock
+ {
+  Lock(MutexType&) 
+  {
+  }
+
+  Lock(MutexType&, boost::try_to_lock_t) 
+  {
+  }
+
+  bool owns_lock() const
+  {
+   return true;
+  }
+ };
+
+ /// Dummy shared Lock class.
+ typedef Lock SharedLock;
+        
+ /// Counters, see __PARALLEL_THREADS_ATOMIC.
+ template<typename T>
+ struct Atomic
+ {
+  typedef T Type;
+
+  static T Add(Type& lval, T val)
+  {
+   return lval += val; 
+  }
+
+  static T Sub(Type& lval, T val)
+  {
+   return lval -= val; 
+  }
+
+  static T Increment(Type& lval)
+  { 
+   return ++lval; 
+  }
+
+  static T Decrement(Type& lval)
+  { 
+   return --lval; 
+  }
+
+  static T Assign(Type& lval, T val)
+  { 
+   return lval = val; 
+  }
+
+  static T Load(const Type& lval)
+  { 
+   return lval; 
+  }
+ };
+
+protected:
+
+ /// Dummy mutex.
+ mutable M _mutex; 
+
+};
+
+// Atomic counters of relaxed ordering, they do not order other memory 
+// accesses, operations return new value.
+#define __PARALLEL_THREADS_ATOMIC                                     \
+ template<typename T>                                                 \
+ struct Atomic                                                        \
+ {                                                                    \
+  typedef boost::atomic<T> Type;                                      \
+                                                                      \
+  static T Add(Type& lval, T val)                                     \
+  {                                                                   \
+   return lval.fetch_add(val, boost::memory_order_relaxed) + val;     \
+  }                                                                   \
+                                                                      \
+  static T Sub(Type& lval, T val)                                     \
+  {                                                                   \
+   return lval.fetch_sub(val, boost::memory_order_relaxed) - val;     \
+  }                                                                   \
+                                                                      \
+  static T Increment(Type& lval)                                      \
+  {                                                                   \
+   return Add(lval, 1);                                               \
+  }                                                                   \
+                                                                      \
+  static T Decrement(Type& lval)                                      \
+  {                                                                   \
+   return Sub(lval, 1);                                               \
+  }                                                                   \
+                                                                      \
+  static T Assign(Type& lval, T val)                                  \
+  {                                                                   \
+   lval.store(val, boost::memory_order_relaxed);                      \
+                                                                      \
+   return val;                                                        \
+  }                                                                   \
+                                                                      \
+  static T Load(const Type& lval)                                     \
+  {                                                                   \
+   return lval.load(boost::memory_order_relaxed);                     \
+  }                                                                   \
+ };
+
+/**  
+Implements a object-level locking scheme.
+*/
+template<
+ typename H, 
+ typename M = boost::mutex, 
+ typename L = boost::unique_lock<M> 
+>
+class ObjectLevelLockable
+{
+public:
+
+ typedef ObjectLevelLockable<H, M, L> ThreadPolicyType;
+
+ /// Volatile type.
+ typedef volatile H VolatileType;
+
+ /// Mutext type.
+ typedef M MutexType;
+
+ /// Lock type.
+ typedef L LockType;
+
+public:
+
+ /// Lock.
+ typedef LockType Lock;
+
+ /// Shared lock, mutex is exclusive only.
+ typedef LockType SharedLock;
+
+ __PARALLEL_THREADS_ATOMIC
+
+protected:
+
+ /// Mutex.
+ mutable M _mutex;
+        
+};
+
+/// Handy macro to do object level lock.
+#define OBJECT_LEVEL_LOCK \
+ typename ThreadPolicyType::Lock _lock(ThreadPolicyType::_mutex);
+
+/// Handy macro to do object level shared lock, for readers.
+#define OBJECT_LEVEL_SHARED_LOCK \
+ typename ThreadPolicyType::SharedLock _lock(ThreadPolicyType::_mutex);
+
+/// Handy macro to try object level lock, check _lock.owns_lock().
+#define OBJECT_LEVEL_TRY_LOCK \
+ typename ThreadPolicyType::Lock _lock(ThreadPolicyType::_mutex, \
+                                       boost::try_to_lock);
+
+/**  
+Implements a object-level readers-writer locking scheme, readers take 
+SharedLock and run concurrently, writers take Lock.
+*/
+template<
+ typename H, 
+ typename M = boost::shared_mutex, 
+ typename L = boost::unique_lock<M>,
+ typename S = boost::shared_lock<M>
+>
+class ObjectLevelRWLockable
+{
+public:
+
+ typedef ObjectLevelRWLockable<H, M, L, S> ThreadPolicyType;
+
+ /// Volatile type.
+ typedef volatile H VolatileType;
+
+ /// Mutext type.
+ typedef M MutexType;
+
+ /// Lock type.
+ typedef L LockType;
+
+public:
+
+ /// Lock.
+ typedef LockType Lock;
+
+ /// Shared lock.
+ typedef S SharedLock;
+
+ __PARALLEL_THREADS_ATOMIC
+
+protected:
+
+ /// Mutex.
+ mutable M _mutex;
+        
+};
+
+/**  
+Implements a class-level locking scheme.
+*/
+template<
+ typename H, 
+ typename M = boost::mutex, 
+ typename L = boost::unique_lock<M> 
+>
+class ClassLevelLockable
+{
+public:
+
+ typedef ClassLevelLockable<H, M, L> ThreadPolicyType;
+
+ /// Volatile type.
+ typedef volatile H VolatileType;
+
+ /// Mutext type.
+ typedef M MutexType;
+
+ /// Lock type.
+ typedef L LockType;
+
+public:
+
+ /// Lock.
+ typedef LockType Lock;
+
+ /// Shared lock, mutex is exclusive only.
+ typedef LockType SharedLock;
+
+ __PARALLEL_THREADS_ATOMIC
+
+protected:
+
+ /// Mutex.
+ static M _mutex;
+        
+};
+
+/// Handy macro to do object level lock.
+#define CLASS_LEVEL_LOCK \
+ typename ThreadPolicyType::Lock _lock(ThreadPolicyType::_mutex);
+
+/**
+One-shot result slot, a producer sets value or exception once and any 
+number of consumers wait for it.
+*/
+template<typename T>
+class SharedResult : private boost::noncopyable
+{
+public:
+
+ SharedResult() : ready(false)
+ {
+ }
+
+ /**
+ Set value and wake up waiting consumers.
+
+ @param v Value.
+ */
+ void Set(const T& v)
+ {
+  {
+   boost::unique_lock<boost::mutex> lock(mutex);
+
+   value = v;
+   ready = true;
+  }
+
+  cond.notify_all();
+ }
+
+ /**
+ Set exception and wake up waiting consumers, they will rethrow it.
+
+ @param e Exception.
+ */
+ void Fail(const boost::exception_ptr& e)
+ {
+  {
+   boost::unique_lock<boost::mutex> lock(mutex);
+
+   error = e;
+   ready = true;
+  }
+
+  cond.notify_all();
+ }
+
+ /**
+ Wait for value.
+
+ @return Value, exception set by producer is rethrown.
+ */
+ T Wait() const
+ {
+  boost::unique_lock<boost::mutex> lock(mutex);
+
+  while(!ready)
+   cond.wait(lock);
+
+  if(error)
+   boost::rethrow_exception(error);
+
+  return value;
+ }
+
+private:
+
+ /// Lock of result.
+ mutable boost::mutex mutex;
+
+ /// Signaled when result is ready.
+ mutable boost::condition_variable cond;
+
+ /// Result is ready or not.
+ bool ready;
+
+ /// Value.
+ T value;
+
+ /// Exception.
+ boost::exception_ptr error;
+
+};
+
+/**
+Bounded pool of worker threads running tasks in background, threads are 
+started on first submission. A task is refused if the queue is full, so a 
+burst of tasks neither grows memory nor blocks the submitter. Tasks must 
+not throw, pending tasks are still run on destruction, so promises they 
+keep are not broken.
+*/
+class WorkerPool : private boost::noncopyable
+{
+public:
+
+ /// Task.
+ typedef boost::function<void()> Task;
+
+public:
+
+ /**
+ Constructor.
+
+ @param n Number of threads.
+ @param queue Maximum number of pending tasks.
+ */
+ explicit WorkerPool(const std::size_t n = 2, const std::size_t queue = 1024) :
+  threads(n), limit(queue), stopped(false)
+ {
+ }
+
+ /**
+ Destructor, refuse new tasks and wait for running and pending tasks.
+ */
+ ~WorkerPool()
+ {
+  {
+   boost::unique_lock<boost::mutex> lock(mutex);
+
+   stopped = true;
+  }
+
+  cond.notify_all();
+  workers.join_all();
+ }
+
+ /**
+ Submit task.
+
+ @param t Task.
+ @return False if queue is full, task is not run.
+ */
+ bool Submit(const Task& t)
+ {
+  {
+   boost::unique_lock<boost::mutex> lock(mutex);
+
+   if(stopped || tasks.size() >= limit)
+    return false;
+
+   while(workers.size() < threads)
+    workers.create_thread(Worker(*this));
+
+   tasks.push_back(t);
+  }
+
+  cond.notify_one();
+
+  return true;
+ }
+
+private:
+
+ /// Thread function.
+ struct Worker
+ {
+  explicit Worker(WorkerPool& p) : pool(p)
+  {
+  }
+
+  inline void operator()()
+  {
+   pool.Run();
+  }
+
+  WorkerPool& pool;
+ };
+
+ /**
+ Run tasks until stopped and no task is pending.
+ */
+ void Run()
+ {
+  for(;;)
+  {
+   Task t;
+
+   {
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    while(!stopped && tasks.empty())
+     cond.wait(lock);
+
+    if(tasks.empty())
+     return;
+
+    t.swap(tasks.front());
+    tasks.pop_front();
+   }
+
+   t();
+  }
+ }
+
+private:
+
+ /// Number of threads.
+ const std::size_t threads;
+
+ /// Maximum number of pending tasks.
+ const std::size_t limit;
+
+ /// Stopped or not.
+ bool stopped;
+
+ /// Lock of queue.
+ boost::mutex mutex;
+
+ /// Signaled when task is queued or pool is stopped.
+ boost::condition_variable cond;
+
+ /// Pending tasks.
+ std::deque<Task> tasks;
+
+ /// Threads.
+ boost::thread_group workers;
+
+};
+
+/**
+Pick stripe of current thread, to spread data updated by threads over 
+stripes.
+
+@param n Number of stripes, power of 2.
+@return Stripe index.
+*/
+inline std::size_t ThreadStripe(const std::size_t n)
+{
+ const boost::uint64_t h = 
+  boost::hash<boost::thread::id>()(boost::this_thread::get_id());
+
+ return (std::size_t)((h * 0x9e3779b97f4a7c15ULL) >> 40) & (n - 1);
+}
+
+// Handy type defines for C++98 lack of supporting default template value for 
+// template template parameter.
+// Use C++11 might solve this problem by using or variadic templates.
+// Reference: http://stackoverflow.com/questions/5301706/
+// default-values-in-templates-with-template-arguments-c
+
+template<typename H>
+struct DefaultNullLockable : public NullLockable<H>
+{
+};
+
+template<typename H>
+struct DefaultObjectLevelLockable : public ObjectLevelLockable<H>
+{
+};
+
+template<typename H>
+struct DefaultObjectLevelRWLockable : public ObjectLevelRWLockable<H>
+{
+};
+
+template<typename H>
+struct DefaultClassLevelLockable : public ClassLevelLockable<H>
+{
+};
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_REUSE_SAMPLER_
+#define _NUWAINFO_LRU_REUSE_SAMPLER_
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "Histogram.hpp"
+
+namespace LRUImpl
+{
+
+/**
+Reuse distances of keys sampled by hash (SHARDS), which estimate hit ratio
+of LRU at any capacity (miss ratio curve).
+
+Reuse distance of an access is the number of distinct keys accessed since
+the last access of its key, LRU of capacity c hits iff it is below c. One
+of every Rate keys is sampled by hash, and all accesses of a sampled key
+are, so distances among sampled keys scaled by Rate estimate distances
+among all keys. Sampled keys are kept in order of last access, counted by
+a Fenwick tree of access times, up to Reach times capacity (scaled),
+older ones count as never accessed.
+
+It is locked by itself, only accesses of sampled keys take the lock.
+*/
+class ReuseSampler : private boost::noncopyable
+{
+public:
+
+ /// Distances are told apart up to Reach times capacity.
+ static const std::size_t Reach = 10;
+
+public:
+
+ /**
+ Constructor.
+
+ @param r Sampling rate, one of r keys is sampled.
+ */
+ explicit ReuseSampler(const std::size_t r) :
+  rate(r ? r : 1), time(0), samples(0), counts(LogBuckets::Buckets, 0)
+ {
+ }
+
+ /**
+ Key is sampled?
+
+ @param h Hash of key.
+ @return True if sampled.
+ */
+ inline bool Sampled(const std::size_t h) const
+ {
+  return Mix(h) % rate == 0;
+ }
+
+ /**
+ Access sampled key.
+
+ @param h Hash of key.
+ @param capacity Capacity of cache.
+ */
+ void Access(const std::size_t h, const std::size_t capacity)
+ {
+  const std::size_t limit = Reach * capacity / rate + 1;
+
+  // Keys are told apart by hash, 0 means no key.
+  const std::size_t id = h | 1;
+
+  boost::lock_guard<boost::mutex> lock(mutex);
+
+  samples++;
+
+  LastTable::iterator i = last.find(id);
+  if(i != last.end())
+  {
+   const std::size_t t = i->second;
+
+   // Keys accessed after it are above it.
+   const boost::uint64_t d = Prefix(time) - Prefix(t + 1);
+   counts[LogBuckets::Bucket(d * rate)]++;
+
+   Add(t, -1);
+   owners[t] = 0;
+  }
+
+  if(time == owners.size())
+   Compact(limit);
+
+  Add(time, 1);
+  owners[time] = id;
+  last[id] = time++;
+
+  // Forget keys beyond reach, from the least recently accessed.
+  while(last.size() > limit)
+  {
+   const std::size_t t = Oldest();
+
+   last.erase(owners[t]);
+   Add(t, -1);
+   owners[t] = 0;
+  }
+ }
+
+ /**
+ Estimate hit ratio at capacity.
+
+ @param c Capacity.
+ @return Hit ratio, 0 if nothing is sampled.
+ */
+ double HitRatio(const std::size_t c) const
+ {
+  boost::lock_guard<boost::mutex> lock(mutex);
+
+  if(!samples)
+   return 0;
+
+  double hits = 0;
+
+  for(std::size_t b = 0; b < counts.size(); b++)
+  {
+   const boost::uint64_t lo = LogBuckets::Lowest(b);
+   const boost::uint64_t hi = LogBuckets::Highest(b);
+
+   if(lo >= c)
+    break;
+
+   // Distances are uniform in bucket.
+   hits += hi < c ? (double)counts[b] :
+                    (double)counts[b] * (c - lo) / (hi - lo + 1);
+  }
+
+  return hits / samples;
+ }
+
+ /**
+ Number of sampled accesses.
+
+ @return Samples.
+ */
+ inline boost::uint64_t Samples() const
+ {
+  boost::lock_guard<boost::mutex> lock(mutex);
+
+  return samples;
+ }
+
+ /**
+ Sampling rate.
+
+ @return One of rate keys is sampled.
+ */
+ inline std::size_t Rate() const
+ {
+  return rate;
+ }
+
+private:
+
+ /// Last access time of sampled keys.
+ typedef boost::unordered_map<std::size_t, std::size_t> LastTable;
+
+ /**
+ Mix bits of hash (a specialized LRUHasher may be weak), so sampling does
+ not follow patterns of keys.
+
+ @param h Hash.
+ @return Mixed hash.
+ */
+ static inline boost::uint64_t Mix(boost::uint64_t h)
+ {
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+ }
+
+ /**
+ Add to count of access time.
+
+ @param t Access time.
+ @param d Delta.
+ */
+ inline void Add(std::size_t t, const int d)
+ {
+  for(t++; t <= tree.size(); t += t & (0 - t))
+   tree[t - 1] += d;
+ }
+
+ /**
+ Number of keys last accessed before time.
+
+ @param t Access time.
+ @return Number of keys.
+ */
+ inline boost::uint64_t Prefix(std::size_t t) const
+ {
+  boost::uint64_t n = 0;
+
+  for(; t; t -= t & (0 - t))
+   n += tree[t - 1];
+
+  return n;
+ }
+
+ /**
+ Earliest access time of keys.
+
+ @return Access time.
+ */
+ std::size_t Oldest() const
+ {
+  std::size_t t = 0;
+  std::size_t step = 1;
+
+  while(step * 2 <= tree.size())
+   step *= 2;
+
+  // Descend over times no key is last accessed at.
+  for(; step; step /= 2)
+   if(t + step <= tree.size() && tree[t + step - 1] == 0)
+    t += step;
+
+  return t;
+ }
+
+ /**
+ Renumber access times of keys from 0 in order, room is twice the limit, 
+ so it runs at most once every limit accesses.
+
+ @param limit Maximum number of keys.
+ */
+ void Compact(const std::size_t limit)
+ {
+  std::vector<std::size_t> live;
+
+  for(std::size_t t = 0; t < time; t++)
+   if(owners[t])
+    live.push_back(owners[t]);
+
+  const std::size_t n = (std::max)(live.size(), limit) * 2 + 16;
+
+  owners.assign(n, 0);
+  tree.assign(n, 0);
+
+  for(time = 0; time < live.size(); time++)
+  {
+   owners[time] = live[time];
+   last[live[time]] = time;
+  }
+
+  // Build tree in linear time.
+  for(std::size_t t = 1; t <= n; t++)
+  {
+   tree[t - 1] += t <= time ? 1 : 0;
+
+   const std::size_t p = t + (t & (0 - t));
+   if(p <= n)
+    tree[p - 1] += tree[t - 1];
+  }
+ }
+
+private:
+
+ /// Sampling rate.
+ const std::size_t rate;
+
+ /// Next access time.
+ std::size_t time;
+
+ /// Number of sampled accesses.
+ boost::uint64_t samples;
+
+ /// Counts of scaled distances in log buckets, see LogBuckets.
+ std::vector<boost::uint64_t> counts;
+
+ /// Last access time of sampled keys.
+ LastTable last;
+
+ /// Key last accessed at time, 0 if none.
+ std::vector<std::size_t> owners;
+
+ /// Fenwick tree of keys by last access time.
+ std::vector<boost::int32_t> tree;
+
+ /// Lock.
+ mutable boost::mutex mutex;
+
+};
+
+}
+
+#endif
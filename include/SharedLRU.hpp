@@ -0,0 +1,601 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_SHARED_LRU_
+#define _NUWAINFO_LRU_SHARED_LRU_
+
+#include <new>
+#include <string>
+
+#include <boost/config.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include "LRU.hpp"
+
+#ifdef BOOST_HAS_UNISTD_H
+#include <unistd.h>
+#endif
+
+// Robust process-shared mutexes are POSIX 2008, glibc and FreeBSD have 
+// them, macOS does not. Define LRU_HAS_ROBUST_MUTEX where others have them.
+#if !defined(LRU_HAS_ROBUST_MUTEX) && defined(_POSIX_THREADS) && \
+    (defined(__GLIBC__) || defined(__FreeBSD__))
+#define LRU_HAS_ROBUST_MUTEX
+#endif
+
+#ifdef LRU_HAS_ROBUST_MUTEX
+
+#include <errno.h>
+#include <pthread.h>
+
+namespace LRUImpl
+{
+
+/**
+Mutex shared by processes, placed in shared memory. It is robust: if its
+owner dies while holding it, the next locker gets it and is told to repair
+state it guards.
+*/
+class SharedMutex : private boost::noncopyable
+{
+public:
+
+ SharedMutex()
+ {
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+
+  pthread_mutex_init(&mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+ }
+
+ /**
+ Lock.
+
+ @return True if owner died holding it, state it guards must be repaired.
+ */
+ bool Lock()
+ {
+  const int rc = pthread_mutex_lock(&mutex);
+
+  if(rc == EOWNERDEAD)
+  {
+   pthread_mutex_consistent(&mutex);
+   return true;
+  }
+
+  if(rc)
+   throw boost::interprocess::interprocess_exception(
+    "SharedMutex: lock failed");
+
+  return false;
+ }
+
+ inline void Unlock()
+ {
+  pthread_mutex_unlock(&mutex);
+ }
+
+private:
+
+ /// Process-shared robust mutex.
+ pthread_mutex_t mutex;
+
+};
+
+/**
+LRU cache in a named shared memory segment, shared by processes of a host
+(e.g. pre-forked workers), so they hold one copy of results and warm up
+together.
+
+Keys and values are POD types, copied in and out of the segment. Records
+refer to each other by index, so the segment is mapped at any address.
+Records are chained in buckets by hash and linked in recency order, a
+SharedMutex guards all of them. If a process dies holding it, records may
+be half-updated, so the next locker drops all records (Recoveries counts
+it).
+
+The first process creating the segment sizes and initializes it, others
+wait until it is ready (a creator dying before that leaves it unusable 
+until Remove), a segment of other types or capacity is refused. The 
+segment outlives processes until Remove.
+
+@param K Key type, POD with == and LRUHasher (see Hash.hpp).
+@param V Value type, POD.
+@param H Hash function.
+*/
+template<typename K, typename V, typename H = LRUHash>
+class SharedLRU : private boost::noncopyable
+{
+ BOOST_STATIC_ASSERT(boost::is_pod<K>::value && boost::is_pod<V>::value);
+
+public:
+
+ typedef K KeyType;
+ typedef V ValueType;
+
+public:
+
+ /**
+ Open segment, create it if it does not exist.
+
+ @param name Segment name, e.g. "/myapp.cache".
+ @param c Maximum number of records.
+ @throw boost::interprocess::interprocess_exception If segment can not be
+        opened, or it is of other types or capacity.
+ */
+ SharedLRU(const std::string& name, const std::size_t c)
+ {
+  using namespace boost::interprocess;
+
+  bool created = true;
+
+  try
+  {
+   shared_memory_object shm(create_only, name.c_str(), read_write);
+   segment.swap(shm);
+   segment.truncate((offset_t)SizeOf(c));
+  }
+  catch(const interprocess_exception& e)
+  {
+   if(e.get_error_code() != already_exists_error)
+    throw;
+
+   shared_memory_object shm(open_only, name.c_str(), read_write);
+   segment.swap(shm);
+   created = false;
+  }
+
+  // Creator sizes segment before initializing it.
+  offset_t size = 0;
+  while(segment.get_size(size) && size < (offset_t)sizeof(Header))
+   boost::this_thread::yield();
+
+  mapped_region region(segment, read_write);
+  mapping.swap(region);
+
+  header = (Header*)mapping.get_address();
+
+  if(created)
+  {
+   new(header) Header(c);
+   Reset();
+
+   header->ready.store(1, boost::memory_order_release);
+  }
+  else
+  {
+   while(!header->ready.load(boost::memory_order_acquire))
+    boost::this_thread::yield();
+
+   if(header->magic != Magic || header->version != Version ||
+      header->keySize != sizeof(K) || header->valueSize != sizeof(V) ||
+      header->capacity != c || mapping.get_size() < SizeOf(c))
+    throw interprocess_exception("SharedLRU: segment does not match");
+  }
+
+  buckets = (RecordIndex*)((char*)header + BucketsOffset());
+  records = (Record*)((char*)header + RecordsOffset(c));
+ }
+
+ /**
+ Remove segment, processes having it mapped keep it until they unmap.
+
+ @param name Segment name.
+ @return True if removed.
+ */
+ static bool Remove(const std::string& name)
+ {
+  return boost::interprocess::shared_memory_object::remove(name.c_str());
+ }
+
+ /**
+ Get cached value.
+
+ @param k Key.
+ @param found Output indicator, could be NULL.
+ @return Value, or default value if not found.
+ */
+ V Get(const K& k, bool* found = NULL)
+ {
+  Lock lock(*this);
+
+  const RecordIndex i = Find(k, Hash(k));
+
+  if(found)
+   *found = i != NilRecord;
+
+  if(i == NilRecord)
+  {
+   header->misses++;
+   return V();
+  }
+
+  header->hits++;
+  Touch(i);
+
+  return records[i].value;
+ }
+
+ /**
+ Put value into cache, replace value of cached key, purge the
+ least-recently-used record if capacity is exceeded.
+
+ @param k Key.
+ @param v Value.
+ */
+ void Put(const K& k, const V& v)
+ {
+  if(header->capacity == 0) /* Disabled */
+   return;
+
+  Lock lock(*this);
+
+  const boost::uint32_t h = Hash(k);
+
+  RecordIndex i = Find(k, h);
+  if(i != NilRecord)
+  {
+   records[i].value = v;
+   Touch(i);
+
+   return;
+  }
+
+  if(header->free == NilRecord)
+  {
+   Unlink(header->head);
+   header->evictions++;
+  }
+
+  i = header->free;
+  header->free = records[i].next;
+
+  Record& r = records[i];
+  r.key = k;
+  r.value = v;
+  r.hash = h;
+
+  RecordIndex& b = buckets[h & (header->buckets - 1)];
+  r.chain = b;
+  b = i;
+
+  r.prev = header->tail;
+  r.next = NilRecord;
+  (r.prev == NilRecord ? header->head : records[r.prev].next) = i;
+  header->tail = i;
+
+  header->size++;
+  header->inserts++;
+ }
+
+ /**
+ Remove cached key.
+
+ @param k Key.
+ */
+ void Erase(const K& k)
+ {
+  Lock lock(*this);
+
+  const RecordIndex i = Find(k, Hash(k));
+  if(i != NilRecord)
+   Unlink(i);
+ }
+
+ /**
+ Cached key exists or not?
+
+ @param k Key.
+ @return True if exists.
+ */
+ bool Exists(const K& k)
+ {
+  Lock lock(*this);
+
+  return Find(k, Hash(k)) != NilRecord;
+ }
+
+ /**
+ Remove all records.
+ */
+ void Clear()
+ {
+  Lock lock(*this);
+
+  Reset();
+ }
+
+ /**
+ Obtain statistics of all processes.
+
+ @return Statistics.
+ */
+ LRUStats Stats()
+ {
+  Lock lock(*this);
+
+  LRUStats s;
+
+  s.hits = header->hits;
+  s.misses = header->misses;
+  s.inserts = header->inserts;
+  s.evictions = header->evictions;
+  s.size = (std::size_t)header->size;
+  s.capacity = (std::size_t)header->capacity;
+
+  return s;
+ }
+
+ /**
+ Number of times records were dropped because a process died holding the
+ lock.
+
+ @return Recoveries.
+ */
+ boost::uint64_t Recoveries()
+ {
+  Lock lock(*this);
+
+  return header->recoveries;
+ }
+
+private:
+
+ /// Record, linked by indices.
+ struct Record
+ {
+  K key;
+  V value;
+
+  /// Hash of key.
+  boost::uint32_t hash;
+
+  /// Next record of bucket.
+  RecordIndex chain;
+
+  /// Recency links, next links free records too.
+  RecordIndex prev;
+  RecordIndex next;
+ };
+
+ /// Segment header.
+ struct Header
+ {
+  explicit Header(const std::size_t c) :
+   magic(Magic), version(Version), keySize(sizeof(K)),
+   valueSize(sizeof(V)), capacity(c), buckets(BucketsOf(c)),
+   head(NilRecord), tail(NilRecord), free(NilRecord), size(0), hits(0),
+   misses(0), inserts(0), evictions(0), recoveries(0)
+  {
+   ready.store(0, boost::memory_order_relaxed);
+  }
+
+  boost::uint32_t magic;
+  boost::uint32_t version;
+  boost::uint32_t keySize;
+  boost::uint32_t valueSize;
+  boost::uint64_t capacity;
+  boost::uint64_t buckets;
+
+  /// Initialized by creator.
+  boost::atomic<boost::uint32_t> ready;
+
+  SharedMutex mutex;
+
+  /// Least and most recently used records, head of free records.
+  RecordIndex head;
+  RecordIndex tail;
+  RecordIndex free;
+
+  boost::uint64_t size;
+  boost::uint64_t hits;
+  boost::uint64_t misses;
+  boost::uint64_t inserts;
+  boost::uint64_t evictions;
+  boost::uint64_t recoveries;
+ };
+
+ /// Lock of segment, repairs records if its owner died.
+ class Lock : private boost::noncopyable
+ {
+ public:
+
+  explicit Lock(SharedLRU& c) : cache(c)
+  {
+   if(cache.header->mutex.Lock())
+   {
+    cache.Reset();
+    cache.header->recoveries++;
+   }
+  }
+
+  ~Lock()
+  {
+   cache.header->mutex.Unlock();
+  }
+
+ private:
+
+  SharedLRU& cache;
+ };
+
+ /// Magic of segment.
+ static const boost::uint32_t Magic = 0x4c525553;
+
+ /// Layout version, segments of other versions are refused.
+ static const boost::uint32_t Version = 1;
+
+ /// Alignment of arrays in segment.
+ static const std::size_t Align = 64;
+
+ static inline std::size_t AlignUp(const std::size_t n)
+ {
+  return (n + Align - 1) & ~(Align - 1);
+ }
+
+ /// Buckets, a power of 2 not less than capacity.
+ static inline std::size_t BucketsOf(const std::size_t c)
+ {
+  std::size_t n = 1;
+  while(n < c)
+   n *= 2;
+
+  return n;
+ }
+
+ static inline std::size_t BucketsOffset()
+ {
+  return AlignUp(sizeof(Header));
+ }
+
+ static inline std::size_t RecordsOffset(const std::size_t c)
+ {
+  return AlignUp(BucketsOffset() + BucketsOf(c) * sizeof(RecordIndex));
+ }
+
+ /// Size of segment.
+ static inline std::size_t SizeOf(const std::size_t c)
+ {
+  return RecordsOffset(c) + (c ? c : 1) * sizeof(Record);
+ }
+
+ static inline boost::uint32_t Hash(const K& k)
+ {
+  const std::size_t h = H()(k);
+
+  return (boost::uint32_t)(h ^ (h >> 16) ^ ((boost::uint64_t)h >> 32));
+ }
+
+ /**
+ Find record of key. Lock must be held by caller.
+
+ @param k Key.
+ @param h Hash of key.
+ @return Record index, NilRecord if not found.
+ */
+ RecordIndex Find(const K& k, const boost::uint32_t h) const
+ {
+  RecordIndex i = buckets[h & (header->buckets - 1)];
+
+  for(; i != NilRecord; i = records[i].chain)
+   if(records[i].hash == h && records[i].key == k)
+    return i;
+
+  return NilRecord;
+ }
+
+ /**
+ Make record most-recently-used. Lock must be held by caller.
+
+ @param i Record index.
+ */
+ void Touch(const RecordIndex i)
+ {
+  if(header->tail == i)
+   return;
+
+  Record& r = records[i];
+
+  (r.prev == NilRecord ? header->head : records[r.prev].next) = r.next;
+  records[r.next].prev = r.prev;
+
+  r.prev = header->tail;
+  r.next = NilRecord;
+  records[header->tail].next = i;
+  header->tail = i;
+ }
+
+ /**
+ Unlink record from its bucket and recency list, free it. Lock must be
+ held by caller.
+
+ @param i Record index.
+ */
+ void Unlink(const RecordIndex i)
+ {
+  Record& r = records[i];
+
+  RecordIndex* p = &buckets[r.hash & (header->buckets - 1)];
+  while(*p != i)
+   p = &records[*p].chain;
+
+  *p = r.chain;
+
+  (r.prev == NilRecord ? header->head : records[r.prev].next) = r.next;
+  (r.next == NilRecord ? header->tail : records[r.next].prev) = r.prev;
+
+  r.next = header->free;
+  header->free = i;
+
+  header->size--;
+ }
+
+ /**
+ Drop all records. Lock must be held by caller, or segment is not ready.
+ */
+ void Reset()
+ {
+  RecordIndex* b = (RecordIndex*)((char*)header + BucketsOffset());
+  Record* r = (Record*)((char*)header +
+                        RecordsOffset((std::size_t)header->capacity));
+
+  for(std::size_t i = 0; i < header->buckets; i++)
+   b[i] = NilRecord;
+
+  header->free = NilRecord;
+  for(std::size_t i = (std::size_t)header->capacity; i > 0; i--)
+  {
+   r[i - 1].next = header->free;
+   header->free = (RecordIndex)(i - 1);
+  }
+
+  header->head = header->tail = NilRecord;
+  header->size = 0;
+ }
+
+private:
+
+ /// Shared memory segment.
+ boost::interprocess::shared_memory_object segment;
+
+ /// Mapping of segment.
+ boost::interprocess::mapped_region mapping;
+
+ /// Header of segment.
+ Header* header;
+
+ /// Buckets of records.
+ RecordIndex* buckets;
+
+ /// Records.
+ Record* records;
+
+};
+
+}
+
+#endif
+
+#endif
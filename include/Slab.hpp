@@ -0,0 +1,427 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_SLAB_
+#define _NUWAINFO_LRU_SLAB_
+
+#include <new>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace LRUImpl
+{
+
+/**
+Slab of fixed-size blocks carved from chunks, for the nodes of a cache.
+Every chunk keeps its own list of free blocks. Freed blocks are reused
+last in first out, so the record a cache purges to make space is where the
+next record goes. It does not lock, the cache lock guards it.
+
+After Shrink, blocks are taken from one chunk until it is full instead, so
+records purged from other chunks are not replaced there, and a chunk is
+returned to the heap as soon as its last block is freed, until chunks left
+hold no more than a chunk of free blocks.
+
+Blocks are sized by the first single object allocated, the node of the
+container; arrays and objects of other sizes go to the heap. Heap traffic
+of the slab is counted, see Allocations and Deallocations.
+*/
+class Slab : private boost::noncopyable
+{
+public:
+
+ /// Blocks in a chunk.
+ static const std::size_t ChunkBlocks = 256;
+
+public:
+
+ Slab() : 
+  block(0), used(0), recent(0), current(0), allocations(0), 
+  deallocations(0), releasing(false)
+ {
+ }
+
+ ~Slab()
+ {
+  for(std::size_t i = 0; i < chunks.size(); i++)
+   ::operator delete(chunks[i].base);
+ }
+
+ /**
+ Allocate a block, or heap memory if size is not of blocks.
+
+ @param size Bytes.
+ @param single A single object, not an array.
+ @return Memory.
+ */
+ void* Allocate(const std::size_t size, const bool single)
+ {
+  if(!block && single)
+   block = Align(size);
+
+  if(!single || Align(size) != block)
+  {
+   allocations++;
+   return ::operator new(size);
+  }
+
+  std::size_t i = recent;
+
+  if(releasing || i >= chunks.size() || !chunks[i].free)
+   i = Current();
+
+  Chunk& c = chunks[i];
+  Block* b = c.free;
+
+  c.free = b->next;
+  c.used++;
+  used++;
+
+  return b;
+ }
+
+ /**
+ Free memory from Allocate.
+
+ @param p Memory.
+ @param size Bytes.
+ @param single A single object, not an array.
+ */
+ void Deallocate(void* p, const std::size_t size, const bool single)
+ {
+  if(!single || Align(size) != block)
+  {
+   deallocations++;
+   ::operator delete(p);
+   return;
+  }
+
+  const std::size_t i = ChunkOf(p);
+  Chunk& c = chunks[i];
+  Block* b = static_cast<Block*>(p);
+
+  b->next = c.free;
+  c.free = b;
+  c.used--;
+  used--;
+
+  recent = i;
+
+  if(releasing && !c.used)
+   Release(i);
+ }
+
+ /**
+ Return chunks to the heap as their blocks are freed, for fewer blocks are
+ needed. Blocks are allocated from one chunk at a time meanwhile, so other
+ chunks empty as their records are purged.
+ */
+ inline void Shrink()
+ {
+  releasing = true;
+ }
+
+ /**
+ Number of chunks held.
+
+ @return Chunks.
+ */
+ inline std::size_t Chunks() const
+ {
+  return chunks.size();
+ }
+
+ /**
+ Number of heap allocations made, chunks and memory not of blocks.
+
+ @return Allocations.
+ */
+ inline std::size_t Allocations() const
+ {
+  return allocations;
+ }
+
+ /**
+ Number of heap deallocations made.
+
+ @return Deallocations.
+ */
+ inline std::size_t Deallocations() const
+ {
+  return deallocations;
+ }
+
+private:
+
+ /// Free block.
+ struct Block
+ {
+  Block* next;
+ };
+
+ /// Chunk of blocks.
+ struct Chunk
+ {
+  /// First block.
+  char* base;
+
+  /// Free blocks.
+  Block* free;
+
+  /// Blocks allocated.
+  std::size_t used;
+
+  inline bool operator<(const Chunk& c) const
+  {
+   return base < c.base;
+  }
+ };
+
+ /// Block size, aligned as any node.
+ static inline std::size_t Align(const std::size_t size)
+ {
+  const std::size_t a = sizeof(void*) * 2;
+
+  return (std::max)((size + a - 1) / a * a, sizeof(Block));
+ }
+
+ /**
+ Add a chunk of free blocks, chunks are kept in order of address. Blocks 
+ are needed, so chunks are no longer released.
+ */
+ void Grow()
+ {
+  Chunk c;
+  c.base = static_cast<char*>(::operator new(block * ChunkBlocks));
+  allocations++;
+  c.free = NULL;
+  c.used = 0;
+
+  for(std::size_t i = ChunkBlocks; i > 0; i--)
+  {
+   Block* b = reinterpret_cast<Block*>(c.base + (i - 1) * block);
+   b->next = c.free;
+   c.free = b;
+  }
+
+  current = 
+   std::upper_bound(chunks.begin(), chunks.end(), c) - chunks.begin();
+  chunks.insert(chunks.begin() + current, c);
+  recent = current;
+  releasing = false;
+ }
+
+ /**
+ Chunk to allocate from, current chunk until it is full, then the next one
+ with free blocks, or a new one.
+
+ @return Index of chunk.
+ */
+ std::size_t Current()
+ {
+  for(std::size_t n = chunks.size(); n; n--)
+  {
+   if(current >= chunks.size())
+    current = 0;
+
+   if(chunks[current].free)
+    return current;
+
+   current++;
+  }
+
+  Grow();
+
+  return current;
+ }
+
+ /**
+ Return an empty chunk to the heap.
+
+ @param i Index of chunk.
+ */
+ void Release(const std::size_t i)
+ {
+  ::operator delete(chunks[i].base);
+  chunks.erase(chunks.begin() + i);
+  deallocations++;
+
+  if(current > i)
+   current--;
+
+  if(recent > i)
+   recent--;
+
+  Releasing();
+ }
+
+ /**
+ Stop releasing once chunks left hold no more than a chunk of free blocks.
+ */
+ inline void Releasing()
+ {
+  if(chunks.size() * ChunkBlocks <= used + ChunkBlocks)
+   releasing = false;
+ }
+
+ /**
+ Chunk of a block.
+
+ @param p Block.
+ @return Index of chunk.
+ */
+ inline std::size_t ChunkOf(const void* p) const
+ {
+  Chunk c;
+  c.base = (char*)p;
+
+  return std::upper_bound(chunks.begin(), chunks.end(), c) - 
+         chunks.begin() - 1;
+ }
+
+private:
+
+ /// Chunks in order of address.
+ std::vector<Chunk> chunks;
+
+ /// Block size, 0 until the first single object.
+ std::size_t block;
+
+ /// Blocks allocated.
+ std::size_t used;
+
+ /// Chunk of block freed last.
+ std::size_t recent;
+
+ /// Chunk allocated from when block freed last is taken.
+ std::size_t current;
+
+ /// Heap allocations made.
+ std::size_t allocations;
+
+ /// Heap deallocations made.
+ std::size_t deallocations;
+
+ /// Chunks are released as they empty.
+ bool releasing;
+
+};
+
+/**
+Allocator of a container from a Slab shared by its copies and rebinds.
+
+@param T Value type.
+*/
+template<typename T>
+class SlabAllocator
+{
+public:
+
+ typedef T value_type;
+ typedef T* pointer;
+ typedef const T* const_pointer;
+ typedef T& reference;
+ typedef const T& const_reference;
+ typedef std::size_t size_type;
+ typedef std::ptrdiff_t difference_type;
+
+ template<typename U>
+ struct rebind
+ {
+  typedef SlabAllocator<U> other;
+ };
+
+public:
+
+ SlabAllocator() : slab(new Slab())
+ {
+ }
+
+ explicit SlabAllocator(const boost::shared_ptr<Slab>& s) : slab(s)
+ {
+ }
+
+ template<typename U>
+ SlabAllocator(const SlabAllocator<U>& a) : slab(a.Get())
+ {
+ }
+
+ inline pointer allocate(const size_type n, const void* = NULL)
+ {
+  return static_cast<pointer>(slab->Allocate(n * sizeof(T), n == 1));
+ }
+
+ inline void deallocate(const pointer p, const size_type n)
+ {
+  slab->Deallocate(p, n * sizeof(T), n == 1);
+ }
+
+ inline void construct(const pointer p, const T& v)
+ {
+  new(p) T(v);
+ }
+
+ inline void destroy(const pointer p)
+ {
+  p->~T();
+ }
+
+ inline pointer address(reference v) const
+ {
+  return &v;
+ }
+
+ inline const_pointer address(const_reference v) const
+ {
+  return &v;
+ }
+
+ inline size_type max_size() const
+ {
+  return (size_type)-1 / sizeof(T);
+ }
+
+ /**
+ Slab of allocator.
+
+ @return Slab.
+ */
+ inline const boost::shared_ptr<Slab>& Get() const
+ {
+  return slab;
+ }
+
+ template<typename U>
+ inline bool operator==(const SlabAllocator<U>& a) const
+ {
+  return slab == a.Get();
+ }
+
+ template<typename U>
+ inline bool operator!=(const SlabAllocator<U>& a) const
+ {
+  return slab != a.Get();
+ }
+
+private:
+
+ /// Shared slab.
+ boost::shared_ptr<Slab> slab;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,582 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_SNAPSHOT_
+#define _NUWAINFO_LRU_SNAPSHOT_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <cstring>
+#include <typeinfo>
+#include <iterator>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include <boost/tuple/tuple.hpp>
+
+#include <boost/preprocessor/repetition.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace LRUImpl
+{
+
+/**
+Serialization of keys and values in snapshots, see SnapshotFile. It is a
+customization point, specialize it for types not supported here:
+
+Supported                 True, caches of types not supported are not
+                          saved.
+Write(os, v)              Append v to stream.
+Read(p, end, v)           Read v from bytes [p, end) and advance p, false
+                          if bytes are malformed.
+
+POD types are copied as their bytes, straight from the mapped file, so
+are strings and vectors of them. Bytes are in host order, snapshots are
+not portable across architectures. Pointers and member pointers are not
+supported, addresses do not survive the process, nor are pairs and tuples
+holding them; PODs holding pointers can not be told apart, do not cache
+them with snapshots.
+
+@param T Type.
+*/
+template<typename T, typename Enable = void>
+struct LRUSerializer
+{
+ static const bool Supported = false;
+
+ static inline void Write(std::ostream&, const T&)
+ {
+ }
+
+ static inline bool Read(const char*&, const char*, T&)
+ {
+  return false;
+ }
+};
+
+/// POD types but pointers, which are copied as their bytes.
+template<typename T>
+struct LRUBytes : boost::integral_constant<
+ bool, boost::is_pod<T>::value && 
+       !boost::is_pointer<typename boost::remove_all_extents<T>::type>::value &&
+       !boost::is_member_pointer<
+        typename boost::remove_all_extents<T>::type
+       >::value
+>
+{
+};
+
+/// POD types are their bytes.
+template<typename T>
+struct LRUSerializer<T, typename boost::enable_if<LRUBytes<T> >::type>
+{
+ static const bool Supported = true;
+
+ static inline void Write(std::ostream& os, const T& v)
+ {
+  os.write((const char*)&v, sizeof(T));
+ }
+
+ static inline bool Read(const char*& p, const char* end, T& v)
+ {
+  if((std::size_t)(end - p) < sizeof(T))
+   return false;
+
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+
+  return true;
+ }
+};
+
+/**
+Read count of elements, which must fit in remaining bytes.
+
+@param p Bytes, advanced.
+@param end End of bytes.
+@param size Size of an element at least.
+@param n Output count.
+@return False if malformed.
+*/
+inline bool ReadCount(const char*& p, const char* end, const std::size_t size,
+                      std::size_t& n)
+{
+ boost::uint64_t c;
+
+ if(!LRUSerializer<boost::uint64_t>::Read(p, end, c) ||
+    c > (boost::uint64_t)(end - p) / (size ? size : 1))
+  return false;
+
+ n = (std::size_t)c;
+
+ return true;
+}
+
+/// Strings are length and characters.
+template<typename C, typename TR, typename A>
+struct LRUSerializer<std::basic_string<C, TR, A> >
+{
+ static const bool Supported = true;
+
+ static void Write(std::ostream& os, const std::basic_string<C, TR, A>& v)
+ {
+  LRUSerializer<boost::uint64_t>::Write(os, v.size());
+  os.write((const char*)v.data(), v.size() * sizeof(C));
+ }
+
+ static bool Read(const char*& p, const char* end,
+                  std::basic_string<C, TR, A>& v)
+ {
+  std::size_t n;
+
+  if(!ReadCount(p, end, sizeof(C), n))
+   return false;
+
+  v.resize(n);
+  if(n)
+   std::memcpy(&v[0], p, n * sizeof(C));
+
+  p += n * sizeof(C);
+
+  return true;
+ }
+};
+
+/// Vectors are size and elements, elements of POD types are a block.
+template<typename T, typename A>
+struct LRUSerializer<std::vector<T, A> >
+{
+ /// Elements are a block.
+ typedef boost::integral_constant<
+  bool, LRUBytes<T>::value && !boost::is_same<T, bool>::value
+ > Block;
+
+ static const bool Supported = LRUSerializer<T>::Supported;
+
+ static void Write(std::ostream& os, const std::vector<T, A>& v)
+ {
+  LRUSerializer<boost::uint64_t>::Write(os, v.size());
+  Write(os, v, Block());
+ }
+
+ static bool Read(const char*& p, const char* end, std::vector<T, A>& v)
+ {
+  std::size_t n;
+
+  if(!ReadCount(p, end, Block::value ? sizeof(T) : 0, n))
+   return false;
+
+  return Read(p, end, v, n, Block());
+ }
+
+private:
+
+ static void Write(std::ostream& os, const std::vector<T, A>& v,
+                   boost::true_type)
+ {
+  if(!v.empty())
+   os.write((const char*)&v[0], v.size() * sizeof(T));
+ }
+
+ static void Write(std::ostream& os, const std::vector<T, A>& v,
+                   boost::false_type)
+ {
+  for(std::size_t i = 0; i < v.size(); i++)
+   LRUSerializer<T>::Write(os, v[i]);
+ }
+
+ static bool Read(const char*& p, const char*, std::vector<T, A>& v,
+                  const std::size_t n, boost::true_type)
+ {
+  v.resize(n);
+  if(n)
+   std::memcpy(&v[0], p, n * sizeof(T));
+
+  p += n * sizeof(T);
+
+  return true;
+ }
+
+ static bool Read(const char*& p, const char* end, std::vector<T, A>& v,
+                  const std::size_t n, boost::false_type)
+ {
+  v.clear();
+  v.reserve((std::min)(n, (std::size_t)(end - p)));
+
+  for(std::size_t i = 0; i < n; i++)
+  {
+   v.push_back(T());
+
+   if(!LRUSerializer<T>::Read(p, end, v.back()))
+    return false;
+  }
+
+  return true;
+ }
+};
+
+/// Pairs are their members.
+template<typename T1, typename T2>
+struct LRUSerializer<std::pair<T1, T2> >
+{
+ static const bool Supported = 
+  LRUSerializer<T1>::Supported && LRUSerializer<T2>::Supported;
+
+ static inline void Write(std::ostream& os, const std::pair<T1, T2>& v)
+ {
+  LRUSerializer<T1>::Write(os, v.first);
+  LRUSerializer<T2>::Write(os, v.second);
+ }
+
+ static inline bool Read(const char*& p, const char* end,
+                         std::pair<T1, T2>& v)
+ {
+  return LRUSerializer<T1>::Read(p, end, v.first) &&
+         LRUSerializer<T2>::Read(p, end, v.second);
+ }
+};
+
+/// Tuples are their elements in order.
+template<>
+struct LRUSerializer<boost::tuples::null_type>
+{
+ static const bool Supported = true;
+
+ static inline void Write(std::ostream&, const boost::tuples::null_type&)
+ {
+ }
+
+ static inline bool Read(const char*&, const char*,
+                         boost::tuples::null_type&)
+ {
+  return true;
+ }
+};
+
+template<typename H, typename T>
+struct LRUSerializer<boost::tuples::cons<H, T> >
+{
+ static const bool Supported = 
+  LRUSerializer<H>::Supported && LRUSerializer<T>::Supported;
+
+ static inline void Write(std::ostream& os,
+                          const boost::tuples::cons<H, T>& v)
+ {
+  LRUSerializer<H>::Write(os, v.head);
+  LRUSerializer<T>::Write(os, v.tail);
+ }
+
+ static inline bool Read(const char*& p, const char* end,
+                         boost::tuples::cons<H, T>& v)
+ {
+  return LRUSerializer<H>::Read(p, end, v.head) &&
+         LRUSerializer<T>::Read(p, end, v.tail);
+ }
+};
+
+template<typename H>
+struct LRUSerializer<boost::tuples::cons<H, boost::tuples::null_type> >
+{
+ static const bool Supported = LRUSerializer<H>::Supported;
+
+ static inline void Write(
+  std::ostream& os, const boost::tuples::cons<H, boost::tuples::null_type>& v)
+ {
+  LRUSerializer<H>::Write(os, v.head);
+ }
+
+ static inline bool Read(
+  const char*& p, const char* end, 
+  boost::tuples::cons<H, boost::tuples::null_type>& v)
+ {
+  return LRUSerializer<H>::Read(p, end, v.head);
+ }
+};
+
+template<BOOST_PP_ENUM_PARAMS(10, typename T)>
+struct LRUSerializer<boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)> > :
+ LRUSerializer<
+  typename boost::tuple<BOOST_PP_ENUM_PARAMS(10, T)>::inherited
+ >
+{
+};
+
+/**
+Stable key of a cache in snapshots: function name and types of keys and
+values, so it survives rebuilding, unlike function unique keys generated
+by compiler, and a snapshot of changed types is not loaded. Functions of
+the same name and signature in different scopes share the key.
+
+Types are named by typeid, whose names are up to the compiler: snapshots
+are only loaded by builds of the same compiler and standard library, and
+a changed layout of a POD type keeping its name is not detected, bump
+the function name when changing it.
+
+@param name Function name.
+@return Key, empty if keys or values are not supported by LRUSerializer.
+*/
+template<typename Cache>
+std::string SnapshotKey(const std::string& name)
+{
+ if(!LRUSerializer<typename Cache::KeyType>::Supported ||
+    !LRUSerializer<typename Cache::ValueType>::Supported)
+  return std::string();
+
+ return name + '(' + typeid(typename Cache::KeyType).name() + ")->" +
+        typeid(typename Cache::ValueType).name();
+}
+
+/**
+Write records of cache, from least to most recently used, so loading them
+in order restores recency.
+
+@param cache Cache.
+@param os Output stream.
+@return Number of records.
+*/
+template<typename Cache>
+std::size_t SaveRecords(Cache& cache, std::ostream& os)
+{
+ typedef typename Cache::KeyType K;
+ typedef typename Cache::ValueType V;
+
+ std::vector<std::pair<K, V> > records;
+ std::back_insert_iterator<std::vector<std::pair<K, V> > > it(records);
+
+ // Most valuable first.
+ cache.GetRecords(it);
+
+ LRUSerializer<boost::uint64_t>::Write(os, records.size());
+
+ for(std::size_t i = records.size(); i > 0; i--)
+ {
+  LRUSerializer<K>::Write(os, records[i - 1].first);
+  LRUSerializer<V>::Write(os, records[i - 1].second);
+ }
+
+ return records.size();
+}
+
+/**
+Put records written by SaveRecords into cache, records already cached are
+kept. Loading stops at malformed bytes.
+
+@param cache Cache.
+@param p Bytes.
+@param end End of bytes.
+@return Number of records read.
+*/
+template<typename Cache>
+std::size_t LoadRecords(Cache& cache, const char* p, const char* end)
+{
+ typedef typename Cache::KeyType K;
+ typedef typename Cache::ValueType V;
+
+ std::size_t n;
+
+ if(!ReadCount(p, end, 0, n))
+  return 0;
+
+ for(std::size_t i = 0; i < n; i++)
+ {
+  K k;
+  V v;
+
+  if(!LRUSerializer<K>::Read(p, end, k) ||
+     !LRUSerializer<V>::Read(p, end, v))
+   return i;
+
+  cache.Put(k, v);
+ }
+
+ return n;
+}
+
+/**
+Snapshot of caches in a file, see _LRUPool::Save and Load.
+
+File is a header (magic, version and byte order mark) and sections of
+caches, a section is the stable key of cache (see SnapshotKey), its length
+and records (see SaveRecords). File is mapped read-only and records are
+read straight from the mapping, sections are taken by caches once.
+*/
+class SnapshotFile : private boost::noncopyable
+{
+public:
+
+ /// Format version, files of other versions are not loaded.
+ static const boost::uint32_t Version = 1;
+
+public:
+
+ /**
+ Map file, it has no section if file is missing or malformed.
+
+ @param path File path.
+ */
+ explicit SnapshotFile(const std::string& path)
+ {
+  try
+  {
+   boost::interprocess::file_mapping file(path.c_str(),
+                                          boost::interprocess::read_only);
+   boost::interprocess::mapped_region region(file,
+                                             boost::interprocess::read_only);
+
+   mapping.swap(region);
+  }
+  catch(const boost::interprocess::interprocess_exception&)
+  {
+   return;
+  }
+
+  const char* p = (const char*)mapping.get_address();
+  const char* end = p + mapping.get_size();
+
+  if((std::size_t)(end - p) < MagicSize ||
+     std::memcmp(p, Magic(), MagicSize))
+   return;
+
+  p += MagicSize;
+
+  boost::uint32_t version, order;
+
+  if(!LRUSerializer<boost::uint32_t>::Read(p, end, version) ||
+     !LRUSerializer<boost::uint32_t>::Read(p, end, order) ||
+     version != Version || order != Order)
+   return;
+
+  while(p != end)
+  {
+   std::string key;
+   std::size_t n;
+
+   if(!LRUSerializer<std::string>::Read(p, end, key) ||
+      !ReadCount(p, end, 1, n))
+    return;
+
+   sections[key] = std::make_pair(p, p + n);
+   p += n;
+  }
+ }
+
+ /**
+ Take section of cache, it is taken once.
+
+ @param key Stable key of cache.
+ @param begin Output beginning of records.
+ @param end Output end of records.
+ @return True if found.
+ */
+ bool Take(const std::string& key, const char*& begin, const char*& end)
+ {
+  SectionTable::iterator i = sections.find(key);
+  if(i == sections.end())
+   return false;
+
+  begin = i->second.first;
+  end = i->second.second;
+
+  sections.erase(i);
+
+  return true;
+ }
+
+ /**
+ Number of sections not taken.
+
+ @return Number of sections.
+ */
+ inline std::size_t Size() const
+ {
+  return sections.size();
+ }
+
+ /**
+ Write header of file.
+
+ @param os Output stream.
+ */
+ static void WriteHeader(std::ostream& os)
+ {
+  os.write(Magic(), MagicSize);
+  LRUSerializer<boost::uint32_t>::Write(os, (boost::uint32_t)Version);
+  LRUSerializer<boost::uint32_t>::Write(os, (boost::uint32_t)Order);
+ }
+
+ /**
+ Write section of cache, its length is filled after records.
+
+ @param os Output stream, seekable.
+ @param key Stable key of cache.
+ @param save Function object writing records, see SaveRecords.
+ */
+ template<typename F>
+ static void WriteSection(std::ostream& os, const std::string& key, F& save)
+ {
+  LRUSerializer<std::string>::Write(os, key);
+
+  const std::ostream::pos_type at = os.tellp();
+  LRUSerializer<boost::uint64_t>::Write(os, 0);
+
+  save(os);
+
+  const std::ostream::pos_type end = os.tellp();
+
+  os.seekp(at);
+  LRUSerializer<boost::uint64_t>::Write(
+   os, (boost::uint64_t)(end - at) - sizeof(boost::uint64_t));
+  os.seekp(end);
+ }
+
+private:
+
+ /**
+ Magic of file.
+
+ @return Magic.
+ */
+ static inline const char* Magic()
+ {
+  return "LRUSNAP";
+ }
+
+ /// Sections by key, records are [first, second).
+ typedef boost::unordered_map<
+  std::string, std::pair<const char*, const char*>
+ > SectionTable;
+
+ /// Length of magic, with terminating zero.
+ static const std::size_t MagicSize = 8;
+
+ /// Byte order mark.
+ static const boost::uint32_t Order = 0x01020304;
+
+private:
+
+ /// Mapped file.
+ boost::interprocess::mapped_region mapping;
+
+ /// Sections not taken.
+ SectionTable sections;
+
+};
+
+}
+
+#endif
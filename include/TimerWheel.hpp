@@ -0,0 +1,366 @@
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _NUWAINFO_LRU_TIMER_WHEEL_
+#define _NUWAINFO_LRU_TIMER_WHEEL_
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <boost/chrono/chrono.hpp>
+
+namespace LRUImpl
+{
+
+/**
+Hierarchical timer wheel of keys, times are 32-bit milliseconds compared
+by serial number arithmetic, so wrapping around is fine for timeouts up to
+24 days.
+
+There are 4 levels of 64 slots, level l spans 64^(l+1) milliseconds
+(level 3 spans 4.6 hours, later timers wait in its farthest slot). A timer
+is put in the slot of its deadline at the lowest level spanning it, slots of
+higher levels cascade to lower levels when time reaches them, so
+scheduling and expiring a timer are O(1) amortized. Advancing jumps over
+empty slots, and past the span of levels all timers are placed again, so 
+an idle wheel does not step through the time it missed.
+
+@param K Key type.
+*/
+template<typename K>
+class TimerWheel : private boost::noncopyable
+{
+public:
+
+ /// Timer.
+ struct Timer
+ {
+  Timer(const K& k, const boost::uint32_t d) : key(k), deadline(d)
+  {
+  }
+
+  K key;
+  boost::uint32_t deadline;
+ };
+
+ typedef std::vector<Timer> Slot;
+
+public:
+
+ /**
+ Constructor.
+
+ @param time Current time.
+ */
+ explicit TimerWheel(const boost::uint32_t time = 0) : current(time), size(0)
+ {
+ }
+
+ /**
+ Obtain current time of monotonic clock.
+
+ @return Milliseconds.
+ */
+ static inline boost::uint32_t Now()
+ {
+  return (boost::uint32_t)boost::chrono::duration_cast<
+   boost::chrono::milliseconds
+  >(boost::chrono::steady_clock::now().time_since_epoch()).count();
+ }
+
+ /**
+ Time a is before b?
+
+ @param a Time.
+ @param b Time.
+ @return True if a is before b.
+ */
+ static inline bool Before(const boost::uint32_t a, const boost::uint32_t b)
+ {
+  return (boost::int32_t)(a - b) < 0;
+ }
+
+ /**
+ Schedule timer of key, timer due already expires on next advance.
+
+ @param k Key.
+ @param deadline Deadline.
+ */
+ void Schedule(const K& k, const boost::uint32_t deadline)
+ {
+  Place(Timer(k, deadline), current + 1);
+  size++;
+ }
+
+ /**
+ Advance time, expire due timers. Time a little before current time (of a
+ caller that waited) is ignored, time after the span of levels (even after
+ 24 days) places all timers again.
+
+ @param time Current time.
+ @param expire Function object called with key and deadline of due timers.
+ */
+ template<typename F>
+ void Advance(const boost::uint32_t time, F& expire)
+ {
+  if(Before(time, current) && current - time < Span)
+   return;
+
+  // Nothing to expire, jump.
+  if(!size)
+  {
+   current = time;
+   return;
+  }
+
+  if(time - current >= Span)
+  {
+   Replace(time, expire);
+   return;
+  }
+
+  while(Before(current, time))
+  {
+   // Jump to the slot before next one to process.
+   const boost::uint32_t next = Next();
+
+   if(next > time - current)
+   {
+    current = time;
+    return;
+   }
+
+   current += next - 1;
+   Step(expire);
+
+   if(!size)
+   {
+    current = time;
+    return;
+   }
+  }
+ }
+
+ /**
+ Restart wheel without timers at time, for instance of another clock.
+
+ @param time Current time.
+ */
+ inline void Reset(const boost::uint32_t time)
+ {
+  if(!size)
+   current = time;
+ }
+
+ /**
+ Number of timers.
+
+ @return Size.
+ */
+ inline std::size_t Size() const
+ {
+  return size;
+ }
+
+private:
+
+ /// Bits of slot index.
+ static const unsigned Bits = 6;
+
+ /// Number of levels.
+ static const unsigned Levels = 4;
+
+ /// Slot index mask.
+ static const boost::uint32_t Mask = (1u << Bits) - 1;
+
+ /// Milliseconds spanned by levels.
+ static const boost::uint32_t Span = 1u << (Bits * Levels);
+
+ /**
+ Put timer in slot of its deadline.
+
+ @param t Timer.
+ @param earliest Earliest slot time, if timer is due already.
+ */
+ void Place(const Timer& t, const boost::uint32_t earliest)
+ {
+  boost::uint32_t when = Before(t.deadline, earliest) ? earliest : 
+                                                        t.deadline;
+
+  const boost::uint32_t delta = when - current;
+
+  if(delta >= Span)
+   when = current + Span - 1;
+
+  unsigned l = 0;
+  while(l < Levels - 1 && (when - current) >= (1u << (Bits * (l + 1))))
+   l++;
+
+  wheels[l][(when >> (Bits * l)) & Mask].push_back(t);
+ }
+
+ /**
+ Advance time by a millisecond, cascade slots reached and expire due timers.
+
+ @param expire Function object called with key and deadline of due timers.
+ */
+ template<typename F>
+ void Step(F& expire)
+ {
+  current++;
+
+  // Cascade higher levels whose slot is reached.
+  for(unsigned l = Levels - 1; l > 0; l--)
+   if(!(current & ((1u << (Bits * l)) - 1)))
+    Cascade(l);
+
+  Slot& slot = wheels[0][current & Mask];
+  if(slot.empty())
+   return;
+
+  Slot due;
+  due.swap(slot);
+
+  for(typename Slot::iterator i = due.begin(); i != due.end(); ++i)
+  {
+   size--;
+
+   // Waited in the farthest slot, not due yet.
+   if(Before(current, i->deadline))
+    Schedule(i->key, i->deadline);
+   else
+    expire(i->key, i->deadline);
+  }
+
+  // Keep allocated slot.
+  if(slot.empty())
+  {
+   due.clear();
+   due.swap(slot);
+  }
+ }
+
+ /**
+ Milliseconds to next slot to process, the first slot of timers after 
+ current time at level 0, or to cascade at higher levels. Timers of a 
+ level are within 64 slots of current time, so no more than 64 slots of 
+ every level are looked at.
+
+ @return Milliseconds, Span if there is none.
+ */
+ boost::uint32_t Next() const
+ {
+  boost::uint32_t next = Span;
+
+  for(unsigned l = 0; l < Levels; l++)
+  {
+   const boost::uint32_t base = current >> (Bits * l);
+
+   for(boost::uint32_t k = 1; k <= Mask + 1; k++)
+   {
+    const boost::uint32_t d = ((base + k) << (Bits * l)) - current;
+
+    if(d >= next)
+     break;
+
+    if(!wheels[l][(base + k) & Mask].empty())
+    {
+     next = d;
+     break;
+    }
+   }
+  }
+
+  return next;
+ }
+
+ /**
+ Time is after the span of levels, slots no longer tell deadlines: expire
+ timers due and place others again. Deadlines are compared as distances
+ from former current time, so a gap over 24 days is told right.
+
+ @param time Current time.
+ @param expire Function object called with key and deadline of due timers.
+ */
+ template<typename F>
+ void Replace(const boost::uint32_t time, F& expire)
+ {
+  Slot timers;
+
+  for(unsigned l = 0; l < Levels; l++)
+  {
+   for(boost::uint32_t i = 0; i <= Mask; i++)
+   {
+    Slot& slot = wheels[l][i];
+
+    timers.insert(timers.end(), slot.begin(), slot.end());
+    slot.clear();
+   }
+  }
+
+  const boost::uint32_t gap = time - current;
+  const boost::uint32_t former = current;
+
+  current = time;
+  size = 0;
+
+  for(typename Slot::iterator i = timers.begin(); i != timers.end(); ++i)
+  {
+   const boost::int32_t d = (boost::int32_t)(i->deadline - former);
+
+   if(d <= 0 || (boost::uint32_t)d <= gap)
+   {
+    expire(i->key, i->deadline);
+   }
+   else
+   {
+    Place(*i, current + 1);
+    size++;
+   }
+  }
+ }
+
+ /**
+ Move timers of reached slot of a level to lower levels.
+
+ @param l Level.
+ */
+ void Cascade(const unsigned l)
+ {
+  Slot& slot = wheels[l][(current >> (Bits * l)) & Mask];
+  if(slot.empty())
+   return;
+
+  Slot timers;
+  timers.swap(slot);
+
+  // Slot of current time is expired right after cascading.
+  for(typename Slot::iterator i = timers.begin(); i != timers.end(); ++i)
+   Place(*i, current);
+ }
+
+private:
+
+ /// Slots of levels.
+ Slot wheels[Levels][1 << Bits];
+
+ /// Current time.
+ boost::uint32_t current;
+
+ /// Number of timers.
+ std::size_t size;
+
+};
+
+}
+
+#endif
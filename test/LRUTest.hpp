@@ -1,103 +1,2877 @@
-/**
-Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
-
-Distributed under the Boost Software License, Version 1.0.
-See accompanying file LICENSE_1_0.txt or copy at
-http://www.boost.org/LICENSE_1_0.txt
-
-See the License for the specific language governing permissions and
-limitations under the License.
-*/
-
-#ifndef _NUWAINFO_LRU_TEST_
-#define _NUWAINFO_LRU_TEST_
-
-#include "TestSuite.hpp"
-#include "../include/LRU.hpp"
-
-using namespace std;
-
-int Fib(int n)
-{
- if(n == 0)
-  return 0;
- 
- if(n == 1)
-  return 1;
- 
- return Fib(n - 1) + Fib(n - 2);
-}
-
-// In test we must duplicate function implemation, to make normal and 
-// cached version co-exist.
-LRU_DECL1(int, FibCached, int, n)
-LRU_CACHED1(int, FibCached, int, n)
-{
- if(n == 0)
-  return 0;
- 
- if(n == 1)
-  return 1;
- 
- return FibCached(n - 1) + FibCached(n - 2);
-}
-
-/**
-Test LRU cache for Fibonacci Sequence.
-*/
-void TestFib()
-{
- TimeReporter _t;
- int n;
- int assertN = 102334155; // Fib(40);
- 
- _t.Start("Test Normal Fib(40).");
- n = Fib(40);
- _t.End();
-
- BOOST_CHECK(n == assertN); 
- 
- _t.Start("Test LRU Cached Fib(40).");
- n = FibCached(40);
- _t.End(); 
- 
- BOOST_CHECK(n == assertN); 
-}
-
-struct Factorial
-{
- long long Fact(int x) 
- {
-  return (x == 1 ? x : x * Fact(x - 1));
- }
-
- LRU_CACHED1(long long, Fact2, int, x)
- {
-  return (x == 1 ? x : x * Fact2(x - 1));
- }
-};
-
-/**
-Test LRU cache for Factorial with method form.
-*/
-void TestFactorial()
-{
- TimeReporter _t;
- long long n;
- long long assertN = 2432902008176640000; // Fact(20);
- 
- Factorial f;
- _t.Start("Test Normal Factorial(20).");
- n = f.Fact(20);
- _t.End();
-
- BOOST_CHECK(n == assertN); 
- 
- _t.Start("Test LRU Cached Factorial(20).");
- n = f.Fact2(20);
- _t.End(); 
-
- BOOST_CHECK(n == assertN); 
-}
-
-#endif
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _NUWAINFO_LRU_TEST_
+#define _NUWAINFO_LRU_TEST_
+
+#include <vector>
+#include <string>
+#include <iterator>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "TestSuite.hpp"
+#include "../include/LRU.hpp"
+#include "../include/SharedLRU.hpp"
+
+#ifdef LRU_HAS_ROBUST_MUTEX
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+
+int Fib(int n)
+{
+ if(n == 0)
+  return 0;
+ 
+ if(n == 1)
+  return 1;
+ 
+ return Fib(n - 1) + Fib(n - 2);
+}
+
+// In test we must duplicate function implemation, to make normal and 
+// cached version co-exist.
+LRU_DECL1(int, FibCached, int, n)
+LRU_CACHED1(int, FibCached, int, n)
+{
+ if(n == 0)
+  return 0;
+ 
+ if(n == 1)
+  return 1;
+ 
+ return FibCached(n - 1) + FibCached(n - 2);
+}
+
+/**
+Test LRU cache for Fibonacci Sequence.
+*/
+void TestFib()
+{
+ TimeReporter _t;
+ int n;
+ int assertN = 102334155; // Fib(40);
+ 
+ _t.Start("Test Normal Fib(40).");
+ n = Fib(40);
+ _t.End();
+
+ BOOST_CHECK(n == assertN); 
+ 
+ _t.Start("Test LRU Cached Fib(40).");
+ n = FibCached(40);
+ _t.End(); 
+ 
+ BOOST_CHECK(n == assertN); 
+}
+
+struct Factorial
+{
+ long long Fact(int x) 
+ {
+  return (x == 1 ? x : x * Fact(x - 1));
+ }
+
+ LRU_CACHED1(long long, Fact2, int, x)
+ {
+  return (x == 1 ? x : x * Fact2(x - 1));
+ }
+};
+
+/**
+Test LRU cache for Factorial with method form.
+*/
+void TestFactorial()
+{
+ TimeReporter _t;
+ long long n;
+ long long assertN = 2432902008176640000; // Fact(20);
+ 
+ Factorial f;
+ _t.Start("Test Normal Factorial(20).");
+ n = f.Fact(20);
+ _t.End();
+
+ BOOST_CHECK(n == assertN); 
+ 
+ _t.Start("Test LRU Cached Factorial(20).");
+ n = f.Fact2(20);
+ _t.End(); 
+
+ BOOST_CHECK(n == assertN); 
+}
+
+int squareCalls = 0;
+
+LRU_DECL1(int, Square, int, n)
+LRU_CACHED1(int, Square, int, n)
+{
+ ++squareCalls;
+
+ return n * n;
+}
+
+/**
+Test cached function resolves its own cache once and hits it afterward.
+*/
+void TestCacheHandle()
+{
+ TimeReporter _t;
+ int n = 0;
+
+ BOOST_CHECK(Square(3) == 9);
+ BOOST_CHECK(Square(3) == 9);
+ BOOST_CHECK(Square(4) == 16);
+ BOOST_CHECK(squareCalls == 2);
+
+ _t.Start("Test LRU Cached Square(3) hit x 1000000.");
+ for(int i = 0; i < 1000000; i++)
+  n += Square(3);
+ _t.End();
+
+ BOOST_CHECK(n == 9000000);
+ BOOST_CHECK(squareCalls == 2);
+
+ // Disabling pool bypasses resolved caches.
+ LRUImpl::LRUPool::instance().Configure(0);
+ BOOST_CHECK(Square(3) == 9 && Square(5) == 25);
+ BOOST_CHECK(squareCalls == 4);
+
+ LRUImpl::LRUPool::instance().Configure(LRU_DEFAULT_CAPACITY);
+ BOOST_CHECK(Square(3) == 9 && Square(5) == 25);
+ BOOST_CHECK(squareCalls == 5);
+}
+
+/**
+Nullary function object to evaluate a value for key.
+*/
+struct Twice
+{
+ Twice(int x) : x(x)
+ {
+ }
+
+ int operator()() const
+ {
+  return x * 2;
+ }
+
+ int x;
+};
+
+/**
+Test and benchmark LRU::GetOrCompute against Exists + Get + Put.
+*/
+void TestGetOrCompute()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > Cache;
+
+ TimeReporter _t;
+ const int loops = 1000000;
+ long long n1 = 0, n2 = 0;
+ bool found;
+
+ Cache c1, c2;
+
+ _t.Start("Test Exists + Get + Put, misses.");
+ for(int i = 0; i < loops; i++)
+ {
+  boost::tuple<int> k(i);
+  if(c1.Exists(k))
+  {
+   n1 += c1.Get(k);
+  }
+  else
+  {
+   const int v = Twice(i)();
+   c1.Put(boost::tuple<int>(i), v);
+   n1 += v;
+  }
+ }
+ _t.End();
+
+ _t.Start("Test GetOrCompute, misses.");
+ for(int i = 0; i < loops; i++)
+  n2 += c2.GetOrCompute(boost::tuple<int>(i), Twice(i));
+ _t.End();
+
+ BOOST_CHECK(n1 == n2);
+
+ _t.Start("Test Exists + Get + Put, hits.");
+ for(int i = 0; i < loops; i++)
+ {
+  boost::tuple<int> k(loops - 1 - (i & 1023));
+  if(c1.Exists(k))
+  {
+   n1 += c1.Get(k);
+  }
+  else
+  {
+   const int v = Twice(boost::get<0>(k))();
+   c1.Put(k, v);
+   n1 += v;
+  }
+ }
+ _t.End();
+
+ _t.Start("Test GetOrCompute, hits.");
+ for(int i = 0; i < loops; i++)
+ {
+  const int x = loops - 1 - (i & 1023);
+  n2 += c2.GetOrCompute(boost::tuple<int>(x), Twice(x), &found);
+ }
+ _t.End();
+
+ BOOST_CHECK(found);
+ BOOST_CHECK(n1 == n2);
+
+ // Pool level form.
+ int arg = 1;
+ BOOST_CHECK(LRUImpl::LRUPool::instance().GetOrCompute<int>(
+  0x5a, Twice(21), found, arg) == 42);
+ BOOST_CHECK(!found);
+ BOOST_CHECK(LRUImpl::LRUPool::instance().GetOrCompute<int>(
+  0x5a, Twice(0), found, arg) == 42);
+ BOOST_CHECK(found);
+}
+
+/**
+Worker thread to hammer a cache.
+*/
+template<typename Cache>
+struct CacheWorker
+{
+ CacheWorker(Cache& c, int l, int s) : cache(c), loops(l), seed(s)
+ {
+ }
+
+ void operator()()
+ {
+  for(int i = 0; i < loops; i++)
+  {
+   const int x = (i * 7 + seed) & 2047;
+   cache.GetOrCompute(boost::tuple<int>(x), Twice(x));
+  }
+ }
+
+ Cache& cache;
+ int loops;
+ int seed;
+};
+
+/**
+Run workers on a cache and return wall time elapsed.
+*/
+template<typename Cache>
+double RunCacheWorkers(Cache& cache, int threads, int loops)
+{
+ const boost::posix_time::ptime start = 
+  boost::posix_time::microsec_clock::universal_time();
+
+ boost::thread_group group;
+ for(int i = 0; i < threads; i++)
+  group.create_thread(CacheWorker<Cache>(cache, loops / threads, i));
+ group.join_all();
+
+ return (double)(boost::posix_time::microsec_clock::universal_time() - 
+                 start).total_microseconds() / 1000000.0;
+}
+
+/**
+Test ShardedLRU and benchmark thread scaling against single lock LRU.
+*/
+void TestShardedLRU()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > Cache;
+ typedef LRUImpl::ShardedLRU<boost::tuple<int>, int, 16, 4096> ShardedCache;
+
+ TimeReporter _t;
+ const int loops = 2000000;
+ bool found;
+
+ ShardedCache sc(64);
+
+ for(int i = 0; i < 1000; i++)
+  sc.Put(boost::tuple<int>(i), i);
+
+ std::vector<boost::tuple<int> > keys;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it(keys);
+ sc.GetKeys(it);
+
+ BOOST_CHECK(keys.size() == 64);
+ BOOST_CHECK(sc.Exists(keys[0]));
+ BOOST_CHECK(sc.Get(keys[0], NULL, &found) == boost::get<0>(keys[0]));
+ BOOST_CHECK(found);
+ BOOST_CHECK(sc.GetOrCompute(boost::tuple<int>(5000), Twice(5000)) == 10000);
+ BOOST_CHECK(sc.Exists(boost::tuple<int>(5000)));
+
+ for(int threads = 1; threads <= 8; threads *= 2)
+ {
+  Cache c;
+  ShardedCache s;
+  std::ostringstream os;
+
+  os << "Test single lock LRU, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(c, threads, loops));
+
+  os.str("");
+  os << "Test ShardedLRU, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(s, threads, loops));
+ }
+}
+
+/**
+Single-flight configuration.
+*/
+struct SingleFlightConfig : LRUImpl::LRUConfig
+{
+ static const bool SingleFlight = true;
+};
+
+boost::atomic<int> scoreCalls(0);
+
+LRU_DECL1(int, Score, int, id)
+LRU_CACHED_EX1(SingleFlightConfig, int, Score, int, id)
+{
+ ++scoreCalls;
+
+ // Expensive remote call.
+ boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+ if(id < 0)
+  throw std::invalid_argument("Negative id.");
+
+ return id * 10;
+}
+
+/**
+Worker thread to call Score concurrently.
+*/
+struct ScoreWorker
+{
+ ScoreWorker(boost::barrier& b, int i, int& r) : barrier(b), id(i), result(r)
+ {
+ }
+
+ void operator()()
+ {
+  barrier.wait();
+
+  try
+  {
+   result = Score(id);
+  }
+  catch(const std::invalid_argument&)
+  {
+   result = -1;
+  }
+ }
+
+ boost::barrier& barrier;
+ int id;
+ int& result;
+};
+
+/**
+Test concurrent misses of the same arguments are evaluated once.
+*/
+void TestSingleFlight()
+{
+ const int threads = 8;
+
+ for(int id = 7; id >= -7; id -= 14)
+ {
+  int results[threads];
+  boost::barrier barrier(threads);
+  boost::thread_group group;
+
+  scoreCalls = 0;
+
+  for(int i = 0; i < threads; i++)
+   group.create_thread(ScoreWorker(barrier, id, results[i]));
+  group.join_all();
+
+  BOOST_CHECK(scoreCalls == 1);
+  for(int i = 0; i < threads; i++)
+   BOOST_CHECK(results[i] == (id < 0 ? -1 : 70));
+ }
+
+ // Failure is not cached.
+ BOOST_CHECK_THROW(Score(-7), std::invalid_argument);
+ BOOST_CHECK(scoreCalls == 2);
+}
+
+/**
+Fill a cache to capacity, then look up hits and misses.
+*/
+template<typename Cache>
+void BenchmarkStorage(const char* name, const std::size_t capacity)
+{
+ TimeReporter _t;
+ const int loops = 4000000;
+ const int size = (int)capacity;
+ long long n = 0;
+ bool found;
+ std::ostringstream os;
+
+ Cache c(capacity);
+
+ os << "Test " << name << " fill " << capacity << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < size; i++)
+  c.Put(boost::tuple<int>(i), i);
+ _t.End();
+
+ os.str("");
+ os << "Test " << name << " hit " << capacity << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < loops; i++)
+  n += c.Get(boost::tuple<int>((int)((i * 2654435761U) % size)), NULL, &found);
+ _t.End();
+
+ BOOST_CHECK(found);
+
+ os.str("");
+ os << "Test " << name << " miss and evict " << capacity << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < loops; i++)
+  n += c.GetOrCompute(boost::tuple<int>(size + i), Twice(i));
+ _t.End();
+
+ BOOST_CHECK(n != 0);
+}
+
+/**
+Test FlatStorage against BimapStorage and benchmark both.
+*/
+void TestFlatStorage()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable
+ > BimapCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > FlatCache;
+
+ BimapCache bc(1000);
+ FlatCache fc(1000);
+ bool found1, found2;
+
+ std::srand(1);
+ for(int i = 0; i < 200000; i++)
+ {
+  const boost::tuple<int> k(std::rand() % 3000);
+
+  if(i & 1)
+  {
+   BOOST_CHECK(bc.Get(k, NULL, &found1) == fc.Get(k, NULL, &found2));
+   BOOST_CHECK(found1 == found2);
+  }
+  else
+  {
+   bc.Put(k, i);
+   fc.Put(k, i);
+  }
+ }
+
+ std::vector<boost::tuple<int> > keys1, keys2;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it1(keys1);
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it2(keys2);
+ bc.GetKeys(it1);
+ fc.GetKeys(it2);
+
+ BOOST_CHECK(keys1.size() == 1000);
+ BOOST_CHECK(keys1 == keys2);
+
+ BenchmarkStorage<BimapCache>("BimapStorage", 4096);
+ BenchmarkStorage<FlatCache>("FlatStorage", 4096);
+ BenchmarkStorage<BimapCache>("BimapStorage", 1 << 20);
+ BenchmarkStorage<FlatCache>("FlatStorage", 1 << 20);
+#ifdef LRU_TEST_LARGE
+ BenchmarkStorage<BimapCache>("BimapStorage", 1 << 24);
+ BenchmarkStorage<FlatCache>("FlatStorage", 1 << 24);
+#endif
+}
+
+/**
+Generate a Zipf distributed trace of keys in [0, n).
+*/
+void ZipfTrace(std::vector<int>& trace, int n, double alpha, int length)
+{
+ std::vector<double> cdf(n);
+ double sum = 0;
+
+ for(int i = 0; i < n; i++)
+  cdf[i] = (sum += 1.0 / std::pow((double)(i + 1), alpha));
+
+ boost::random::mt19937 gen(n);
+ boost::random::uniform_real_distribution<double> u(0, sum);
+
+ trace.resize(length);
+ for(int i = 0; i < length; i++)
+  trace[i] = (int)(std::lower_bound(cdf.begin(), cdf.end(), u(gen)) - 
+                   cdf.begin());
+}
+
+/**
+Replay trace on a cache and return hit ratio.
+*/
+template<typename Cache>
+double HitRatio(const std::vector<int>& trace, const std::size_t capacity)
+{
+ Cache c(capacity);
+ bool found;
+ int hits = 0;
+
+ for(std::size_t i = 0; i < trace.size(); i++)
+ {
+  c.GetOrCompute(boost::tuple<int>(trace[i]), Twice(trace[i]), &found);
+
+  if(found)
+   hits++;
+ }
+
+ return (double)hits / trace.size();
+}
+
+/**
+Test ClockEviction hit ratio against true LRU on Zipf traces and benchmark
+shared lock hits.
+*/
+void TestClockEviction()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > LRUCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > ClockCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<>
+ > LockedCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > SharedCache;
+
+ const double alphas[] = {0.7, 0.9, 1.1};
+ const std::size_t capacities[] = {100, 1000, 10000};
+ std::vector<int> trace;
+
+ for(int i = 0; i < 3; i++)
+ {
+  ZipfTrace(trace, 100000, alphas[i], 500000);
+
+  for(int j = 0; j < 3; j++)
+  {
+   const double lru = HitRatio<LRUCache>(trace, capacities[j]);
+   const double clock = HitRatio<ClockCache>(trace, capacities[j]);
+
+   BOOST_TEST_MESSAGE("Zipf " << alphas[i] << ", capacity " << 
+                      capacities[j] << ": LRU " << lru << ", CLOCK " << 
+                      clock << ".");
+   BOOST_CHECK(std::fabs(lru - clock) < 0.02);
+  }
+ }
+
+ ClockCache cc(2);
+ bool found;
+
+ cc.Put(boost::tuple<int>(1), 1);
+ cc.Put(boost::tuple<int>(2), 2);
+ cc.Get(boost::tuple<int>(1));
+ cc.Put(boost::tuple<int>(3), 3);
+
+ BOOST_CHECK(cc.Exists(boost::tuple<int>(1)));
+ BOOST_CHECK(!cc.Exists(boost::tuple<int>(2)));
+ BOOST_CHECK(cc.Get(boost::tuple<int>(3), NULL, &found) == 3 && found);
+
+ TimeReporter _t;
+ const int loops = 2000000;
+
+ for(int threads = 1; threads <= 8; threads *= 2)
+ {
+  LockedCache l;
+  SharedCache s;
+  std::ostringstream os;
+
+  os << "Test exclusive lock LRU, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(l, threads, loops));
+
+  os.str("");
+  os << "Test shared lock CLOCK, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(s, threads, loops));
+ }
+}
+
+/**
+Test BufferedEviction against LRUEviction and benchmark shared lock hits.
+*/
+void TestBufferedEviction()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > LRUCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::BufferedEviction<> >
+ > BufferedCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<>
+ > LockedCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::BufferedEviction<> >
+ > SharedCache;
+
+ // Hits are drained in order before writes, fewer hits than a buffer 
+ // holds between writes keep exact LRU order.
+ LRUCache lc(1000);
+ BufferedCache bc(1000);
+ bool found1, found2;
+
+ std::srand(1);
+ for(int i = 0; i < 200000; i++)
+ {
+  const int x = std::rand() % 3000;
+  const boost::tuple<int> k(x);
+
+  if(i % 8)
+  {
+   BOOST_CHECK(lc.GetOrCompute(k, Twice(x), &found1) == 
+               bc.GetOrCompute(k, Twice(x), &found2));
+   BOOST_CHECK(found1 == found2);
+  }
+  else
+  {
+   lc.Put(k, 2 * x);
+   bc.Put(k, 2 * x);
+  }
+ }
+
+ std::vector<boost::tuple<int> > keys1, keys2;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it1(keys1);
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it2(keys2);
+ lc.GetKeys(it1);
+ bc.GetKeys(it2);
+
+ BOOST_CHECK(keys1.size() == 1000);
+ BOOST_CHECK(keys1 == keys2);
+
+ // Many hits between writes drop some hits.
+ std::vector<int> trace;
+ ZipfTrace(trace, 100000, 1.1, 500000);
+
+ const double lru = HitRatio<LRUCache>(trace, 1000);
+ const double buffered = HitRatio<BufferedCache>(trace, 1000);
+
+ BOOST_TEST_MESSAGE("Zipf 1.1, capacity 1000: LRU " << lru << 
+                    ", buffered LRU " << buffered << ".");
+ BOOST_CHECK(std::fabs(lru - buffered) < 0.02);
+
+ TimeReporter _t;
+ const int loops = 2000000;
+
+ for(int threads = 1; threads <= 8; threads *= 2)
+ {
+  LockedCache l;
+  SharedCache s;
+  std::ostringstream os;
+
+  os << "Test exclusive lock LRU, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(l, threads, loops));
+
+  os.str("");
+  os << "Test shared lock buffered LRU, " << threads << " threads.";
+  _t.Start(os.str());
+  _t.End(RunCacheWorkers(s, threads, loops));
+
+  BOOST_CHECK(s.Get(boost::tuple<int>(7), NULL, &found1) == 14 && found1);
+ }
+}
+
+/**
+Test TinyLFUEviction hit ratio against LRU on traces with scans.
+*/
+void TestTinyLFUEviction()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > LRUCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::TinyLFUEviction>
+ > TinyLFUCache;
+
+ TinyLFUCache tc(100);
+
+ for(int i = 0; i < 1000; i++)
+  tc.Put(boost::tuple<int>(i % 300), i);
+
+ std::vector<boost::tuple<int> > keys;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it(keys);
+ tc.GetKeys(it);
+
+ BOOST_CHECK(keys.size() == 100);
+ for(std::size_t i = 0; i < keys.size(); i++)
+  BOOST_CHECK(tc.Exists(keys[i]));
+
+ // Hot keys interleaved with scans of keys never seen again.
+ std::vector<int> zipf, trace;
+ ZipfTrace(zipf, 10000, 0.9, 400000);
+
+ int scan = 1000000;
+ for(std::size_t i = 0; i < zipf.size(); i++)
+ {
+  trace.push_back(zipf[i]);
+
+  if(i % 1000 == 999)
+   for(int j = 0; j < 2000; j++)
+    trace.push_back(scan++);
+ }
+
+ const std::size_t capacities[] = {500, 2000};
+
+ for(int i = 0; i < 2; i++)
+ {
+  const double lru = HitRatio<LRUCache>(zipf, capacities[i]);
+  const double tinylfu = HitRatio<TinyLFUCache>(zipf, capacities[i]);
+  const double lruScan = HitRatio<LRUCache>(trace, capacities[i]);
+  const double tinylfuScan = HitRatio<TinyLFUCache>(trace, capacities[i]);
+
+  BOOST_TEST_MESSAGE("Zipf 0.9, capacity " << capacities[i] << ": LRU " << 
+                     lru << ", W-TinyLFU " << tinylfu << "; with scans: " << 
+                     "LRU " << lruScan << ", W-TinyLFU " << tinylfuScan << 
+                     ".");
+  BOOST_CHECK(tinylfu > lru);
+  BOOST_CHECK(tinylfuScan > lruScan * 1.3);
+ }
+}
+
+/**
+Check cache invariants under random puts and gets.
+*/
+template<typename Cache>
+void CheckEviction(const std::size_t capacity)
+{
+ Cache c(capacity);
+ bool found;
+
+ std::srand(1);
+ for(int i = 0; i < 100000; i++)
+ {
+  const int x = i % 3 ? std::rand() % (int)(capacity * 3) : std::rand();
+  const boost::tuple<int> k(x);
+
+  if(i & 1)
+  {
+   BOOST_CHECK(c.GetOrCompute(k, Twice(x), &found) == 2 * x);
+  }
+  else
+  {
+   c.Put(k, 2 * x);
+   BOOST_CHECK(c.Exists(k));
+  }
+ }
+
+ std::vector<boost::tuple<int> > keys;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it(keys);
+ c.GetKeys(it);
+
+ BOOST_CHECK(keys.size() == capacity);
+ for(std::size_t i = 0; i < keys.size(); i++)
+  BOOST_CHECK(c.Get(keys[i], NULL, &found) == 2 * boost::get<0>(keys[i]) && 
+              found);
+}
+
+/**
+Eviction policy configuration.
+*/
+struct ARCConfig : LRUImpl::LRUConfig
+{
+ typedef LRUImpl::FlatStorage<LRUImpl::ARCEviction> Storage;
+};
+
+LRU_DECL1(int, Cube, int, x)
+LRU_CACHED_EX1(ARCConfig, int, Cube, int, x)
+{
+ return x * x * x;
+}
+
+/**
+Test SLRU, 2Q and ARC eviction policies, compare hit ratios with LRU.
+*/
+void TestEvictionPolicies()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > LRUCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::SLRUEviction>
+ > SLRUCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::TwoQueueEviction>
+ > TwoQueueCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ARCEviction>
+ > ARCCache;
+
+ for(std::size_t capacity = 1; capacity <= 1000; capacity *= 10)
+ {
+  CheckEviction<SLRUCache>(capacity);
+  CheckEviction<TwoQueueCache>(capacity);
+  CheckEviction<ARCCache>(capacity);
+ }
+
+ for(int i = 0; i < 10; i++)
+  BOOST_CHECK(Cube(i) == i * i * i);
+
+ // Zipf, Zipf with scans, and loops slightly larger than cache.
+ std::vector<int> traces[3];
+ const char* names[] = {"Zipf 0.9", "Zipf 0.9 with scans", "loop"};
+
+ ZipfTrace(traces[0], 10000, 0.9, 400000);
+
+ int scan = 1000000;
+ for(std::size_t i = 0; i < traces[0].size(); i++)
+ {
+  traces[1].push_back(traces[0][i]);
+
+  if(i % 1000 == 999)
+   for(int j = 0; j < 2000; j++)
+    traces[1].push_back(scan++);
+ }
+
+ for(int i = 0; i < 400000; i++)
+  traces[2].push_back(i % 1200);
+
+ double ratios[3][4];
+
+ for(int i = 0; i < 3; i++)
+ {
+  ratios[i][0] = HitRatio<LRUCache>(traces[i], 1000);
+  ratios[i][1] = HitRatio<SLRUCache>(traces[i], 1000);
+  ratios[i][2] = HitRatio<TwoQueueCache>(traces[i], 1000);
+  ratios[i][3] = HitRatio<ARCCache>(traces[i], 1000);
+
+  BOOST_TEST_MESSAGE(names[i] << ", capacity 1000: LRU " << ratios[i][0] << 
+                     ", SLRU " << ratios[i][1] << ", 2Q " << ratios[i][2] << 
+                     ", ARC " << ratios[i][3] << ".");
+ }
+
+ for(int j = 1; j < 4; j++)
+  BOOST_CHECK(ratios[0][j] > ratios[0][0]);
+
+ // Scans flush A1out of 2Q, T1 + B1 of ARC is bounded by capacity in loops.
+ BOOST_CHECK(ratios[1][1] > ratios[1][0] * 1.3);
+ BOOST_CHECK(ratios[1][3] > ratios[1][0] * 1.3);
+ BOOST_CHECK(ratios[2][0] == 0);
+ BOOST_CHECK(ratios[2][2] > 0.5);
+}
+
+/**
+Check weight bound of cache with vector values.
+*/
+template<typename Cache>
+void CheckWeight()
+{
+ typedef LRUImpl::LRUWeigher<boost::tuple<int> > KeyWeigher;
+ typedef LRUImpl::LRUWeigher<std::vector<char> > ValueWeigher;
+
+ Cache c(1000);
+ c.MaxWeight(1 << 20);
+
+ std::srand(1);
+ for(int i = 0; i < 1000; i++)
+ {
+  const boost::tuple<int> k(std::rand() % 100);
+  c.Put(k, std::vector<char>(std::rand() % (100 << 10)));
+
+  BOOST_CHECK(c.Weight() <= 1 << 20);
+ }
+
+ std::vector<boost::tuple<int> > keys;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it(keys);
+ c.GetKeys(it);
+
+ std::size_t weight = 0;
+ for(std::size_t i = 0; i < keys.size(); i++)
+  weight += KeyWeigher::Weight(keys[i]) + ValueWeigher::Weight(c.Get(keys[i]));
+
+ BOOST_CHECK(weight == c.Weight());
+ BOOST_CHECK(keys.size() > 10 && keys.size() < 100);
+
+ keys.clear();
+ c.GetKeys(it);
+
+ // Too heavy to cache, the others are kept.
+ c.Put(boost::tuple<int>(-1), std::vector<char>(2 << 20));
+
+ BOOST_CHECK(!c.Exists(boost::tuple<int>(-1)));
+ BOOST_CHECK(c.Exists(keys[0]));
+
+ // Lower bound purges least-recently-used records.
+ c.MaxWeight(weight / 2);
+
+ BOOST_CHECK(c.Weight() <= weight / 2);
+ BOOST_CHECK(c.Exists(keys[0]));
+ BOOST_CHECK(!c.Exists(keys[keys.size() - 1]));
+}
+
+/**
+Weight bounded configuration.
+*/
+struct WeightConfig : LRUImpl::LRUConfig
+{
+ static const std::size_t MaxWeight = 1 << 16;
+};
+
+LRU_DECL1(std::string, Repeat, int, n)
+LRU_CACHED_EX1(WeightConfig, std::string, Repeat, int, n)
+{
+ return std::string(n, 'x');
+}
+
+/**
+Test weight-bounded caches.
+*/
+void TestWeigher()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, std::vector<char>, 4096, LRUImpl::DefaultNullLockable
+ > BimapCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, std::vector<char>, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > FlatCache;
+
+ std::vector<std::string> strings(2, std::string(100, 'x'));
+
+ BOOST_CHECK(LRUImpl::LRUWeigher<int>::Weight(1) == sizeof(int));
+ BOOST_CHECK(LRUImpl::LRUWeigher<std::string>::Weight(strings[0]) >= 100);
+ BOOST_CHECK(LRUImpl::LRUWeigher<std::vector<int> >::Weight(
+              std::vector<int>(100)) >= 100 * sizeof(int));
+ BOOST_CHECK(LRUImpl::LRUWeigher<std::vector<std::string> >::Weight(
+              strings) >= 200);
+
+ CheckWeight<BimapCache>();
+ CheckWeight<FlatCache>();
+
+ for(int i = 0; i < 100; i++)
+  BOOST_CHECK(Repeat(i * 100).size() == (std::size_t)i * 100);
+}
+
+/**
+Record expired timers of TimerWheel.
+*/
+struct TimerRecorder
+{
+ TimerRecorder(std::vector<boost::uint32_t>& f, boost::uint32_t& n) : 
+  fired(f), now(n)
+ {
+ }
+
+ void operator()(const int& k, const boost::uint32_t deadline)
+ {
+  BOOST_CHECK(!LRUImpl::TimerWheel<int>::Before(now, deadline));
+  fired[k] = now;
+ }
+
+ std::vector<boost::uint32_t>& fired;
+ boost::uint32_t& now;
+};
+
+/**
+Count expired timers of TimerWheel.
+*/
+struct TimerCounter
+{
+ TimerCounter() : n(0)
+ {
+ }
+
+ void operator()(const int&, const boost::uint32_t)
+ {
+  n++;
+ }
+
+ std::size_t n;
+};
+
+/// Simulated time of expiry tests, in milliseconds.
+boost::uint32_t simulatedTime = 0xffffff00;
+
+/**
+Clock of expiry tests, time only goes on when a test moves it.
+*/
+struct SimulatedClock
+{
+ static boost::uint32_t Now()
+ {
+  return simulatedTime;
+ }
+};
+
+/**
+Check expiry of cache, time is simulated and crosses wrapping around.
+*/
+template<typename Cache>
+void CheckExpiry()
+{
+ const boost::tuple<int> k(1);
+ bool found;
+
+ // Expire after write.
+ Cache c(1000);
+ c.Clock(&SimulatedClock::Now);
+ c.Expire(100);
+ c.Put(k, 1);
+
+ simulatedTime += 99;
+ BOOST_CHECK(c.Get(k, NULL, &found) == 1 && found);
+ simulatedTime += 1;
+ c.Get(k, NULL, &found);
+ BOOST_CHECK(!found);
+
+ // Own time to live.
+ c.Put(k, 2, 1000);
+ c.Put(boost::tuple<int>(2), 2);
+ simulatedTime += 150;
+ BOOST_CHECK(c.Get(k, NULL, &found) == 2 && found);
+ c.Get(boost::tuple<int>(2), NULL, &found);
+ BOOST_CHECK(!found);
+
+ // Expire after access.
+ Cache a(1000);
+ a.Clock(&SimulatedClock::Now);
+ a.Expire(100, true);
+ a.Put(k, 3);
+
+ for(int i = 0; i < 5; i++)
+ {
+  simulatedTime += 99;
+  BOOST_CHECK(a.GetOrCompute(k, Twice(1), &found) == 3 && found);
+ }
+
+ simulatedTime += 100;
+ BOOST_CHECK(a.GetOrCompute(k, Twice(1), &found) == 2 && !found);
+
+ // Timers reclaim expired records on write.
+ Cache r(1000);
+ r.Clock(&SimulatedClock::Now);
+ r.Expire(50);
+
+ for(int i = 0; i < 100; i++)
+  r.Put(boost::tuple<int>(i), i);
+
+ simulatedTime += 100;
+ r.Put(boost::tuple<int>(-1), -1);
+
+ std::vector<boost::tuple<int> > keys;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it(keys);
+ r.GetKeys(it);
+
+ BOOST_CHECK(keys.size() == 1);
+}
+
+/**
+Expiring configuration.
+*/
+struct ExpiryConfig : LRUImpl::LRUConfig
+{
+ static const std::size_t TTL = 100;
+
+ typedef SimulatedClock Clock;
+};
+
+int clockCalls = 0;
+
+LRU_DECL1(int, Clock, int, x)
+LRU_CACHED_EX1(ExpiryConfig, int, Clock, int, x)
+{
+ return x + clockCalls++;
+}
+
+/**
+Test TimerWheel and expiry of records.
+*/
+void TestExpiry()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > BimapCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > FlatCache;
+
+ // Timers fire at their deadline, across wrapping around of time too.
+ const boost::uint32_t starts[] = {0, 0xfffff000};
+
+ for(int s = 0; s < 2; s++)
+ {
+  boost::uint32_t now = starts[s];
+  LRUImpl::TimerWheel<int> wheel(now);
+  std::vector<boost::uint32_t> deadlines, fired(10000, 0);
+  TimerRecorder recorder(fired, now);
+
+  std::srand(1);
+  for(int i = 0; i < 10000; i++)
+  {
+   const boost::uint32_t delay = i < 10 ? 
+    (1u << 25) + i : (boost::uint32_t)std::rand() % (1u << (i % 22));
+
+   deadlines.push_back(now + delay);
+   wheel.Schedule(i, now + delay);
+  }
+
+  while(wheel.Size())
+  {
+   now += std::rand() % 5000;
+   wheel.Advance(now, recorder);
+  }
+
+  bool exact = true;
+  for(int i = 0; i < 10000; i++)
+   exact = exact && fired[i] - deadlines[i] < 5000;
+
+  BOOST_CHECK(exact);
+ }
+
+ // Idle time is jumped over, an idle hour and then a month (over 2^31 
+ // milliseconds) at once.
+ {
+  const boost::uint32_t now = 0x7ffff000;
+  LRUImpl::TimerWheel<int> wheel(now);
+  TimerCounter counter;
+
+  for(int i = 0; i < 100; i++)
+   wheel.Schedule(i, now + i * 60000);
+
+  // Time of a caller that waited is ignored.
+  wheel.Advance(now - 10, counter);
+  BOOST_CHECK(counter.n == 0 && wheel.Size() == 100);
+
+  wheel.Advance(now + 3600000, counter);
+  BOOST_CHECK(counter.n == 61 && wheel.Size() == 39);
+
+  // Timer past the span waits until its deadline.
+  wheel.Schedule(100, now + 3600000 + (1u << 30));
+  wheel.Advance(now + 3600000 + (1u << 29), counter);
+  BOOST_CHECK(counter.n == 100 && wheel.Size() == 1);
+
+  wheel.Advance(now + 3600000 + (1u << 29) + 0x90000000u, counter);
+  BOOST_CHECK(counter.n == 101 && wheel.Size() == 0);
+ }
+
+ CheckExpiry<BimapCache>();
+ CheckExpiry<FlatCache>();
+
+ BOOST_CHECK(Clock(1) == 1);
+ simulatedTime += 99;
+ BOOST_CHECK(Clock(1) == 1);
+ simulatedTime += 1;
+ BOOST_CHECK(Clock(1) == 2 && clockCalls == 2);
+}
+
+/**
+Refreshing configuration.
+*/
+struct RefreshConfig : LRUImpl::LRUConfig
+{
+ static const std::size_t RefreshAfter = 50;
+};
+
+boost::atomic<int> quoteCalls(0);
+
+LRU_DECL1(int, Quote, int, x)
+LRU_CACHED_EX1(RefreshConfig, int, Quote, int, x)
+{
+ return x * 100 + ++quoteCalls;
+}
+
+/**
+Test refresh of stale records while they are served.
+*/
+void TestRefresh()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > Cache;
+
+ const boost::tuple<int> k(1);
+ bool found, stale;
+
+ Cache c(16);
+ c.RefreshAfter(50, 0);
+ c.Put(k, 1);
+
+ BOOST_CHECK(c.Acquire(k, found, NULL, &stale) == 1 && found && !stale);
+
+ boost::this_thread::sleep(boost::posix_time::milliseconds(80));
+
+ // Only one caller refreshes, stale value is served meanwhile.
+ BOOST_CHECK(c.Acquire(k, found, NULL, &stale) == 1 && found && stale);
+ BOOST_CHECK(c.Acquire(k, found, NULL, &stale) == 1 && found && !stale);
+
+ // Failed refresh is reported again.
+ c.Refresh(k, NULL);
+ BOOST_CHECK(c.Acquire(k, found, NULL, &stale) == 1 && found && stale);
+
+ const int v = 2;
+ c.Refresh(k, &v);
+ BOOST_CHECK(c.Acquire(k, found, NULL, &stale) == 2 && found && !stale);
+
+ // Records evaluated slowly are refreshed earlier at random.
+ Cache x(1024);
+ x.RefreshAfter(1000, 1);
+
+ for(int i = 0; i < 1000; i++)
+  x.Complete(boost::tuple<int>(i), i, NULL, 1000);
+
+ int early = 0;
+ for(int i = 0; i < 1000; i++)
+ {
+  x.Acquire(boost::tuple<int>(i), found, NULL, &stale);
+  early += stale;
+ }
+
+ // P(-log(u) >= 1) = 1/e.
+ BOOST_CHECK(early > 250 && early < 500);
+
+ // Decorated function returns stale result and refreshes it.
+ const int first = Quote(1);
+ BOOST_CHECK(first == 101 && Quote(1) == first);
+
+ boost::this_thread::sleep(boost::posix_time::milliseconds(80));
+
+ // Stale result is returned at once, refreshed by workers.
+ int r = Quote(1);
+ BOOST_CHECK(r == first);
+
+ for(int i = 0; i < 100 && r == first; i++)
+ {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  r = Quote(1);
+ }
+
+ BOOST_CHECK(r == 102 && quoteCalls == 2);
+}
+
+boost::atomic<int> fetchCalls(0);
+
+LRU_DECL1(int, Fetch, int, x)
+LRU_CACHED_ASYNC1(int, Fetch, int, x)
+{
+ ++fetchCalls;
+
+ boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+ if(x < 0)
+  throw std::invalid_argument("Fetch");
+
+ return x * 2;
+}
+
+/**
+Task keeping its promise after a while.
+*/
+struct Promised
+{
+ Promised(const boost::shared_ptr<boost::promise<int> >& p, const int v) : 
+  promise(p), value(v)
+ {
+ }
+
+ void operator()()
+ {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  promise->set_value(value);
+ }
+
+ boost::shared_ptr<boost::promise<int> > promise;
+ int value;
+};
+
+/**
+Test asynchronous cached functions.
+*/
+void TestAsync()
+{
+ // Concurrent callers share the in-flight future.
+ boost::shared_future<int> a = Fetch(1);
+ boost::shared_future<int> b = Fetch(1);
+
+ // Miss does not block.
+ BOOST_CHECK(!a.is_ready());
+
+ BOOST_CHECK(a.get() == 2 && b.get() == 2 && fetchCalls == 1);
+
+ // Ready on hit.
+ BOOST_CHECK(Fetch(1).is_ready() && Fetch(1).get() == 2 && fetchCalls == 1);
+
+ // Failure is not cached.
+ for(int i = 1; i <= 2; i++)
+ {
+  bool thrown = false;
+
+  try
+  {
+   Fetch(-1).get();
+  }
+  catch(const std::invalid_argument&)
+  {
+   thrown = true;
+  }
+
+  BOOST_CHECK(thrown && fetchCalls == 1 + i);
+ }
+
+ // Evaluated but not cached while pool is disabled.
+ LRUImpl::LRUPool::instance().Configure(0);
+ BOOST_CHECK(Fetch(3).get() == 6 && Fetch(3).get() == 6 && fetchCalls == 5);
+
+ LRUImpl::LRUPool::instance().Configure(LRU_DEFAULT_CAPACITY);
+ BOOST_CHECK(Fetch(1).get() == 2 && fetchCalls == 5);
+
+ // Pool destroyed with queued tasks runs them, promises are kept.
+ std::vector<boost::shared_future<int> > futures;
+ {
+  LRUImpl::WorkerPool pool(1, 16);
+
+  for(int i = 0; i < 10; i++)
+  {
+   const boost::shared_ptr<boost::promise<int> > p(
+    new boost::promise<int>());
+
+   futures.push_back(boost::shared_future<int>(p->get_future()));
+   BOOST_CHECK(pool.Submit(Promised(p, i)));
+  }
+ }
+
+ bool kept = true;
+ for(int i = 0; i < 10; i++)
+ {
+  try
+  {
+   kept = kept && futures[i].is_ready() && futures[i].get() == i;
+  }
+  catch(const boost::broken_promise&)
+  {
+   kept = false;
+  }
+ }
+
+ BOOST_CHECK(kept);
+}
+
+/**
+Check batches against single gets.
+*/
+template<typename Cache>
+void CheckBatch()
+{
+ typedef boost::tuple<int> Key;
+
+ Cache c(1000);
+ std::vector<Key> keys;
+ std::vector<int> values, results;
+ std::vector<bool> found;
+
+ for(int i = 0; i < 1500; i++)
+ {
+  keys.push_back(Key(i));
+  values.push_back(i * 3);
+ }
+
+ c.PutMany(keys, values);
+
+ std::reverse(keys.begin(), keys.end());
+
+ const std::size_t hits = c.GetMany(keys, results, &found);
+
+ bool same = results.size() == keys.size() && found.size() == keys.size();
+ std::size_t n = 0;
+
+ for(std::size_t i = 0; same && i < keys.size(); i++)
+ {
+  same = found[i] ? results[i] == keys[i].get<0>() * 3 : results[i] == 0;
+  n += found[i];
+ }
+
+ BOOST_CHECK(same && hits == n && hits == 1000);
+}
+
+/**
+Look up a filled cache in batches.
+*/
+template<typename Cache>
+void BenchmarkBatch(const char* name, const std::size_t batch)
+{
+ typedef boost::tuple<int> Key;
+
+ TimeReporter _t;
+ const int capacity = 1 << 20;
+ const int loops = 4000000;
+ std::vector<Key> keys;
+ std::vector<int> values;
+ std::size_t hits = 0;
+ std::ostringstream os;
+
+ Cache c(capacity);
+
+ for(int i = 0; i < capacity; i++)
+ {
+  keys.push_back(Key(i));
+  values.push_back(i);
+ }
+
+ c.PutMany(keys, values);
+
+ std::vector<Key> batches(batch);
+ std::vector<bool> found;
+
+ os << "Test " << name << " GetMany batch " << batch << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < loops; i += (int)batch)
+ {
+  for(std::size_t j = 0; j < batch; j++)
+   batches[j] = Key((int)(((i + j) * 2654435761U) % capacity));
+
+  hits += c.GetMany(batches, values, &found);
+ }
+ _t.End();
+
+ BOOST_CHECK(hits >= (std::size_t)loops);
+}
+
+/**
+Test GetMany and PutMany, and benchmark batch sizes.
+*/
+void TestBatch()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > BimapCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<>
+ > FlatCache;
+ typedef LRUImpl::ShardedLRU<
+  boost::tuple<int>, int, 4, 4096, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<>
+ > ShardedCache;
+
+ CheckBatch<BimapCache>();
+ CheckBatch<FlatCache>();
+
+ // Shards are filled unevenly, just check results.
+ ShardedCache s(4000);
+ std::vector<boost::tuple<int> > keys;
+ std::vector<int> values, results;
+ std::vector<bool> found;
+
+ for(int i = 0; i < 100; i++)
+ {
+  keys.push_back(boost::make_tuple(i));
+  values.push_back(-i);
+ }
+
+ s.PutMany(keys, values);
+ keys.push_back(boost::make_tuple(100));
+
+ BOOST_CHECK(s.GetMany(keys, results, &found) == 100);
+ BOOST_CHECK(std::equal(values.begin(), values.end(), results.begin()));
+ BOOST_CHECK(!found[100] && results[100] == 0);
+
+ // Pool batch.
+ LRUImpl::LRUPool::instance().PutMany(0x7e57, keys, results);
+ BOOST_CHECK(LRUImpl::LRUPool::instance().GetMany(0x7e57, keys, values) == 
+             101);
+ BOOST_CHECK(values == results);
+
+ const std::size_t batches[] = {1, 16, 256, 4096};
+
+ for(int i = 0; i < 4; i++)
+  BenchmarkBatch<FlatCache>("FlatStorage", batches[i]);
+}
+
+LRU_DECL1(int, Half, int, x)
+LRU_CACHED1(int, Half, int, x)
+{
+ return x / 2;
+}
+
+/**
+Test statistics of caches.
+*/
+void TestStats()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > Cache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > FlatCache;
+ typedef LRUImpl::ShardedLRU<boost::tuple<int>, int, 4, 4096> ShardedCache;
+
+ bool found;
+
+ Cache c(2);
+ c.Put(boost::make_tuple(1), 1);
+ c.Put(boost::make_tuple(2), 2);
+ c.Get(boost::make_tuple(1));
+ c.Get(boost::make_tuple(3));
+ c.GetOrCompute(boost::make_tuple(3), Twice(3));
+
+ LRUImpl::LRUStats s = c.Stats();
+
+ BOOST_CHECK(s.hits == 1 && s.misses == 2 && s.inserts == 3 && 
+             s.evictions == 1 && s.size == 2);
+ BOOST_CHECK(s.HitRate() > 0.33 && s.HitRate() < 0.34);
+
+ // Counters are exact under concurrent hits.
+ FlatCache f(4096);
+ RunCacheWorkers(f, 4, 400000);
+ s = f.Stats();
+
+ BOOST_CHECK(s.hits + s.misses == 400000 && s.inserts == 2048 && 
+             s.size == 2048);
+
+ ShardedCache sc(4096);
+ RunCacheWorkers(sc, 4, 400000);
+ s = sc.Stats();
+
+ BOOST_CHECK(s.hits + s.misses == 400000 && s.size == 2048);
+
+ // Pool enumerates caches of decorated functions by name.
+ for(int i = 0; i < 10; i++)
+  Half(i % 4);
+
+ std::vector<std::pair<std::string, LRUImpl::LRUStats> > stats;
+ std::back_insert_iterator<
+  std::vector<std::pair<std::string, LRUImpl::LRUStats> > 
+ > it(stats);
+ LRUImpl::LRUPool::instance().GetStats(it);
+
+ found = false;
+ for(std::size_t i = 0; i < stats.size(); i++)
+ {
+  if(stats[i].first == "Half")
+  {
+   found = true;
+   BOOST_CHECK(stats[i].second.hits == 6 && stats[i].second.misses == 4);
+  }
+ }
+
+ BOOST_CHECK(found);
+}
+
+struct LatencyConfig : LRUImpl::LRUConfig
+{
+ static const bool Latency = true;
+};
+
+LRU_DECL1(int, Slow, int, x)
+LRU_CACHED_EX1(LatencyConfig, int, Slow, int, x)
+{
+ boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+ return x;
+}
+
+/**
+Test latency histograms.
+*/
+void TestLatency()
+{
+ typedef LRUImpl::LatencyHistogram<> Histogram;
+
+ // Buckets are exact below 8, upper bounds cover their latencies.
+ for(boost::uint64_t v = 0; v < 8; v++)
+  BOOST_CHECK(Histogram::Bucket(v) == v && Histogram::Highest(v) == v);
+
+ for(boost::uint64_t v = 8; v < 100000; v += v / 7 + 1)
+ {
+  const std::size_t b = Histogram::Bucket(v);
+
+  BOOST_CHECK(Histogram::Highest(b) >= v);
+  BOOST_CHECK(Histogram::Highest(b) - v <= v / 8);
+  BOOST_CHECK(b == 0 || Histogram::Highest(b - 1) < v);
+ }
+
+ BOOST_CHECK(Histogram::Bucket(~0ULL) == Histogram::Buckets - 1);
+
+ Histogram h;
+ BOOST_CHECK(h.Percentile(0.5) == 0);
+
+ for(boost::uint64_t v = 1; v <= 1000; v++)
+  h.Record(v);
+
+ const LRUImpl::LatencySummary s = h.Summarize();
+
+ BOOST_CHECK(s.count == 1000);
+ BOOST_CHECK(s.p50 >= 500 && s.p50 <= 500 + 500 / 8);
+ BOOST_CHECK(s.p99 >= 990 && s.p99 <= 990 + 990 / 8);
+ BOOST_CHECK(s.p999 >= 999 && s.p999 <= 999 + 999 / 8);
+
+ // Misses are evaluated in 2ms, hits are not.
+ for(int i = 0; i < 20; i++)
+  Slow(i % 2);
+
+ std::vector<std::pair<std::string, LRUImpl::LRULatencyStats> > stats;
+ std::back_insert_iterator<
+  std::vector<std::pair<std::string, LRUImpl::LRULatencyStats> > 
+ > it(stats);
+ LRUImpl::LRUPool::instance().GetLatency(it);
+
+ bool found = false;
+ for(std::size_t i = 0; i < stats.size(); i++)
+ {
+  // Only caches configured to record latency are listed.
+  BOOST_CHECK(stats[i].first == "Slow");
+
+  if(stats[i].first == "Slow")
+  {
+   found = true;
+   BOOST_CHECK(stats[i].second.lookup.count == 20);
+   BOOST_CHECK(stats[i].second.load.count == 2);
+   BOOST_CHECK(stats[i].second.load.p50 >= 2000000);
+  }
+ }
+
+ BOOST_CHECK(found);
+}
+
+LRU_DECL1(int, Cycle, int, x)
+LRU_CACHED1(int, Cycle, int, x)
+{
+ return x + 1;
+}
+
+/**
+Obtain statistics of cache of a decorated function.
+
+@param name Function name.
+@return Statistics.
+*/
+LRUImpl::LRUStats StatsOf(const std::string& name)
+{
+ std::vector<std::pair<std::string, LRUImpl::LRUStats> > stats;
+ std::back_insert_iterator<
+  std::vector<std::pair<std::string, LRUImpl::LRUStats> > 
+ > it(stats);
+ LRUImpl::LRUPool::instance().GetStats(it);
+
+ for(std::size_t i = 0; i < stats.size(); i++)
+  if(stats[i].first == name)
+   return stats[i].second;
+
+ return LRUImpl::LRUStats();
+}
+
+/**
+Test resize, ghosts and pool budget.
+*/
+void TestBudget()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > Cache;
+
+ bool found;
+
+ // Shrinking purges least-recently-used records.
+ Cache c(100);
+ for(int i = 0; i < 100; i++)
+  c.Put(boost::make_tuple(i), i);
+
+ c.Resize(10);
+ while(c.Trim());
+ BOOST_CHECK(c.Capacity() == 10 && c.Stats().size == 10);
+
+ c.Get(boost::make_tuple(99), NULL, &found);
+ BOOST_CHECK(found);
+ c.Get(boost::make_tuple(89), NULL, &found);
+ BOOST_CHECK(!found);
+
+ // Cycling over 15 keys misses on keys purged 5 misses ago, most of them 
+ // are still ghosts.
+ c.Ghosts(10);
+ for(int i = 0; i < 45; i++)
+ {
+  c.Get(boost::make_tuple(i % 15), NULL, &found);
+  if(!found)
+   c.Put(boost::make_tuple(i % 15), i);
+ }
+
+ LRUImpl::LRUStats s = c.Stats();
+ BOOST_CHECK(s.ghostHits >= 15 && s.ghostHits <= s.misses);
+
+ // Grown cache holds the cycle.
+ c.Resize(15);
+ for(int i = 0; i < 45; i++)
+ {
+  c.Get(boost::make_tuple(i % 15), NULL, &found);
+  if(!found)
+   c.Put(boost::make_tuple(i % 15), i);
+ }
+
+ BOOST_CHECK(c.Stats().misses - s.misses <= 5);
+
+ // Cycle thrashes over 120 keys, other caches have flat hit curves, 
+ // registered here too when the test runs alone.
+ LRUImpl::_LRUPool& pool = LRUImpl::LRUPool::instance();
+
+ Cycle(0);
+ Square(0);
+ Half(0);
+
+ std::vector<std::pair<std::string, LRUImpl::LRUStats> > stats;
+ std::back_insert_iterator<
+  std::vector<std::pair<std::string, LRUImpl::LRUStats> > 
+ > it(stats);
+ pool.GetStats(it);
+
+ const std::size_t budget = 100 * stats.size();
+ pool.Budget(budget, 0);
+
+ s = StatsOf("Cycle");
+ BOOST_CHECK(s.capacity >= 100 && s.capacity < 110);
+
+ for(int r = 0; r < 10; r++)
+ {
+  for(int i = 0; i < 360; i++)
+   Cycle(i % 120);
+
+  pool.Rebalance();
+ }
+
+ s = StatsOf("Cycle");
+ BOOST_CHECK(s.capacity >= 120);
+
+ for(int i = 0; i < 360; i++)
+  Cycle(i % 120);
+
+ BOOST_CHECK(StatsOf("Cycle").hits - s.hits > 240);
+
+ // Budget is kept.
+ std::size_t total = 0;
+
+ stats.clear();
+ pool.GetStats(it);
+ for(std::size_t i = 0; i < stats.size(); i++)
+  total += stats[i].second.capacity;
+
+ BOOST_CHECK(total <= budget + 4 * stats.size());
+
+ // Caches get capacity of pool back.
+ pool.Budget(0);
+ BOOST_CHECK(StatsOf("Cycle").capacity >= LRU_DEFAULT_CAPACITY);
+}
+
+struct SampleConfig : LRUImpl::LRUConfig
+{
+ static const std::size_t SampleRate = 4;
+};
+
+LRU_DECL1(int, Sampled, int, x)
+LRU_CACHED_EX1(SampleConfig, int, Sampled, int, x)
+{
+ return x - 1;
+}
+
+/**
+Test estimation of hit ratios by sampled reuse distances.
+*/
+void TestCurve()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelLockable
+ > Cache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > FlatCache;
+
+ bool found;
+
+ // Cycling over 1000 keys, every key is sampled: distances are 999.
+ Cache c(500);
+ c.Sample(1);
+
+ for(int i = 0; i < 5000; i++)
+ {
+  c.Get(boost::make_tuple(i % 1000), NULL, &found);
+  if(!found)
+   c.Put(boost::make_tuple(i % 1000), i);
+ }
+
+ BOOST_CHECK(c.Stats().hits == 0);
+ BOOST_CHECK(c.HitRatio(500) == 0);
+ BOOST_CHECK(c.HitRatio(900) == 0);
+ BOOST_CHECK(std::fabs(c.HitRatio(2000) - 0.8) < 0.001);
+ BOOST_CHECK(std::fabs(c.HitRatio(5000) - 0.8) < 0.001);
+
+ // Uniform keys, one of 10 sampled: hit ratio is about capacity / keys.
+ FlatCache f(1000);
+ f.Sample(10);
+
+ boost::random::mt19937 gen(7);
+ boost::random::uniform_real_distribution<double> u(0, 2000);
+
+ for(int i = 0; i < 200000; i++)
+ {
+  const int k = (int)u(gen);
+
+  f.Get(boost::make_tuple(k), NULL, &found);
+  if(!found)
+   f.Put(boost::make_tuple(k), k);
+ }
+
+ const LRUImpl::LRUStats s = f.Stats();
+
+ BOOST_CHECK(std::fabs(f.HitRatio(1000) - s.HitRate()) < 0.1);
+ BOOST_CHECK(std::fabs(f.HitRatio(500) - 0.25) < 0.1);
+ BOOST_CHECK(f.HitRatio(4000) > 0.95);
+
+ BOOST_CHECK(s.curve.size() == LRUImpl::LRUStats::CurvePoints);
+ BOOST_CHECK(s.curve.front().first == 100 && s.curve[6].first == 1000 && 
+             s.curve.back().first == 10000);
+
+ for(std::size_t i = 1; i < s.curve.size(); i++)
+  BOOST_CHECK(s.curve[i].second >= s.curve[i - 1].second);
+
+ // Not sampled.
+ f.Sample(0);
+ BOOST_CHECK(f.HitRatio(1000) == 0 && f.Stats().curve.empty());
+
+ // Pool samples caches configured to.
+ for(int i = 0; i < 1000; i++)
+  Sampled(i % 100);
+
+ const LRUImpl::LRUStats p = StatsOf("Sampled");
+
+ BOOST_CHECK(p.curve.size() == LRUImpl::LRUStats::CurvePoints);
+ BOOST_CHECK(p.curve.back().second > 0.8);
+}
+
+/**
+Check incremental shrinking and growth of cache.
+*/
+template<typename Cache>
+void CheckResize()
+{
+ bool found;
+
+ Cache c(100);
+ for(int i = 0; i < 100; i++)
+  c.Put(boost::make_tuple(i), i);
+
+ // Growth keeps records, index is migrated while inserting.
+ c.Resize(20000);
+ for(int i = 100; i < 20000; i++)
+ {
+  c.Put(boost::make_tuple(i), i);
+
+  // Erased while index is migrated.
+  if(i % 100 == 0)
+   c.Erase(boost::make_tuple(i / 100));
+ }
+
+ std::size_t n = 0;
+ for(int i = 0; i < 20000; i++)
+ {
+  const int v = c.Get(boost::make_tuple(i), NULL, &found);
+  if(found && v == i)
+   n++;
+ }
+
+ BOOST_CHECK(c.Capacity() == 20000);
+ BOOST_CHECK(n == 20000 - 199 && c.Stats().size == n);
+
+ // Shrinking purges a step at a time.
+ c.Resize(1000);
+ BOOST_CHECK(c.Stats().size == n - Cache::TrimStep);
+
+ c.Put(boost::make_tuple(-1), -1);
+ BOOST_CHECK(c.Stats().size == n - 2 * Cache::TrimStep + 1);
+
+ const std::size_t over = c.Stats().size - 1000;
+
+ std::size_t steps = 0;
+ while(c.Trim(1000))
+  steps++;
+
+ BOOST_CHECK(steps == (over - 1) / 1000);
+ BOOST_CHECK(c.Stats().size == 1000 && !c.Trim());
+
+ // Shrunk storage grows again.
+ c.Resize(5000);
+ for(int i = 0; i < 5000; i++)
+  c.Put(boost::make_tuple(i), i);
+
+ BOOST_CHECK(c.Stats().size == 5000);
+
+ // Disabling clears cache at once.
+ c.Resize(0);
+ BOOST_CHECK(c.Stats().size == 0);
+
+ // The only record, just inserted, is purged too.
+ c.Resize(1);
+ c.Put(boost::make_tuple(1), 1);
+ c.Put(boost::make_tuple(2), 2);
+ c.Resize(0);
+ BOOST_CHECK(c.Stats().size == 0);
+
+ c.Put(boost::make_tuple(3), 3);
+ c.Get(boost::make_tuple(3), NULL, &found);
+ BOOST_CHECK(!found && c.Stats().size == 0);
+}
+
+/**
+Check ghosts of eviction policy follow capacity: a key purged after 
+growing, older than ghosts of the old capacity, is still reused and 
+survives a scan.
+*/
+template<typename Cache>
+void CheckGhosts()
+{
+ Cache c(10);
+ c.Resize(1000);
+
+ for(int i = 0; i < 1200; i++)
+ {
+  c.Put(boost::make_tuple(i), i);
+  c.Get(boost::make_tuple(i));
+ }
+
+ BOOST_CHECK(!c.Exists(boost::make_tuple(0)));
+ c.Put(boost::make_tuple(0), 0);
+
+ for(int i = 1200; i < 3200; i++)
+  c.Put(boost::make_tuple(i), i);
+
+ BOOST_CHECK(c.Exists(boost::make_tuple(0)));
+}
+
+LRU_DECL1(int, Third, int, x)
+LRU_CACHED1(int, Third, int, x)
+{
+ return x / 3;
+}
+
+/**
+Test live resizing of caches and of pool caches by function name.
+*/
+void TestResize()
+{
+ CheckGhosts<LRUImpl::LRU<
+  boost::tuple<int>, int, 10, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::TwoQueueEviction>
+ > >();
+ CheckGhosts<LRUImpl::LRU<
+  boost::tuple<int>, int, 10, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ARCEviction>
+ > >();
+
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::TinyLFUEviction>
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<>
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::BufferedEviction<> >
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::SLRUEviction>
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::TwoQueueEviction>
+ > >();
+ CheckResize<LRUImpl::LRU<
+  boost::tuple<int>, int, 100, LRUImpl::DefaultObjectLevelLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ARCEviction>
+ > >();
+
+ LRUImpl::_LRUPool& pool = LRUImpl::LRUPool::instance();
+
+ for(int i = 0; i < 1000; i++)
+  Third(i);
+
+ const std::size_t size = StatsOf("Third").size;
+
+ BOOST_CHECK(pool.Resize("Third", 10) == 1);
+ BOOST_CHECK(pool.Resize("Nothing", 10) == 0);
+
+ // Purged by refresh workers, sharded capacity is rounded up by shards.
+ LRUImpl::LRUStats s = StatsOf("Third");
+ for(int i = 0; i < 100 && s.size > s.capacity; i++)
+ {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  s = StatsOf("Third");
+ }
+
+ BOOST_CHECK(s.capacity >= 10 && s.capacity <= 10 + LRU_DEFAULT_SHARDS);
+ BOOST_CHECK(size > s.capacity && s.size == s.capacity);
+
+ pool.Resize("Third", LRU_DEFAULT_CAPACITY);
+}
+
+/**
+Test saving caches to snapshots and warming them up.
+*/
+void TestSnapshot()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int, std::string>, std::vector<int>, 100
+ > Cache;
+
+ Cache c(100);
+ for(int i = 0; i < 100; i++)
+  c.Put(boost::make_tuple(i, std::string(i, 'k')), std::vector<int>(i, i));
+
+ bool found;
+ c.Get(boost::make_tuple(0, std::string()), NULL, &found);
+
+ std::ostringstream os;
+ BOOST_CHECK(LRUImpl::SaveRecords(c, os) == 100);
+
+ const std::string bytes = os.str();
+ const char* p = bytes.data();
+
+ // Records and recency are restored.
+ Cache w(100);
+ BOOST_CHECK(LRUImpl::LoadRecords(w, p, p + bytes.size()) == 100);
+
+ for(int i = 0; i < 100; i++)
+ {
+  const std::vector<int> v = 
+   w.Get(boost::make_tuple(i, std::string(i, 'k')), NULL, &found);
+
+  BOOST_CHECK(found && v == std::vector<int>(i, i));
+ }
+
+ Cache r(100);
+ LRUImpl::LoadRecords(r, p, p + bytes.size());
+ r.Put(boost::make_tuple(-1, std::string()), std::vector<int>());
+
+ BOOST_CHECK(r.Exists(boost::make_tuple(0, std::string())));
+ BOOST_CHECK(!r.Exists(boost::make_tuple(1, std::string(1, 'k'))));
+
+ // Truncated records stop loading.
+ Cache t(100);
+ const std::size_t n = LRUImpl::LoadRecords(t, p, p + bytes.size() / 2);
+ BOOST_CHECK(n > 0 && n < 100 && t.Stats().size == n);
+
+ // Addresses are not saved, even inside tuples and vectors.
+ BOOST_CHECK(LRUImpl::LRUSerializer<int[4]>::Supported);
+ BOOST_CHECK(!LRUImpl::LRUSerializer<const char*>::Supported);
+ BOOST_CHECK(!LRUImpl::LRUSerializer<int*[4]>::Supported);
+ BOOST_CHECK(!LRUImpl::LRUSerializer<std::size_t TimerCounter::*>::Supported);
+ BOOST_CHECK(!LRUImpl::LRUSerializer<std::vector<void*> >::Supported);
+ BOOST_CHECK(!(LRUImpl::LRUSerializer<boost::tuple<int, int*> >::Supported));
+ BOOST_CHECK(
+  !(LRUImpl::LRUSerializer<std::pair<int, std::string*> >::Supported));
+
+ // Pool caches are matched by name and types, not by unique key.
+ const char* path = "TestSnapshot.lru";
+ int x;
+
+ LRUImpl::_LRUPool saved(100);
+ x = 0;
+ saved.Register<LRUImpl::LRUConfig, int>(1, "Square", x);
+ saved.Register<LRUImpl::LRUConfig, double>(2, "Root", x);
+
+ for(x = 0; x < 10; x++)
+ {
+  int y = x * x;
+  saved.Put(1, y, x);
+ }
+
+ BOOST_CHECK(saved.Save(path) == 2);
+
+ LRUImpl::_LRUPool loaded(100);
+ BOOST_CHECK(loaded.Load(path) == 0);
+
+ x = 0;
+ loaded.Register<LRUImpl::LRUConfig, double>(3, "Square", x);
+ loaded.Register<LRUImpl::LRUConfig, int>(4, "Square", x);
+
+ loaded.Get<double>(3, found, x);
+ BOOST_CHECK(!found);
+
+ for(x = 0; x < 10; x++)
+  BOOST_CHECK(loaded.Get<int>(4, found, x) == x * x && found);
+
+ BOOST_CHECK(loaded.Load("Missing.lru") == 0);
+
+ std::remove(path);
+}
+
+
+#ifdef LRU_HAS_ROBUST_MUTEX
+
+/**
+Wait for forked process.
+
+@param pid Process id.
+@return True if it exited with 0.
+*/
+bool Succeeded(const pid_t pid)
+{
+ int status;
+
+ return waitpid(pid, &status, 0) == pid && 
+        WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+Hash function killing its process on key -2, so the process dies holding 
+the lock of a shared cache.
+*/
+struct DyingHash
+{
+ std::size_t operator()(const int k) const
+ {
+  if(k == -2)
+   kill(getpid(), SIGKILL);
+
+  return LRUImpl::LRUHash()(k);
+ }
+};
+
+/**
+Test cache shared by forked processes.
+*/
+void TestShared()
+{
+ typedef LRUImpl::SharedLRU<int, double> Cache;
+
+ std::ostringstream os;
+ os << "/lru_test_" << getpid();
+ const std::string name = os.str();
+
+ // Owner died holding mutex, next locker repairs.
+ LRUImpl::SharedMutex* m = new(
+  mmap(NULL, sizeof(LRUImpl::SharedMutex), PROT_READ | PROT_WRITE, 
+       MAP_SHARED | MAP_ANONYMOUS, -1, 0)
+ ) LRUImpl::SharedMutex();
+
+ pid_t pid = fork();
+ if(pid == 0)
+ {
+  m->Lock();
+  _exit(0);
+ }
+
+ BOOST_CHECK(Succeeded(pid));
+ BOOST_CHECK(m->Lock());
+ m->Unlock();
+ BOOST_CHECK(!m->Lock());
+ m->Unlock();
+
+ munmap(m, sizeof(LRUImpl::SharedMutex));
+
+ Cache::Remove(name);
+
+ {
+  Cache c(name, 1000);
+
+  // Workers fill their ranges, parent sees all of them.
+  const int Workers = 4;
+  pid_t pids[Workers];
+
+  for(int w = 0; w < Workers; w++)
+  {
+   pids[w] = fork();
+   if(pids[w] == 0)
+   {
+    Cache s(name, 1000);
+    int failures = 0;
+
+    for(int i = w * 200; i < (w + 1) * 200; i++)
+     s.Put(i, i * 0.5);
+
+    for(int i = w * 200; i < (w + 1) * 200; i++)
+    {
+     bool found;
+     if(s.Get(i, &found) != i * 0.5 || !found)
+      failures++;
+    }
+
+    _exit(failures ? 1 : 0);
+   }
+  }
+
+  for(int w = 0; w < Workers; w++)
+   BOOST_CHECK(Succeeded(pids[w]));
+
+  bool found;
+  std::size_t n = 0;
+
+  for(int i = 0; i < Workers * 200; i++)
+   if(c.Get(i, &found) == i * 0.5 && found)
+    n++;
+
+  BOOST_CHECK(n == Workers * 200);
+  BOOST_CHECK(c.Stats().inserts == n && c.Stats().size == n);
+
+  // Least-recently-used records are purged.
+  for(int i = 1000; i < 1300; i++)
+   c.Put(i, 1.0);
+
+  BOOST_CHECK(c.Stats().size == 1000 && c.Stats().evictions == 100);
+  BOOST_CHECK(!c.Exists(99) && c.Exists(100) && c.Exists(1299));
+
+  // Segment of other capacity is refused.
+  bool refused = false;
+  try
+  {
+   Cache other(name, 10);
+  }
+  catch(const boost::interprocess::interprocess_exception&)
+  {
+   refused = true;
+  }
+
+  BOOST_CHECK(refused);
+
+  // Worker killed holding the lock does not block others, records it 
+  // may have left half-updated are dropped once.
+  BOOST_CHECK(c.Recoveries() == 0);
+
+  pid = fork();
+  if(pid == 0)
+  {
+   LRUImpl::SharedLRU<int, double, DyingHash> s(name, 1000);
+
+   s.Put(-2, 1.0);
+   _exit(0);
+  }
+
+  BOOST_CHECK(!Succeeded(pid));
+
+  c.Put(-1, 2.0);
+  BOOST_CHECK(c.Get(-1, &found) == 2.0 && found);
+  BOOST_CHECK(c.Recoveries() == 1);
+  BOOST_CHECK(c.Stats().size == 1 && !c.Exists(1299));
+
+  // Segment is consistent, it fills and purges as before.
+  for(int i = 0; i < 1200; i++)
+   c.Put(i, i * 0.5);
+
+  n = 0;
+  for(int i = 200; i < 1200; i++)
+   if(c.Get(i, &found) == i * 0.5 && found)
+    n++;
+
+  BOOST_CHECK(n == 1000 && c.Stats().size == 1000);
+  BOOST_CHECK(!c.Exists(-1) && !c.Exists(199) && c.Recoveries() == 1);
+ }
+
+ BOOST_CHECK(Cache::Remove(name));
+}
+
+#endif
+
+
+/**
+Key counting its copies.
+*/
+struct Counted
+{
+ explicit Counted(const int v = 0) : value(v)
+ {
+ }
+
+ Counted(const Counted& c) : value(c.value)
+ {
+  copies++;
+ }
+
+ bool operator==(const Counted& c) const
+ {
+  return value == c.value;
+ }
+
+ int value;
+
+ static int copies;
+};
+
+int Counted::copies = 0;
+
+std::size_t hash_value(const Counted& c)
+{
+ return boost::hash<int>()(c.value);
+}
+
+/**
+Check probing a cache by view of keys, flat storage does not copy keys.
+
+@param copyless Keys are not copied to probe.
+*/
+template<typename Cache>
+void CheckView(const bool copyless)
+{
+ typedef typename Cache::ViewType View;
+
+ Cache c(100);
+
+ for(int i = 0; i < 50; i++)
+  c.Put(boost::make_tuple(Counted(i), i), i);
+
+ Counted::copies = 0;
+
+ bool found = false;
+ for(int i = 0; i < 50; i++)
+ {
+  const Counted k(i);
+
+  BOOST_CHECK(c.Get(View(k, i), NULL, &found) == i && found);
+  BOOST_CHECK(c.Acquire(View(k, i), found) == i && found);
+ }
+
+ // Missed by view, key is built only to put the result.
+ const Counted k(-1);
+
+ c.Acquire(View(k, 1), found);
+ BOOST_CHECK(!found);
+
+ BOOST_CHECK(!copyless || Counted::copies == 0);
+
+ c.Complete(View(k, 1), 7);
+ BOOST_CHECK(c.Get(boost::make_tuple(k, 1)) == 7);
+}
+
+/**
+Flat storage, probed by views of arguments.
+*/
+struct FlatViewConfig : LRUImpl::LRUConfig
+{
+ typedef LRUImpl::FlatStorage<> Storage;
+};
+
+/**
+Bimap storage, which builds the key of view to probe.
+*/
+struct BimapViewConfig : LRUImpl::LRUConfig
+{
+ typedef LRUImpl::BimapStorage Storage;
+};
+
+int measureCalls = 0;
+
+LRU_DECL2(int, Measure, const Counted&, x, const std::string&, s)
+LRU_CACHED_EX2(FlatViewConfig, int, Measure, const Counted&, x, 
+               const std::string&, s)
+{
+ ++measureCalls;
+
+ return x.value + (int)s.size();
+}
+
+LRU_DECL2(int, MeasureBimap, const Counted&, x, const std::string&, s)
+LRU_CACHED_EX2(BimapViewConfig, int, MeasureBimap, const Counted&, x, 
+               const std::string&, s)
+{
+ ++measureCalls;
+
+ return x.value - (int)s.size();
+}
+
+/**
+Test probing caches by views of keys, decorated functions probe by views 
+of their arguments.
+*/
+void TestView()
+{
+ typedef boost::tuple<Counted, int> Key;
+
+ // Bimap builds the key of view to probe.
+ CheckView<LRUImpl::LRU<
+  Key, int, 100, LRUImpl::DefaultObjectLevelLockable, LRUImpl::BimapStorage
+ > >(false);
+ CheckView<LRUImpl::LRU<
+  Key, int, 100, LRUImpl::DefaultObjectLevelRWLockable, 
+  LRUImpl::FlatStorage<LRUImpl::ClockEviction>
+ > >(true);
+ CheckView<LRUImpl::ShardedLRU<Key, int, 4> >(false);
+
+ const Counted x(3);
+ const std::string s("view");
+
+ BOOST_CHECK(Measure(x, s) == 7 && measureCalls == 1);
+
+ // Hits copy neither arguments nor keys.
+ Counted::copies = 0;
+ for(int i = 0; i < 10; i++)
+  BOOST_CHECK(Measure(x, s) == 7);
+
+ BOOST_CHECK(Counted::copies == 0 && measureCalls == 1);
+
+ // Bimap hits the same, missed arguments are evaluated once.
+ measureCalls = 0;
+ for(int i = 0; i < 10; i++)
+ {
+  const Counted y(i % 3);
+
+  BOOST_CHECK(MeasureBimap(y, s) == i % 3 - 4);
+ }
+
+ BOOST_CHECK(measureCalls == 3);
+}
+
+/**
+Hash by boost::hash, to compare LRUHash against.
+*/
+struct BoostHash
+{
+ template<typename K>
+ std::size_t operator()(const K& k) const
+ {
+  return boost::hash<K>()(k);
+ }
+};
+
+/**
+Largest number of keys hashed to a bucket of a power-of-two table.
+*/
+template<typename H, typename K>
+std::size_t MaxLoad(const std::vector<K>& keys, const unsigned bits)
+{
+ std::vector<std::size_t> buckets((std::size_t)1 << bits);
+ std::size_t max = 0;
+
+ for(std::size_t i = 0; i < keys.size(); i++)
+  max = (std::max)(max, ++buckets[H()(keys[i]) & (buckets.size() - 1)]);
+
+ return max;
+}
+
+/**
+Hash keys over and over, report time taken.
+*/
+template<typename H, typename K>
+void BenchmarkHash(const char* name, const char* shape, 
+                   const std::vector<K>& keys)
+{
+ TimeReporter _t;
+ const std::size_t loops = 4000000;
+ std::ostringstream os;
+ std::size_t n = 0;
+
+ os << "Test " << name << " " << shape << ".";
+ _t.Start(os.str());
+ for(std::size_t i = 0; i < loops; i++)
+  n += H()(keys[i % keys.size()]);
+ _t.End();
+
+ BOOST_CHECK(n != 0);
+}
+
+/**
+Test quality of LRUHash against boost::hash, and benchmark both over tuple 
+shapes of cached functions.
+*/
+void TestHash()
+{
+ typedef boost::tuple<int> IntKey;
+ typedef boost::tuple<int, int> PairKey;
+ typedef boost::tuple<std::string, int> MixedKey;
+
+ // Views hash as keys they view.
+ const std::string text("view of key");
+
+ BOOST_CHECK(LRUImpl::LRUHash()(MixedKey(text, 7)) == 
+  LRUImpl::LRUHash()(LRUImpl::LRUKeyView<MixedKey>::type(text, 7)));
+
+ // Strided IDs and grids cluster by boost::hash in power-of-two tables.
+ std::vector<IntKey> strided;
+ std::vector<PairKey> grid;
+
+ for(int i = 0; i < 1 << 16; i++)
+ {
+  strided.push_back(IntKey(i << 12));
+  grid.push_back(PairKey(i >> 8, i & 255));
+ }
+
+ const std::size_t stridedLoad = MaxLoad<LRUImpl::LRUHash>(strided, 16);
+ const std::size_t gridLoad = MaxLoad<LRUImpl::LRUHash>(grid, 16);
+
+ BOOST_TEST_MESSAGE("Max load of 65536 keys in 65536 buckets, strided: " << 
+                    "LRUHash " << stridedLoad << ", boost::hash " << 
+                    MaxLoad<BoostHash>(strided, 16) << "; grid: LRUHash " << 
+                    gridLoad << ", boost::hash " << 
+                    MaxLoad<BoostHash>(grid, 16) << ".");
+ BOOST_CHECK(stridedLoad < 16 && gridLoad < 16);
+
+ // Flipping a bit of key flips half of bits of hash.
+ double flips = 0;
+ for(int i = 0; i < 10000; i++)
+ {
+  const boost::uint64_t h = LRUImpl::LRUHasher<int>::Hash(i);
+
+  for(int b = 0; b < 32; b++)
+  {
+   boost::uint64_t d = h ^ LRUImpl::LRUHasher<int>::Hash(i ^ (1 << b));
+
+   for(; d; d &= d - 1)
+    flips++;
+  }
+ }
+
+ flips /= 10000 * 32;
+ BOOST_CHECK(flips > 31 && flips < 33);
+
+ // Strings of every length up to 3 stripes, and their 1-byte changes.
+ std::vector<boost::uint64_t> hashes;
+ std::string bytes;
+
+ for(int n = 0; n < 150; n++)
+ {
+  hashes.push_back(LRUImpl::LRUHasher<std::string>::Hash(bytes));
+
+  for(int i = 0; i < n; i++)
+  {
+   std::string changed(bytes);
+   changed[i] ^= 1;
+
+   hashes.push_back(LRUImpl::LRUHasher<std::string>::Hash(changed));
+  }
+
+  bytes.push_back((char)('a' + n % 26));
+ }
+
+ std::sort(hashes.begin(), hashes.end());
+ BOOST_CHECK(std::unique(hashes.begin(), hashes.end()) == hashes.end());
+
+ // Throughput over tuple shapes of cached functions.
+ std::vector<boost::tuple<int, int, int> > triples;
+ std::vector<boost::tuple<std::string> > shorts, longs;
+ std::vector<boost::tuple<int, std::string, double> > mixed;
+ std::vector<boost::tuple<std::vector<int> > > vectors;
+
+ for(int i = 0; i < 1024; i++)
+ {
+  std::ostringstream os;
+  os << "key-" << i * 7919;
+
+  triples.push_back(boost::make_tuple(i, i * 3, i * 5));
+  shorts.push_back(boost::make_tuple(os.str()));
+  longs.push_back(boost::make_tuple(os.str() + std::string(240, 'x')));
+  mixed.push_back(boost::make_tuple(i, os.str(), i * 0.5));
+  vectors.push_back(boost::make_tuple(std::vector<int>(64, i)));
+ }
+
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<int>", strided);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<int>", strided);
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<int, int, int>", triples);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<int, int, int>", 
+                                 triples);
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<string> short", shorts);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<string> short", shorts);
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<string> long", longs);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<string> long", longs);
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<int, string, double>", 
+                          mixed);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<int, string, double>", 
+                                 mixed);
+ BenchmarkHash<BoostHash>("boost::hash", "tuple<vector<int> >", vectors);
+ BenchmarkHash<LRUImpl::LRUHash>("LRUHash", "tuple<vector<int> >", vectors);
+}
+
+/**
+Fill a cache to capacity, then look up hits only and misses only.
+*/
+template<typename Cache>
+void BenchmarkProbing(const char* name, const std::size_t capacity)
+{
+ TimeReporter _t;
+ const int loops = 4000000;
+ const int size = (int)capacity;
+ long long n = 0;
+ bool found = true;
+ std::ostringstream os;
+
+ Cache c(capacity);
+
+ for(int i = 0; i < size; i++)
+  c.Put(boost::tuple<int>(i * 2), i);
+
+ os << "Test " << name << " hit " << capacity << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < loops; i++)
+ {
+  const int k = (int)((i * 2654435761U) % size);
+
+  n += c.Get(boost::tuple<int>(k * 2), NULL, &found);
+ }
+ _t.End();
+
+ BOOST_CHECK(found);
+
+ os.str("");
+ os << "Test " << name << " miss " << capacity << ".";
+ _t.Start(os.str());
+ for(int i = 0; i < loops; i++)
+ {
+  const int k = (int)((i * 2654435761U) % size);
+
+  n += c.Get(boost::tuple<int>(k * 2 + 1), NULL, &found);
+ }
+ _t.End();
+
+ BOOST_CHECK(!found && n != 0);
+}
+
+/**
+Test GroupProbing index against BimapStorage, and benchmark lookups of it 
+against SlotProbing.
+*/
+void TestGroupProbing()
+{
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable
+ > BimapCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<>
+ > SlotCache;
+ typedef LRUImpl::LRU<
+  boost::tuple<int>, int, 4096, LRUImpl::DefaultNullLockable, 
+  LRUImpl::FlatStorage<LRUImpl::LRUEviction, LRUImpl::GroupProbing>
+ > GroupCache;
+
+ BimapCache bc(16);
+ GroupCache gc(16);
+ bool found1, found2;
+
+ // Grow and shrink through index doubling and migration, erase by 
+ // backward shifting.
+ std::srand(2);
+ for(int i = 0; i < 300000; i++)
+ {
+  const boost::tuple<int> k(std::rand() % 20000);
+
+  if(i % 20000 == 0)
+  {
+   const std::size_t size = 16 << (i / 20000 % 11);
+
+   bc.Resize(size);
+   gc.Resize(size);
+  }
+
+  switch(i % 4)
+  {
+  case 0:
+  case 1:
+   bc.Put(k, i);
+   gc.Put(k, i);
+   break;
+  case 2:
+   BOOST_CHECK(bc.Get(k, NULL, &found1) == gc.Get(k, NULL, &found2));
+   BOOST_CHECK(found1 == found2);
+   break;
+  default:
+   bc.Erase(k);
+   gc.Erase(k);
+  }
+ }
+
+ std::vector<boost::tuple<int> > keys1, keys2;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it1(keys1);
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it2(keys2);
+ bc.GetKeys(it1);
+ gc.GetKeys(it2);
+
+ BOOST_CHECK(!keys1.empty());
+ BOOST_CHECK(keys1 == keys2);
+
+ BenchmarkProbing<SlotCache>("SlotProbing", 1 << 16);
+ BenchmarkProbing<GroupCache>("GroupProbing", 1 << 16);
+ BenchmarkProbing<SlotCache>("SlotProbing", 1 << 20);
+ BenchmarkProbing<GroupCache>("GroupProbing", 1 << 20);
+#ifdef LRU_TEST_LARGE
+ BenchmarkProbing<SlotCache>("SlotProbing", 1 << 24);
+ BenchmarkProbing<GroupCache>("GroupProbing", 1 << 24);
+#endif
+}
+
+/**
+Put and get keys over capacity of container as LRU does, after the first 
+round every insertion purges the least recently used record.
+
+@param c Container.
+@param rounds Rounds over keys.
+@param keys Number of keys.
+@param capacity Records kept.
+*/
+template<typename Container>
+void Churn(Container& c, const int rounds, const int keys, 
+           const std::size_t capacity)
+{
+ typename Container::Position pos;
+
+ for(int r = 0; r < rounds; r++)
+ {
+  for(int i = 0; i < keys; i++)
+  {
+   c.Insert(boost::tuple<int>(r * keys + i), i, NULL);
+   while(c.Size() > capacity)
+    c.Evict(c.Victim());
+
+   const typename Container::Iterator it = 
+    c.Find(boost::tuple<int>(r * keys + i / 2), pos);
+   if(it != c.End())
+    c.Touch(it);
+  }
+ }
+}
+
+/**
+Test records of full bimap containers are purged and inserted without heap 
+traffic, counted by their slab, and chunks of nodes are returned to heap 
+after shrinking.
+*/
+void TestSlab()
+{
+ typedef LRUImpl::BimapContainer<boost::tuple<int>, int> Container;
+
+ // Blocks kept after shrinking move to one chunk as they are
+ // replaced, the others are returned as they empty.
+ LRUImpl::Slab slab;
+ std::vector<void*> blocks;
+
+ for(int i = 0; i < 4096; i++)
+  blocks.push_back(slab.Allocate(32, true));
+
+ for(int i = 0; i < 4096; i++)
+ {
+  if(i % 64)
+   slab.Deallocate(blocks[i], 32, true);
+ }
+
+ BOOST_CHECK(slab.Chunks() == 16);
+
+ slab.Shrink();
+ for(int i = 0; i < 4096; i += 64)
+ {
+  void* p = slab.Allocate(32, true);
+
+  slab.Deallocate(blocks[i], 32, true);
+  blocks[i] = p;
+ }
+
+ BOOST_CHECK(slab.Chunks() == 1);
+
+ for(int i = 0; i < 4096; i += 64)
+  slab.Deallocate(blocks[i], 32, true);
+
+ Container c;
+ const LRUImpl::Slab& nodes = c.Nodes();
+ std::size_t n;
+
+ // Warm up to capacity.
+ Churn(c, 2, 10000, 10000);
+
+ n = nodes.Allocations();
+ Churn(c, 10, 10000, 10000);
+ BOOST_CHECK_EQUAL(nodes.Allocations() - n, 0U);
+
+ std::vector<boost::tuple<int> > keys1, keys2;
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it1(keys1);
+ std::back_insert_iterator<std::vector<boost::tuple<int> > > it2(keys2);
+ c.GetKeys(it1);
+ keys1.resize(100);
+
+ // Chunks are returned as records left by shrinking are replaced, records
+ // kept stay in order.
+ n = nodes.Deallocations();
+ c.Compact();
+ while(c.Size() > 100)
+  c.Evict(c.Victim());
+
+ c.GetKeys(it2);
+ BOOST_CHECK(keys1 == keys2);
+
+ Churn(c, 2, 100, 100);
+ BOOST_CHECK(nodes.Deallocations() - n >= 
+             10000 / LRUImpl::Slab::ChunkBlocks - 1);
+
+ // Then no more heap traffic at smaller capacity.
+ n = nodes.Allocations();
+ Churn(c, 10, 100, 100);
+ BOOST_CHECK_EQUAL(nodes.Allocations() - n, 0U);
+
+ // Growing back allocates chunks again, then no more.
+ Churn(c, 2, 10000, 10000);
+
+ n = nodes.Allocations();
+ Churn(c, 5, 10000, 10000);
+ BOOST_CHECK_EQUAL(nodes.Allocations() - n, 0U);
+
+ BOOST_CHECK(c.Size() == 10000);
+}
+
+#endif
@@ -1,24 +1,51 @@
-/**
-Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
-
-Distributed under the Boost Software License, Version 1.0.
-See accompanying file LICENSE_1_0.txt or copy at
-http://www.boost.org/LICENSE_1_0.txt
-
-See the License for the specific language governing permissions and
-limitations under the License.
-*/
-
-#include "TestSuite.hpp"
-#include "LRUTest.hpp"
-
-test_suite* init_unit_test_suite(int, char*[]) 
-{
- test_suite* test = BOOST_TEST_SUITE("LRU Test Suite");
-
- // Add test functions here.
- test->add(BOOST_TEST_CASE(&TestFib));
- test->add(BOOST_TEST_CASE(&TestFactorial));
-
- return test;
-}
+/**
+Copyright (c) 2015 Nuwa Information Co., Ltd, All Rights Reserved.
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+http://www.boost.org/LICENSE_1_0.txt
+
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "TestSuite.hpp"
+#include "LRUTest.hpp"
+
+test_suite* init_unit_test_suite(int, char*[]) 
+{
+ test_suite* test = BOOST_TEST_SUITE("LRU Test Suite");
+
+ // Add test functions here.
+ test->add(BOOST_TEST_CASE(&TestFib));
+ test->add(BOOST_TEST_CASE(&TestFactorial));
+ test->add(BOOST_TEST_CASE(&TestCacheHandle));
+ test->add(BOOST_TEST_CASE(&TestGetOrCompute));
+ test->add(BOOST_TEST_CASE(&TestShardedLRU));
+ test->add(BOOST_TEST_CASE(&TestSingleFlight));
+ test->add(BOOST_TEST_CASE(&TestFlatStorage));
+ test->add(BOOST_TEST_CASE(&TestClockEviction));
+ test->add(BOOST_TEST_CASE(&TestBufferedEviction));
+ test->add(BOOST_TEST_CASE(&TestTinyLFUEviction));
+ test->add(BOOST_TEST_CASE(&TestEvictionPolicies));
+ test->add(BOOST_TEST_CASE(&TestWeigher));
+ test->add(BOOST_TEST_CASE(&TestExpiry));
+ test->add(BOOST_TEST_CASE(&TestRefresh));
+ test->add(BOOST_TEST_CASE(&TestAsync));
+ test->add(BOOST_TEST_CASE(&TestBatch));
+ test->add(BOOST_TEST_CASE(&TestStats));
+ test->add(BOOST_TEST_CASE(&TestLatency));
+ test->add(BOOST_TEST_CASE(&TestBudget));
+ test->add(BOOST_TEST_CASE(&TestCurve));
+ test->add(BOOST_TEST_CASE(&TestResize));
+ test->add(BOOST_TEST_CASE(&TestSnapshot));
+#ifdef LRU_HAS_ROBUST_MUTEX
+ test->add(BOOST_TEST_CASE(&TestShared));
+#endif
+ test->add(BOOST_TEST_CASE(&TestView));
+ test->add(BOOST_TEST_CASE(&TestHash));
+ test->add(BOOST_TEST_CASE(&TestGroupProbing));
+ test->add(BOOST_TEST_CASE(&TestSlab));
+
+ return test;
+}